@@ -19,7 +19,12 @@
 #include <complex>
 #include <cstdint>
 #include <cassert>
+#include <cmath>
+#include <limits>
+#include <thread>
+#include <future>
 #include <vector>
+#include <random>
 
 #if !defined(__ANDROID__) && !defined(__arm__) && !defined(__aarch64__)
 #include <xmmintrin.h>
@@ -28,11 +33,16 @@
 #include <fftw3.h>
 
 #include "alignedmalloc.h"
+#include "arena.h"
 #include "factorial.h"
+#include "fftplancache.h"
+#include "ctpl/ctpl_stl.h"
 
 #define WRAP_WITH_MEMCPY
 #define FILTERSIZE_LIMIT 131071
 #define FILTERSIZE_BASE 103
+#define FILTER_DESIGN_BLOCK_SIZE 256				// taps per work item in filter design functions
+#define FILTER_DESIGN_PARALLEL_THRESHOLD 16384		// filters at least this long are designed using multiple threads
 
 #ifdef USE_AVX
 
@@ -58,14 +68,79 @@
 #endif
 #endif
 
+// flushDenormals() : set the calling thread to flush denormal results to zero (FTZ), and to treat denormal operands as zero (DAZ).
+// (the decaying tails of filter responses produce denormals, which many CPUs handle very slowly)
+// Returns false if this isn't supported on the target.
+inline bool flushDenormals() {
+
+#if !defined(__ANDROID__) && !defined(__arm__) && !defined(__aarch64__)
+	_mm_setcsr(_mm_getcsr() | 0x8040); // (MXCSR bits: FTZ = 0x8000, DAZ = 0x0040)
+	return true;
+#elif defined(__aarch64__) && defined(__GNUC__)
+	uint64_t fpcr;
+	__asm__ __volatile__("mrs %0, fpcr" : "=r"(fpcr));
+	__asm__ __volatile__("msr fpcr, %0" : : "r"(fpcr | (1ULL << 24))); // (FZ: flush denormal operands and results to zero)
+	return true;
+#else
+	return false;
+#endif
+
+}
+
+// Error-free transformations, used for compensated ("double-double") accumulation in extended-precision mode.
+// (see Ogita, Rump & Oishi, "Accurate Sum and Dot Product", SIAM J. Sci. Comput. 26(6), 2005)
+
+// twoSum() : s + e == a + b exactly
+template <typename FloatType>
+inline void twoSum(FloatType a, FloatType b, FloatType& s, FloatType& e) {
+	s = a + b;
+	FloatType bb = s - a;
+	e = (a - (s - bb)) + (b - bb);
+}
+
+// twoProduct() : p + e == a * b exactly
+template <typename FloatType>
+inline void twoProduct(FloatType a, FloatType b, FloatType& p, FloatType& e) {
+	p = a * b;
+#if defined(USE_FMA) || defined(__FMA__) // (note: if FMA is available, compiler may contract Dekker's algorithm incorrectly)
+	e = std::fma(a, b, -p);
+#else
+	// Dekker's algorithm, with Veltkamp splitting:
+	const FloatType splitter = static_cast<FloatType>((1 << ((std::numeric_limits<FloatType>::digits + 1) / 2)) + 1);
+	FloatType ca = splitter * a;
+	FloatType ah = ca - (ca - a);
+	FloatType al = a - ah;
+	FloatType cb = splitter * b;
+	FloatType bh = cb - (cb - b);
+	FloatType bl = b - bh;
+	e = ((ah * bh - p) + ah * bl + al * bh) + al * bl;
+#endif
+}
+
+// sumCompensatedLanes() : sum n partial sums and their compensation terms into a single value
+template <typename FloatType>
+inline FloatType sumCompensatedLanes(const FloatType* sums, const FloatType* compensations, int n) {
+	FloatType sum = 0.0;
+	FloatType compensation = 0.0;
+	for (int i = 0; i < n; i++) {
+		FloatType e;
+		twoSum(sum, sums[i], sum, e);
+		compensation += e + compensations[i];
+	}
+	return sum + compensation;
+}
+
 template <typename FloatType>
 class FIRFilter {
 
 public:
 
 	// constructor:
-	FIRFilter(const FloatType* taps, int length) :
-		length(length), signal(nullptr), currentIndex(length-1), lastPut(0)
+	// (if an arena is given, the signal buffer and kernel tables are allocated from it, and stay there for the life of the arena)
+	// bTapsOnly: only keep the taps (for a filter which is never run, but only used to build other filters from - see getTaps());
+	// there is no signal buffer, and no additional kernel phases
+	FIRFilter(const FloatType* taps, int length, Arena* arena = nullptr, bool bTapsOnly = false) :
+		length(length), signal(nullptr), currentIndex(length-1), lastPut(0), bExtendedPrecision(false), ownsBuffers(arena == nullptr)
 
 	{
 		calcPaddedLength();
@@ -74,13 +149,20 @@ public:
 			kernelphases[i] = nullptr;
 		}
 
-		allocateBuffers();
+		allocateBuffers(arena, bTapsOnly);
 		assertAlignment();
-		clearBuffers();
+		if (ownsBuffers) {
+			clearBuffers(); // (arena memory is already zero-filled)
+		}
 
 		// initialize filter kernel and signal buffers
 		for (int i = 0; i < length; ++i) {
 			kernelphases[0][i] = taps[i];
+		}
+		if (bTapsOnly) {
+			return;
+		}
+		for (int i = 0; i < length; ++i) {
 			signal[i] = 0.0;
 			signal[i + length] = 0.0;
 		}
@@ -96,18 +178,13 @@ public:
 		freeBuffers();
 	}
 
-	// copy constructor:
-	FIRFilter(const FIRFilter& other) : length(other.length), currentIndex(other.currentIndex), lastPut(other.lastPut)
-	{
-		calcPaddedLength();
-		allocateBuffers();
-		assertAlignment();
-		copyBuffers(other);
-	}
+	// FIRFilter is move-only (the kernel tables are built once, and then only change hands):
+	FIRFilter(const FIRFilter& other) = delete;
+	FIRFilter& operator= (const FIRFilter& other) = delete;
 
 	// move constructor:
 	FIRFilter(FIRFilter&& other) noexcept :
-		length(other.length), signal(other.signal), currentIndex(other.currentIndex), lastPut(other.lastPut)
+		length(other.length), signal(other.signal), currentIndex(other.currentIndex), lastPut(other.lastPut), bExtendedPrecision(other.bExtendedPrecision), ownsBuffers(other.ownsBuffers)
 	{
 		calcPaddedLength();
 
@@ -120,20 +197,6 @@ public:
 		assertAlignment();
 	}
 
-	// copy assignment:
-	FIRFilter& operator= (const FIRFilter& other)
-	{
-		length = other.length;
-		calcPaddedLength();
-		currentIndex = other.currentIndex;
-		lastPut = other.lastPut;
-		freeBuffers();
-		allocateBuffers();
-		assertAlignment();
-		copyBuffers(other);
-		return *this;
-	}
-
 	// move assignment:
 	FIRFilter& operator= (FIRFilter&& other) noexcept
 	{
@@ -143,9 +206,11 @@ public:
 		   	calcPaddedLength();
 			currentIndex = other.currentIndex;
 			lastPut = other.lastPut;
+			bExtendedPrecision = other.bExtendedPrecision;
 
 			freeBuffers();
-			
+			ownsBuffers = other.ownsBuffers;
+
 			signal = other.signal;
 			for(int i = 0; i < numVecElements; i++) {
 				kernelphases[i] = other.kernelphases[i];
@@ -170,9 +235,12 @@ public:
 		return true;
 	}
 
-	void reset() {
+	// reset() : clear the history. The write position is set to where it would be after 'position' samples had been put,
+	// so that a filter restarted part-way through a signal adds up its products in the same order (and gets bit-identical results)
+	// as one which has been running since the start of the signal (the SIMD get() functions group the taps according to the write position)
+	void reset(uint64_t position = 0) {
 		// reset indexes:
-		currentIndex = length - 1;
+		currentIndex = length - 1 - static_cast<int>(position % static_cast<uint64_t>(length));
 		lastPut = 0;
 
 		// clear signal buffer
@@ -221,8 +289,59 @@ public:
 			--currentIndex;
 	}
 
+	// skipZeros() : equivalent to putZeros(n), provided that the history holds nothing but zeros (then only the write position moves)
+	void skipZeros(uint64_t n) {
+
+#ifdef WRAP_WITH_MEMCPY
+		if (n > static_cast<uint64_t>(currentIndex)) { // (passes the wrap point: the upper half may still hold the history from before the zeros)
+			memcpy(signal + length, signal, length * sizeof(FloatType)); // copy history to upper half of buffer
+		}
+#endif
+
+		currentIndex -= static_cast<int>(n % static_cast<uint64_t>(length));
+		if (currentIndex < 0) {
+			currentIndex += length; // Wrap
+		}
+	}
+
+	// putZeros() : equivalent to calling putZero() n times
+	void putZeros(int n) {
+		if (n <= 16) { // (a few zeros: cheaper one at a time)
+			for (; n > 0; --n) {
+				putZero();
+			}
+			return;
+		}
+		while (n > 0) {
+			int count = std::min(n, currentIndex + 1); // (positions currentIndex down to 0, before wrapping)
+			int first = currentIndex - count + 1;
+			memset(signal + first, 0, count * sizeof(FloatType));
+
+#ifndef WRAP_WITH_MEMCPY
+			memset(signal + first + length, 0, count * sizeof(FloatType));
+#endif
+
+			n -= count;
+			currentIndex -= count;
+			if (currentIndex < 0) {
+				currentIndex = length - 1; // Wrap
+
+#ifdef WRAP_WITH_MEMCPY
+				memcpy(signal + length, signal, length * sizeof(FloatType)); // copy history to upper half of buffer
+#endif
+
+			}
+		}
+	}
+
 	FloatType get() {
 
+#ifndef FIR_QUAD_PRECISION // (quad-precision builds ignore extended precision here: accumulating in quad precision is more accurate)
+		if (bExtendedPrecision) {
+			return getCompensated();
+		}
+#endif
+
 #ifdef FIR_QUAD_PRECISION
 
 		// scalar processing of quad-precision types
@@ -308,7 +427,50 @@ public:
 
 	}
 
+	// getCompensated() : calculate output using compensated (double-double) accumulation.
+	// Error is about the same as if the dot product was calculated with twice the working precision, and then rounded.
+	FloatType getCompensated() {
+		FloatType sum = 0.0;
+		FloatType compensation = 0.0;
+		int index = currentIndex;
+		for (int i = 0; i < length; ++i) {
+			FloatType p, ep, es;
+			twoProduct(signal[index], kernelphases[0][i], p, ep);
+			twoSum(sum, p, sum, es);
+			compensation += ep + es;
+			index++;
+		}
+		return sum + compensation;
+	}
+
+	int getLength() const {
+		return length;
+	}
+
+	// getTaps() : returns a copy of the filter coefficients
+	std::vector<FloatType> getTaps() const {
+		return std::vector<FloatType>(kernelphases[0], kernelphases[0] + length);
+	}
+
+	// getMemorySize() : size (in bytes) of the signal buffer and kernel tables (ie the filter's contribution to the working set)
+	size_t getMemorySize() const {
+		return static_cast<size_t>(2 + numVecElements) * paddedLength * sizeof(FloatType);
+	}
+
+	// setExtendedPrecision() : select compensated accumulation for get() and lazyGet()
+	void setExtendedPrecision(bool bExtendedPrecision) {
+		FIRFilter::bExtendedPrecision = bExtendedPrecision;
+	}
+
+	bool isExtendedPrecision() const {
+		return bExtendedPrecision;
+	}
+
 	FloatType lazyGet(int L) {	// Skips stuffed-zeros introduced by interpolation, by only calculating every Lth sample from lastPut
+		if (bExtendedPrecision) {
+			return lazyGetCompensated(L);
+		}
+
 		FloatType output = 0.0;
 		int offset = lastPut - currentIndex;
 		if (offset < 0) { // Wrap condition
@@ -321,6 +483,23 @@ public:
 		return output;
 	}
 
+	FloatType lazyGetCompensated(int L) {	// lazyGet() with compensated accumulation
+		FloatType sum = 0.0;
+		FloatType compensation = 0.0;
+		int offset = lastPut - currentIndex;
+		if (offset < 0) { // Wrap condition
+			offset += length;
+		}
+
+		for (int i = offset; i < length; i += L) {
+			FloatType p, ep, es;
+			twoProduct(signal[i + currentIndex], kernelphases[0][i], p, ep);
+			twoSum(sum, p, sum, es);
+			compensation += ep + es;
+		}
+		return sum + compensation;
+	}
+
 private:
 	int length;
 	int paddedLength;
@@ -328,6 +507,8 @@ private:
 	FloatType* signal; // Double-length signal buffer, to facilitate fast emulation of a circular buffe
 	int currentIndex;
 	int lastPut;
+	bool bExtendedPrecision;
+	bool ownsBuffers; // (false: buffers are in an arena, which owns them)
 	int numVecElements;
 	uintptr_t alignMask;
 
@@ -348,36 +529,44 @@ private:
 		paddedLength = (length & alignMask) + numVecElements;
 	}
 
-	void allocateBuffers()
+	// allocateBuffers() : allocate the signal buffer and kernel tables together, in one block (from arena, if not nullptr)
+	// (bTapsOnly: just the first kernel table)
+	void allocateBuffers(Arena* arena, bool bTapsOnly)
 	{
-		signal = static_cast<FloatType*>(aligned_malloc((paddedLength + length) * sizeof(FloatType), ALIGNMENT_SIZE));
-		for(int i = 0; i < numVecElements; i++) {
-			kernelphases[i] = static_cast<FloatType*>(aligned_malloc(paddedLength * sizeof(FloatType), ALIGNMENT_SIZE));
+		size_t signalSize = bTapsOnly ? 0 : getSignalBufferSize();
+		int numPhases = bTapsOnly ? 1 : numVecElements;
+		size_t blockSize = signalSize + static_cast<size_t>(numPhases) * paddedLength;
+		FloatType* block = (arena != nullptr) ?
+			arena->allocateArray<FloatType>(blockSize, ALIGNMENT_SIZE) :
+			static_cast<FloatType*>(aligned_malloc(blockSize * sizeof(FloatType), ALIGNMENT_SIZE));
+		signal = bTapsOnly ? nullptr : block;
+		for(int i = 0; i < numPhases; i++) {
+			kernelphases[i] = block + signalSize + static_cast<size_t>(i) * paddedLength;
 		}
 	}
 
-	void clearBuffers()
+	// getSignalBufferSize() : size of signal buffer (paddedLength + length), rounded up to keep the kernel tables after it aligned
+	size_t getSignalBufferSize() const
 	{
-		memset(signal, 0.0, (paddedLength + length) * sizeof(FloatType));
-		for(int i = 0; i < numVecElements; i++) {
-			memset(kernelphases[i], 0.0, paddedLength * sizeof(FloatType));
-		}
+		return (static_cast<size_t>(paddedLength + length) + numVecElements - 1) & alignMask;
 	}
 
-	void copyBuffers(const FIRFilter& other)
+	void clearBuffers()
 	{
-		memcpy(signal, other.signal, (paddedLength + length) * sizeof(FloatType));
-		for(int i = 0; i < numVecElements; i++) {
-			memcpy(kernelphases[i], other.kernelphases[i], paddedLength * sizeof(FloatType));
+		if (signal != nullptr) {
+			memset(signal, 0.0, (paddedLength + length) * sizeof(FloatType));
+		}
+		for(int i = 0; i < numVecElements && kernelphases[i] != nullptr; i++) {
+			memset(kernelphases[i], 0.0, paddedLength * sizeof(FloatType));
 		}
 	}
 
 	void freeBuffers()
 	{
-		aligned_free(signal);
-		for(int i = 0; i < numVecElements; i++) {
-			aligned_free(kernelphases[i]);
+		if (ownsBuffers) {
+			aligned_free(signal != nullptr ? signal : kernelphases[0]); // (kernel tables are in the same block as the signal buffer, if there is one)
 		}
+		signal = nullptr;
 	}
 	
 	// assertAlignment() : asserts that all private data buffers are aligned on expected boundaries
@@ -418,11 +607,65 @@ static inline double sum4doubles(__m256d x) {
 
 #if defined(USE_AVX)
 
+template <>
+double FIRFilter<double>::getCompensated() {
+
+	// AVX implementation of compensated dot product: four independent (sum, compensation) pairs
+
+	int index = currentIndex & -4; // make multiple-of-four
+	int phase = currentIndex & 3;
+	double* kernel = kernelphases[phase];
+
+	__m256d sum = _mm256_setzero_pd();
+	__m256d compensation = _mm256_setzero_pd();
+
+#ifndef USE_FMA
+	const __m256d splitter = _mm256_set1_pd(134217729.0); // 2^27 + 1
+#endif
+
+	for (int i = 0; i < paddedLength; i += 4) {
+		__m256d s = _mm256_load_pd(signal + index + i);
+		__m256d k = _mm256_load_pd(kernel + i);
+
+		// twoProduct:
+		__m256d p = _mm256_mul_pd(s, k);
+#ifdef USE_FMA
+		__m256d ep = _mm256_fmsub_pd(s, k, p);
+#else
+		__m256d cs = _mm256_mul_pd(splitter, s);
+		__m256d sh = _mm256_sub_pd(cs, _mm256_sub_pd(cs, s));
+		__m256d sl = _mm256_sub_pd(s, sh);
+		__m256d ck = _mm256_mul_pd(splitter, k);
+		__m256d kh = _mm256_sub_pd(ck, _mm256_sub_pd(ck, k));
+		__m256d kl = _mm256_sub_pd(k, kh);
+		__m256d ep = _mm256_add_pd(_mm256_add_pd(_mm256_add_pd(_mm256_sub_pd(_mm256_mul_pd(sh, kh), p), _mm256_mul_pd(sh, kl)), _mm256_mul_pd(sl, kh)), _mm256_mul_pd(sl, kl));
+#endif
+
+		// twoSum:
+		__m256d t = _mm256_add_pd(sum, p);
+		__m256d bb = _mm256_sub_pd(t, sum);
+		__m256d es = _mm256_add_pd(_mm256_sub_pd(sum, _mm256_sub_pd(t, bb)), _mm256_sub_pd(p, bb));
+		sum = t;
+
+		compensation = _mm256_add_pd(compensation, _mm256_add_pd(ep, es));
+	}
+
+	alignas(ALIGNMENT_SIZE) double sums[4];
+	alignas(ALIGNMENT_SIZE) double compensations[4];
+	_mm256_store_pd(sums, sum);
+	_mm256_store_pd(compensations, compensation);
+	return sumCompensatedLanes(sums, compensations, 4);
+}
+
 template <>
 double FIRFilter<double>::get() {
 
 	// AVX implementation: Processes four doubles at a time.
 
+	if (bExtendedPrecision) {
+		return getCompensated();
+	}
+
 	double output = 0.0;
 	int index = currentIndex & -4; // make multiple-of-four
 	int phase = currentIndex & 3;
@@ -453,11 +696,58 @@ double FIRFilter<double>::get() {
 
 #elif defined(USE_SIMD) && defined(USE_SIMD_FOR_DOUBLES) && !defined(FIR_QUAD_PRECISION)
 
+template <>
+double FIRFilter<double>::getCompensated() {
+
+	// SSE implementation of compensated dot product: two independent (sum, compensation) pairs
+
+	int index = currentIndex & -2; // make multiple-of-two
+	int phase = currentIndex & 1;
+	double* kernel = kernelphases[phase];
+
+	__m128d sum = _mm_setzero_pd();
+	__m128d compensation = _mm_setzero_pd();
+	const __m128d splitter = _mm_set1_pd(134217729.0); // 2^27 + 1
+
+	for (int i = 0; i < paddedLength; i += 2) {
+		__m128d s = _mm_load_pd(signal + index + i);
+		__m128d k = _mm_load_pd(kernel + i);
+
+		// twoProduct (Dekker):
+		__m128d p = _mm_mul_pd(s, k);
+		__m128d cs = _mm_mul_pd(splitter, s);
+		__m128d sh = _mm_sub_pd(cs, _mm_sub_pd(cs, s));
+		__m128d sl = _mm_sub_pd(s, sh);
+		__m128d ck = _mm_mul_pd(splitter, k);
+		__m128d kh = _mm_sub_pd(ck, _mm_sub_pd(ck, k));
+		__m128d kl = _mm_sub_pd(k, kh);
+		__m128d ep = _mm_add_pd(_mm_add_pd(_mm_add_pd(_mm_sub_pd(_mm_mul_pd(sh, kh), p), _mm_mul_pd(sh, kl)), _mm_mul_pd(sl, kh)), _mm_mul_pd(sl, kl));
+
+		// twoSum:
+		__m128d t = _mm_add_pd(sum, p);
+		__m128d bb = _mm_sub_pd(t, sum);
+		__m128d es = _mm_add_pd(_mm_sub_pd(sum, _mm_sub_pd(t, bb)), _mm_sub_pd(p, bb));
+		sum = t;
+
+		compensation = _mm_add_pd(compensation, _mm_add_pd(ep, es));
+	}
+
+	alignas(ALIGNMENT_SIZE) double sums[2];
+	alignas(ALIGNMENT_SIZE) double compensations[2];
+	_mm_store_pd(sums, sum);
+	_mm_store_pd(compensations, compensation);
+	return sumCompensatedLanes(sums, compensations, 2);
+}
+
 template <>
 double FIRFilter<double>::get() {
 
 	// SSE Implementation: Processes two doubles at a time.
 
+	if (bExtendedPrecision) {
+		return getCompensated();
+	}
+
 	double output = 0.0;
 	double* kernel;
 	int index = currentIndex & -2; // make multiple-of-two
@@ -487,12 +777,156 @@ double FIRFilter<double>::get() {
 
 #endif // double specialisation
 
+// exactSum() : sum of values, accurate to within one unit in the last place (Shewchuk's algorithm, as in Python's math.fsum():
+// the running sum is held exactly, as a list of non-overlapping partial sums, in increasing order of magnitude)
+inline double exactSum(const std::vector<double>& values) {
+	std::vector<double> partials;
+	for (double x : values) {
+		size_t n = 0;
+		for (size_t i = 0; i < partials.size(); i++) {
+			double y = partials[i];
+			if (std::fabs(x) < std::fabs(y)) {
+				std::swap(x, y);
+			}
+			double hi = x + y;
+			double lo = y - (hi - x);
+			if (lo != 0.0) {
+				partials[n++] = lo;
+			}
+			x = hi;
+		}
+		partials.resize(n);
+		partials.push_back(x);
+	}
+	double sum = 0.0;
+	for (size_t i = partials.size(); i > 0; i--) {
+		sum += partials[i - 1];
+	}
+	return sum;
+}
+
+// testCompensatedAccumulation() : check the accuracy of FIRFilter<double>::get(), with and without extended precision (compensated accumulation),
+// on ill-conditioned dot products (large products which cancel each other out, leaving a much smaller result), against an exact reference.
+// The reference is independent of twoProduct(): each product is split into four partial products, which are exact in double precision
+// (the operands are rounded to 26 significant bits, and the remainders also fit in 26 bits), and these are summed with exactSum().
+// The filter is restarted at a different write position for each trial, so that each phase of the SIMD kernels is used.
+// (the last few taps are zero, as the SIMD kernels leave out up to three of them at some write positions)
+// Reports the largest relative error of each, and returns true if the compensated result is within a few units in the last place
+// (as if the dot product had been calculated in twice the precision, and then rounded), and more accurate than the plain result.
+inline bool testCompensatedAccumulation(double& plainError, double& compensatedError) {
+	const int half = 512;
+	const int length = 2 * half + 3;
+	const double bigScale = 1.0e8;
+	const double epsilon = std::numeric_limits<double>::epsilon();
+	std::mt19937_64 rng(1234);
+	auto random = [&rng]() { // (uniform in [-1, 1), the same on every platform)
+		return std::ldexp(static_cast<double>(rng() >> 11), -52) - 1.0;
+	};
+	auto split = [](double x, double& hi, double& lo) {
+		int e;
+		double m = std::frexp(x, &e);
+		hi = std::ldexp(std::round(std::ldexp(m, 26)), e - 26);
+		lo = x - hi;
+	};
+
+	plainError = 0.0;
+	compensatedError = 0.0;
+	for (int trial = 0; trial < 16; trial++) {
+
+		// the second half of the taps repeats the first half, and the samples which meet them cancel each other's large part:
+		std::vector<double> taps(length);
+		std::vector<double> window(length); // (window[i] : the sample which meets taps[i])
+		for (int i = 0; i < half; i++) {
+			taps[i] = taps[i + half] = random();
+			double big = bigScale * random();
+			window[i] = big + random();
+			window[i + half] = -big + random();
+		}
+		for (int i = 2 * half; i < length; i++) {
+			taps[i] = 0.0;
+			window[i] = random();
+		}
+
+		std::vector<double> partialProducts;
+		for (int i = 0; i < length; i++) {
+			double th, tl, wh, wl;
+			split(taps[i], th, tl);
+			split(window[i], wh, wl);
+			partialProducts.push_back(th * wh);
+			partialProducts.push_back(th * wl);
+			partialProducts.push_back(tl * wh);
+			partialProducts.push_back(tl * wl);
+		}
+		double reference = exactSum(partialProducts);
+
+		// after length samples have been put, taps[0] meets the first (oldest) sample, and taps[i] meets the ith newest:
+		FIRFilter<double> filter(taps.data(), length);
+		filter.reset(trial);
+		filter.put(window[0]);
+		for (int i = length - 1; i > 0; i--) {
+			filter.put(window[i]);
+		}
+
+		filter.setExtendedPrecision(false);
+		plainError = std::max(plainError, std::fabs((filter.get() - reference) / reference));
+		filter.setExtendedPrecision(true);
+		compensatedError = std::max(compensatedError, std::fabs((filter.get() - reference) / reference));
+	}
+
+#ifdef FIR_QUAD_PRECISION
+	return compensatedError <= 4 * epsilon && compensatedError <= plainError; // (get() accumulates in quad precision either way)
+#else
+	return compensatedError <= 4 * epsilon && compensatedError < plainError;
+#endif
+
+}
+
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // -- Functions beyond this point are for manipulating filter taps, and not for actually performing filtering -- //
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 
+// getFilterDesignThreadPool() : the pool of threads (one per hardware thread) used for designing long filters.
+// It is created on first use, and shared by all filter designs for the rest of the process (including those made concurrently for different channels)
+inline ctpl::thread_pool& getFilterDesignThreadPool()
+{
+	static ctpl::thread_pool threadPool(std::max(1, static_cast<int>(std::thread::hardware_concurrency())));
+	return threadPool;
+}
+
+// designInBlocks() : calls func(first, last) for consecutive blocks of FILTER_DESIGN_BLOCK_SIZE taps covering [0, count).
+// Long filters are shared out amongst multiple threads (so func must only write to its own block).
+template<typename Func>
+void designInBlocks(int count, Func func)
+{
+	const int blockSize = FILTER_DESIGN_BLOCK_SIZE;
+	const int numBlocks = (count + blockSize - 1) / blockSize;
+	const int numThreads = (count >= FILTER_DESIGN_PARALLEL_THRESHOLD) ?
+		std::min(numBlocks, std::max(1, static_cast<int>(std::thread::hardware_concurrency()))) :
+		1;
+
+	if (numThreads <= 1) {
+		for (int b = 0; b < numBlocks; ++b) {
+			func(b * blockSize, std::min(count, (b + 1) * blockSize));
+		}
+		return;
+	}
+
+	ctpl::thread_pool& threadPool = getFilterDesignThreadPool();
+	std::vector<std::future<void>> results;
+	for (int t = 0; t < numThreads; ++t) {
+		results.emplace_back(threadPool.push([=, &func](int) {
+			for (int b = t; b < numBlocks; b += numThreads) { // (interleave blocks between threads)
+				func(b * blockSize, std::min(count, (b + 1) * blockSize));
+			}
+		}));
+	}
+	for (auto& r : results) {
+		r.get();
+	}
+}
+
 // makeLPF() : generate low pass filter coefficients, using sinc function
 template<typename FloatType> bool makeLPF(FloatType* filter, int Length, FloatType transitionFreq, FloatType sampleRate)
 {
@@ -525,11 +959,24 @@ template<typename FloatType> bool makeLPF(FloatType* filter, int Length, FloatTy
 	if (Length & 1)
 		filter[halfLength] = 2.0 * ft; // if length is odd, avoid divide-by-zero at centre-tap
 
-	for (int n = 0; n < halfLength; ++n) {
-		// sinc function
-		double sinc = sin(fmod(M_TWOPI * ft * (n - halfM), M_TWOPI)) / (M_PI * (n - halfM));
-		filter[Length - n - 1] = filter[n] = sinc;	// exploit symmetry
-	}
+	// sin(theta * (n - halfM)) is evaluated by rotating (sin, cos) by theta for each tap,
+	// starting from an exact value at the beginning of each block (to stop rounding errors accumulating)
+	const double theta = M_TWOPI * ft;
+	const double sinTheta = sin(theta);
+	const double cosTheta = cos(theta);
+
+	designInBlocks(halfLength, [=](int first, int last) {
+		double angle = fmod(theta * (first - halfM), M_TWOPI);
+		double s = sin(angle);
+		double c = cos(angle);
+		for (int n = first; n < last; ++n) {
+			double sinc = s / (M_PI * (n - halfM)); // sinc function
+			filter[Length - n - 1] = filter[n] = static_cast<FloatType>(sinc); // exploit symmetry
+			double nextS = s * cosTheta + c * sinTheta;
+			c = c * cosTheta - s * sinTheta;
+			s = nextS;
+		}
+	});
 #endif
 
 	return true;
@@ -554,14 +1001,18 @@ template<typename FloatType> FloatType calcKaiserBeta(FloatType dB)
 	}
 }
 
+#define I0_NUM_TERMS 34
+
 // I0() : 0th-order Modified Bessel function of the first kind:
-double I0(double z)
+// sum of (z^2 / 4)^k / (k!)^2, with each term calculated from the previous one
+inline double I0(double z)
 {
-	double result = 0.0;
-	for (int k = 0; k < 34; ++k) {
-		double kfact = factorial[k];
-		double x = pow(z * z / 4.0, k) / (kfact * kfact);
-		result += x;
+	const double y = z * z / 4.0;
+	double term = 1.0;
+	double result = 1.0;
+	for (int k = 1; k < I0_NUM_TERMS; ++k) {
+		term *= y / (static_cast<double>(k) * k);
+		result += term;
 	}
 	return result;
 }
@@ -597,11 +1048,42 @@ template<typename FloatType> bool applyKaiserWindow(FloatType* filter, int Lengt
 
 #else
 
-	for (int n = 0; n < Length; ++n) {
-		filter[n] *= I0(Beta * sqrt(1.0 - pow((2.0 * n / (Length - 1) - 1), 2.0)))
-			/ I0(Beta);
+	// I0(z) is evaluated for a whole block of taps at once (one series term at a time, across the block), 
+	// with z^2 / 4 = (Beta^2 / 4) * (1 - r^2), r = 2n / (Length - 1) - 1 (so no sqrt() or pow() required)
+	const double reciprocalI0Beta = 1.0 / I0(Beta);
+	const double yScale = Beta * Beta / 4.0;
+	const double rScale = (Length > 1) ? 2.0 / (Length - 1) : 0.0;
+	double invKSquared[I0_NUM_TERMS];
+	for (int k = 1; k < I0_NUM_TERMS; ++k) {
+		invKSquared[k] = 1.0 / (static_cast<double>(k) * k);
 	}
 
+	designInBlocks(Length, [=, &invKSquared](int first, int last) {
+		double y[FILTER_DESIGN_BLOCK_SIZE];
+		double term[FILTER_DESIGN_BLOCK_SIZE];
+		double sum[FILTER_DESIGN_BLOCK_SIZE];
+		const int count = last - first;
+
+		for (int j = 0; j < count; ++j) {
+			double r = rScale * (first + j) - 1.0;
+			y[j] = yScale * (1.0 - r * r);
+			term[j] = 1.0;
+			sum[j] = 1.0;
+		}
+
+		for (int k = 1; k < I0_NUM_TERMS; ++k) {
+			const double c = invKSquared[k];
+			for (int j = 0; j < count; ++j) {
+				term[j] *= y[j] * c;
+				sum[j] += term[j];
+			}
+		}
+
+		for (int j = 0; j < count; ++j) {
+			filter[first + j] *= sum[j] * reciprocalI0Beta;
+		}
+	});
+
 #endif
 
 	return true;
@@ -704,17 +1186,7 @@ std::vector<std::complex<double>>
 fftV(std::vector<std::complex<double>> input) {
 	
 	std::vector<std::complex<double>> output(input.size(), 0); // output vector
-		
-	// create, execute, destroy plan:
-	fftw_plan p = fftw_plan_dft_1d(static_cast<int>(input.size()), 
-		reinterpret_cast<fftw_complex*>(&input[0]), 
-		reinterpret_cast<fftw_complex*>(&output[0]), 
-		FFTW_FORWARD, 
-		FFTW_ESTIMATE);
-
-	fftw_execute(p);
-	fftw_destroy_plan(p);
-	
+	fftComplex(static_cast<int>(input.size()), input.data(), output.data(), FFTW_FORWARD);
 	return output;
 }
 
@@ -723,16 +1195,7 @@ std::vector<std::complex<double>>
 ifftV(std::vector<std::complex<double>> input) {
 
 	std::vector<std::complex<double>> output(input.size(), 0); // output vector
-
-	// create, execute, destroy plan:
-	fftw_plan p = fftw_plan_dft_1d(static_cast<int>(input.size()),
-		reinterpret_cast<fftw_complex*>(&input[0]),
-		reinterpret_cast<fftw_complex*>(&output[0]),
-		FFTW_BACKWARD,
-		FFTW_ESTIMATE);
-
-	fftw_execute(p);
-	fftw_destroy_plan(p);
+	fftComplex(static_cast<int>(input.size()), input.data(), output.data(), FFTW_BACKWARD);
 
 	// scale output:
 	double reciprocalSize = 1.0 / input.size();
@@ -768,121 +1231,98 @@ AnalyticSignalV(const std::vector<std::complex<double>>& input) {
 	return output;
 }
 
-// makeMinPhase() : transform linear-phase FIR filter coefficients into minimum-phase (in-place version)
+// minPhaseTransform() : transform linear-phase FIR filter coefficients into minimum-phase, using the cepstral method:
+
+	// take the real parts of
+	// the ifft of
+	// e to the power of
+	// the fft of
+	// the folded (causal) version of
+	// the real cepstrum (ifft of log magnitude) of
+	// the dynamic-range limited version of
+	// the fft of
+	// the original filter (padded with zeros on either side)
+
+// Since all the time-domain signals are real, real-to-complex / complex-to-real FFTs are used, 
+// in-place, in a single buffer of (fftLength + 2) doubles.
+// Writes the first outLength (<= fftLength) minimum-phase coefficients to output.
+// Note: output[n] = hmin[n + 1] (as with the previous complex-FFT implementation, which produced the minimum-phase response
+// via a time-reversal, and was therefore advanced by one sample)
+
 template<typename FloatType>
-void makeMinPhase(FloatType* pFIRcoeffs, size_t length)
+void minPhaseTransform(const FloatType* pFIRcoeffs, size_t length, FloatType* output, size_t outLength, size_t fftLength)
 {
-	auto fftLength = static_cast<size_t>(pow(2, 2.0 + ceil(log2(length)))); // use FFT 4x larger than (length rounded-up to power-of-2)
+	assert(length <= fftLength && outLength <= fftLength);
+	const size_t N = fftLength;
+	const size_t halfN = N / 2;
+	const double reciprocalN = 1.0 / N;
 
-	std::vector <std::complex<double>> complexInput;
-	std::vector <std::complex<double>> complexOutput;
+	const int n = static_cast<int>(N);
 
-	// Pad zeros on either side of FIR:
-	
-	size_t frontPaddingLength = (fftLength - length) / 2;
-	size_t backPaddingLength = fftLength - frontPaddingLength - length;
-	
-	for (size_t n = 0; n < frontPaddingLength; ++n) {
-		complexInput.emplace_back(0, 0);
-	}
+	double* r = static_cast<double*>(fftw_malloc(2 * (halfN + 1) * sizeof(double)));
+	auto c = reinterpret_cast<std::complex<double>*>(r); // complex view of same buffer (halfN + 1 bins)
 
+	// pad zeros on either side of FIR:
+	size_t frontPaddingLength = (N - length) / 2;
+	std::fill(r, r + 2 * (halfN + 1), 0.0);
 	for (size_t n = 0; n < length; ++n) {
-		complexInput.push_back({ pFIRcoeffs[n], 0 });
+		r[frontPaddingLength + n] = pFIRcoeffs[n];
 	}
 
-	for (size_t n = 0; n < backPaddingLength; ++n) {
-		complexInput.emplace_back(0, 0);
-	}
+	// spectrum:
+	fftRealToComplex(n, r, c);
 
-	/*
-	// pad with trailing zeros
-	for (int n = 0; n < fftLength; ++n) {
-		if (n<length)
-			complexInput.push_back({ pFIRcoeffs[n], 0 });
-		else
-			complexInput.push_back({ 0, 0 }); // pad remainder with zeros
+	// log magnitude, limited to 190dB below peak (never zero):
+	double peak = 0.0;
+	for (size_t k = 0; k <= halfN; ++k) {
+		peak = std::max(peak, std::abs(c[k]));
 	}
-	*/
-
-	assert(complexInput.size() == fftLength); // make sure padding worked properly.
-
-	// Formula is as follows:
-
-	// take the reversed array of
-	// the real parts of
-	// the ifft of
-	// e to the power of
-	// the Analytic Signal of
-	// the real parts of 
-	// the log of
-	// the dynamic-ranged limited version of
-	// the fft of 
-	// the original filter
-			
-	complexOutput = realV(ifftV(expV(AnalyticSignalV(realV(logV(limitDynRangeV(fftV(complexInput),-190)))))));
-	std::reverse(complexOutput.begin(), complexOutput.end());
-
-	// write all the real parts back to coeff array:
-	int n = 0;
-	for (auto &c : complexOutput) {
-		if (n < length)
-			pFIRcoeffs[n] = c.real();	
-		else
-			break;
-		++n;
+	const double lowThresh = peak / pow(10, 190.0 / 20.0);
+	for (size_t k = 0; k <= halfN; ++k) {
+		c[k] = std::log(std::max(std::abs(c[k]), lowThresh));
 	}
-}
 
-// makeMinPhase2() : take linear-phase FIR filter coefficients, and return a new vector of minimum-phase coefficients
-template<typename FloatType>
-std::vector<FloatType> makeMinPhase2(const FloatType* pFIRcoeffs, size_t length)
-{
-	auto fftLength = static_cast<size_t>(pow(2, 2.0 + ceil(log2(length)))); // use FFT 4x larger than (length rounded-up to power-of-2)
-
-	std::vector <std::complex<double>> complexInput;
-	std::vector <std::complex<double>> complexOutput;
+	// real cepstrum:
+	fftComplexToReal(n, c, r);
 
-	// Pad zeros on either side of FIR:
-
-	size_t frontPaddingLength = (fftLength - length) / 2;
-	size_t backPaddingLength = fftLength - frontPaddingLength - length;
-
-	for (size_t n = 0; n < frontPaddingLength; ++n) {
-		complexInput.emplace_back(0, 0);
+	// fold (and normalise) cepstrum:
+	r[0] *= reciprocalN;
+	for (size_t n = 1; n < halfN; ++n) {
+		r[n] *= 2.0 * reciprocalN;
 	}
+	r[halfN] *= reciprocalN;
+	std::fill(r + halfN + 1, r + N, 0.0);
 
-	for (size_t n = 0; n < length; ++n) {
-		complexInput.push_back({ pFIRcoeffs[n], 0 });
+	// minimum-phase spectrum:
+	fftRealToComplex(n, r, c);
+	for (size_t k = 0; k <= halfN; ++k) {
+		c[k] = std::exp(c[k]);
 	}
 
-	for (size_t n = 0; n < backPaddingLength; ++n) {
-		complexInput.emplace_back(0, 0);
+	// minimum-phase impulse response:
+	fftComplexToReal(n, c, r);
+	for (size_t n = 0; n < outLength; ++n) {
+		output[n] = static_cast<FloatType>(r[(n + 1) % N] * reciprocalN);
 	}
 
-	assert(complexInput.size() == fftLength); // make sure padding worked properly.
-
-	// Formula is as follows:
-
-	// take the reversed array of
-	// the real parts of
-	// the ifft of
-	// e to the power of
-	// the Analytic Signal of
-	// the real parts of 
-	// the log of
-	// the dynamic-ranged limited version of
-	// the fft of 
-	// the original filter
-
-	complexOutput = realV(ifftV(expV(AnalyticSignalV(realV(logV(limitDynRangeV(fftV(complexInput), -190)))))));
-	std::reverse(complexOutput.begin(), complexOutput.end());
+	fftw_free(r);
+}
 
-	std::vector<FloatType> minPhaseCoeffs;
-	minPhaseCoeffs.reserve(complexOutput.size());
-	for (auto & c : complexOutput) {
-		minPhaseCoeffs.push_back(c.real());
-	}
+// makeMinPhase() : transform linear-phase FIR filter coefficients into minimum-phase (in-place version)
+template<typename FloatType>
+void makeMinPhase(FloatType* pFIRcoeffs, size_t length)
+{
+	auto fftLength = static_cast<size_t>(pow(2, 2.0 + ceil(log2(length)))); // use FFT 4x larger than (length rounded-up to power-of-2)
+	minPhaseTransform(pFIRcoeffs, length, pFIRcoeffs, length, fftLength);
+}
 
+// makeMinPhase2() : take linear-phase FIR filter coefficients, and return a new vector of minimum-phase coefficients
+template<typename FloatType>
+std::vector<FloatType> makeMinPhase2(const FloatType* pFIRcoeffs, size_t length)
+{
+	auto fftLength = static_cast<size_t>(pow(2, 2.0 + ceil(log2(length)))); // use FFT 4x larger than (length rounded-up to power-of-2)
+	std::vector<FloatType> minPhaseCoeffs(fftLength);
+	minPhaseTransform(pFIRcoeffs, length, minPhaseCoeffs.data(), fftLength, fftLength);
 	return minPhaseCoeffs;
 }
 
@@ -12,10 +12,13 @@
 #define _USE_MATH_DEFINES
 #include <cmath>
 #include <cstdio>
+#include <algorithm>
+#include <limits>
 #include <string>
 #include <iostream>
 #include <vector>
 #include <iomanip>
+#include <sstream>
 #include <regex>
 
 #ifdef __APPLE__
@@ -42,6 +45,13 @@
 #include "raiitimer.h"
 #include "fraction.h"
 #include "srconvert.h"
+#include "mcconvert.h"
+#include "realtime.h"
+#include "segment.h"
+#include "asyncio.h"
+#include "mmapfile.h"
+#include "pcmwriter.h"
+#include "metrics.h"
 #if !defined(__ANDROID__) && !defined(__arm__) && !defined(__aarch64__)
 #else
 #define COMPILING_ON_ANDROID
@@ -99,6 +109,18 @@ int main(int argc, char * argv[])
 	if (!showBuildVersion())
 		exit(EXIT_FAILURE); // can't continue (CPU / build mismatch)
 
+	// real-time streaming test (no files involved):
+	if (ci.bRealtimeTest) {
+		int numChannels = 2;
+		double duration = 10.0;
+		getCmdlineParam(argv, argv + argc, "--channels", numChannels);
+		getCmdlineParam(argv, argv + argc, "--duration", duration);
+		bool ok = ci.bUseDoublePrecision ?
+			testRealtimeResampler<double>(ci, std::max(1, numChannels), std::max(0.1, duration)) :
+			testRealtimeResampler<float>(ci, std::max(1, numChannels), std::max(0.1, duration));
+		exit(ok ? EXIT_SUCCESS : EXIT_FAILURE);
+	}
+
 	// echo filenames to user
 #ifdef COMPILING_ON_ANDROID
     ANDROID_OUT("Input file: %s", ANDROID_STDTOC(ci.inputFilename));
@@ -207,11 +229,20 @@ int main(int argc, char * argv[])
             std::cout << "Using quadruple-precision for calculations." << std::endl;
     #endif
 #else
+			if (ci.bExtendedPrecision) {
     #ifdef COMPILING_ON_ANDROID
-            ANDROID_OUT("Using double precision for calculations.");
+                ANDROID_OUT("Using double precision, with extended-precision (compensated) filter accumulation, for calculations.");
     #else
-			std::cout << "Using double precision for calculations." << std::endl;
+				std::cout << "Using double precision, with extended-precision (compensated) filter accumulation, for calculations." << std::endl;
     #endif
+			}
+			else {
+    #ifdef COMPILING_ON_ANDROID
+                ANDROID_OUT("Using double precision for calculations.");
+    #else
+				std::cout << "Using double precision for calculations." << std::endl;
+    #endif
+			}
 #endif
 			if (ci.dsfInput) {
 				ci.bEnablePeakDetection = false;
@@ -221,9 +252,13 @@ int main(int argc, char * argv[])
 				ci.bEnablePeakDetection = false;
 				return convert<DffFile, double> (ci) ? EXIT_SUCCESS : EXIT_FAILURE;
 			}
+			else if (ci.bMmap && MappedPcmFile::canRead(ci.inputFilename)) {
+				ci.bEnablePeakDetection = true;
+				return convert<MappedPcmFile, double> (ci) ? EXIT_SUCCESS : EXIT_FAILURE;
+			}
 			else {
 				ci.bEnablePeakDetection = true;
-				return convert<SndfileHandle, double> (ci) ? EXIT_SUCCESS : EXIT_FAILURE;
+				return convert<AsyncSndfileHandle, double> (ci) ? EXIT_SUCCESS : EXIT_FAILURE;
 			}
 		}
 
@@ -244,9 +279,13 @@ int main(int argc, char * argv[])
 				ci.bEnablePeakDetection = false;
 				return convert<DffFile, float> (ci) ? EXIT_SUCCESS : EXIT_FAILURE;
 			}
+			else if (ci.bMmap && MappedPcmFile::canRead(ci.inputFilename)) {
+				ci.bEnablePeakDetection = true;
+				return convert<MappedPcmFile, float> (ci) ? EXIT_SUCCESS : EXIT_FAILURE;
+			}
 			else {
 				ci.bEnablePeakDetection = true;
-				return convert<SndfileHandle, float> (ci) ? EXIT_SUCCESS : EXIT_FAILURE;
+				return convert<AsyncSndfileHandle, float> (ci) ? EXIT_SUCCESS : EXIT_FAILURE;
 			}
 		}
 
@@ -319,11 +358,39 @@ bool parseGlobalOptions(int argc, char * argv[]) {
 		return true;
 	}
 
+	// selfTest (exits with a non-zero status on failure)
+	if (getCmdlineParam(argv, argv + argc, "--selfTest")) {
+		bool philoxOk = Philox4x32::test();
+		bool dithererOk = Ditherer<float>::test() && Ditherer<double>::test();
+		double plainError, compensatedError;
+		bool compensatedOk = testCompensatedAccumulation(plainError, compensatedError);
+#ifdef COMPILING_ON_ANDROID
+		ANDROID_OUT("Philox4x32-10 test: %s", philoxOk ? "pass" : "FAIL");
+		ANDROID_OUT("Ditherer block test: %s", dithererOk ? "pass" : "FAIL");
+		ANDROID_OUT("Extended precision test: %s (largest relative error: %g plain, %g compensated)", compensatedOk ? "pass" : "FAIL", plainError, compensatedError);
+#else
+		std::cout << "Philox4x32-10 test: " << (philoxOk ? "pass" : "FAIL") << std::endl;
+		std::cout << "Ditherer block test: " << (dithererOk ? "pass" : "FAIL") << std::endl;
+		std::cout << "Extended precision test: " << (compensatedOk ? "pass" : "FAIL")
+			<< " (largest relative error: " << plainError << " plain, " << compensatedError << " compensated)" << std::endl;
+#endif
+		if (!philoxOk || !dithererOk || !compensatedOk) {
+			exit(EXIT_FAILURE);
+		}
+		return true;
+	}
+
 	// generate
 	if (getCmdlineParam(argv, argv + argc, "--generate")) {
 		std::string filename;
+		int sampleRate = 96000;
+		int numChannels = 1;
+		double duration = 10.0;
 		getCmdlineParam(argv, argv + argc, "--generate", filename);
-		generateExpSweep(filename);
+		getCmdlineParam(argv, argv + argc, "-r", sampleRate);
+		getCmdlineParam(argv, argv + argc, "--channels", numChannels);
+		getCmdlineParam(argv, argv + argc, "--duration", duration);
+		generateExpSweep(filename, std::max(1, sampleRate), SF_FORMAT_WAV | SF_FORMAT_FLOAT, std::max(0.1, duration), 12, -3.0, std::max(1, numChannels));
 		return true;
 	}
 
@@ -538,7 +605,7 @@ void listSubFormats(const std::string& f)
 // convert()
 
 /* Note: type 'FileReader' MUST implement the following methods:
-constuctor(const std::string& fileName)
+constuctor(const std::string& fileName, const IOOptions& io)
 bool error() // or int error()
 unsigned int channels()
 unsigned int samplerate()
@@ -574,7 +641,13 @@ bool convert(ConversionInfo& ci)
         SndfileHandle (SF_VIRTUAL_IO &sfvirtual, void *user_data, int mode = SFM_READ,
             int format = 0, int channels = 0, int samplerate = 0) ;
 	 */
-	FileReader infile(ci.inputFilename);
+	IOOptions io;
+	io.async = ci.bAsyncIO;
+	io.direct = ci.bDirectIO;
+	io.depth = ci.ioDepth;
+	io.mmap = ci.bMmap;
+
+	FileReader infile(ci.inputFilename, io);
 	if (int e = infile.error()) {
 #ifdef COMPILING_ON_ANDROID
 		ANDROID_ERR("Error: Couldn't Open Input File (%s)", sf_error_number(e));
@@ -583,6 +656,13 @@ bool convert(ConversionInfo& ci)
 #endif
 		return false;
 	}
+	if (std::is_same<FileReader, MappedPcmFile>::value && ci.bAsyncIO) { // (the mapped file is read by page faults, not by I/O requests)
+#ifdef COMPILING_ON_ANDROID
+		ANDROID_OUT("Warning: input file is memory-mapped (--mmap), so --asyncIO and --directIO only apply to the output file");
+#else
+		std::cout << "Warning: input file is memory-mapped (--mmap), so --asyncIO and --directIO only apply to the output file" << std::endl;
+#endif
+	}
 
 	// read input file metadata:
 	MetaData m;
@@ -592,26 +672,38 @@ bool convert(ConversionInfo& ci)
     int nChannels = static_cast<int>(infile.channels());
 	ci.inputSampleRate = infile.samplerate();
 	sf_count_t inputFrames = infile.frames();
-	sf_count_t inputSampleCount = inputFrames * nChannels;
-	double inputDuration = 1000.0 * inputFrames / ci.inputSampleRate; // ms
+
+	// determine range of input frames to be converted (--start / --end):
+	auto startFrame = std::min(inputFrames, static_cast<sf_count_t>(std::llround(ci.startTime * ci.inputSampleRate)));
+	auto endFrame = (ci.endTime > 0.0) ? std::min(inputFrames, static_cast<sf_count_t>(std::llround(ci.endTime * ci.inputSampleRate))) : inputFrames;
+	if (ci.segment > 0) {
+		getSegmentBounds(inputFrames, ci.segment, ci.numSegments, startFrame, endFrame);
+	}
+	if (startFrame >= endFrame && inputFrames > 0 && ci.segment == 0) {
+#ifdef COMPILING_ON_ANDROID
+		ANDROID_ERR("Error: --start is beyond the end of the input file");
+#else
+		std::cerr << "Error: --start is beyond the end of the input file" << std::endl;
+#endif
+		return false;
+	}
+	bool bTimeRange = (startFrame > 0 || endFrame < inputFrames);
+
+	sf_count_t inputSampleCount = (endFrame - startFrame) * nChannels;
+	double inputDuration = 1000.0 * (endFrame - startFrame) / ci.inputSampleRate; // ms
 
 	// determine conversion ratio:
 	Fraction fraction = getFractionFromSamplerates(ci.inputSampleRate, ci.outputSampleRate);
 
-	// set buffer sizes:
-	auto inputChannelBufferSize = static_cast<size_t>(BUFFERSIZE);
-    auto inputBlockSize = static_cast<size_t>(BUFFERSIZE * nChannels);
-	auto outputChannelBufferSize = static_cast<size_t>(1 + std::ceil(BUFFERSIZE * static_cast<double>(fraction.numerator) / static_cast<double>(fraction.denominator)));
-	auto outputBlockSize = static_cast<size_t>(nChannels * (1 + outputChannelBufferSize));
+	// set input buffer sizes (output buffer sizes are determined by the converters - see below):
+	auto inputChannelBufferSize = static_cast<size_t>(ci.blockSize);
+    auto inputBlockSize = static_cast<size_t>(ci.blockSize * nChannels);
 
-	// allocate buffers:
+	// allocate input buffers:
 	std::vector<FloatType> inputBlock(inputBlockSize, 0);		// input buffer for storing interleaved samples from input file
-	std::vector<FloatType> outputBlock(outputBlockSize, 0);		// output buffer for storing interleaved samples to be saved to output file
 	std::vector<std::vector<FloatType>> inputChannelBuffers;	// input buffer for each channel to store deinterleaved samples
-	std::vector<std::vector<FloatType>> outputChannelBuffers;	// output buffer for each channel to store converted deinterleaved samples
 	for (int n = 0; n < nChannels; n++) {
 		inputChannelBuffers.emplace_back(std::vector<FloatType>(inputChannelBufferSize, 0));
-		outputChannelBuffers.emplace_back(std::vector<FloatType>(outputChannelBufferSize, 0));
 	}
 
 	int inputFileFormat = infile.format();
@@ -667,12 +759,63 @@ bool convert(ConversionInfo& ci)
 	std::cout << "input sample rate: " << ci.inputSampleRate << "\noutput sample rate: " << ci.outputSampleRate << std::endl;
 #endif
 
+	if (bTimeRange) {
+#ifdef COMPILING_ON_ANDROID
+		ANDROID_OUT("Converting frames %lld to %lld of %lld", static_cast<long long>(startFrame), static_cast<long long>(endFrame), static_cast<long long>(inputFrames));
+#else
+		if (ci.segment > 0) {
+			std::cout << "Segment " << ci.segment << " of " << ci.numSegments << ": ";
+		}
+		std::cout << "Converting frames " << startFrame << " to " << endFrame << " of " << inputFrames << " (";
+		printSamplePosAsTime(startFrame, static_cast<unsigned int>(ci.inputSampleRate));
+		std::cout << " - ";
+		printSamplePosAsTime(endFrame, static_cast<unsigned int>(ci.inputSampleRate));
+		std::cout << ")" << std::endl;
+#endif
+	}
+
 	FloatType peakInputSample;
 	sf_count_t peakInputPosition = 0LL;
 	sf_count_t samplesRead = 0LL;
 	sf_count_t totalSamplesRead = 0LL;
 
+	// timers for each phase of the conversion (reported with --showTimings):
+	PhaseTimer peakScanTimer;
+	PhaseTimer convertTimer;
+	PhaseTimer tmpFileTimer;
+
+	// detailed per-phase / per-stage statistics (reported with --profile):
+	Profiler profiler(ci.bProfile);
+	profiler.setFlushDenormals(flushDenormals()); // (for this thread; worker threads do the same before converting each block)
+	PhaseTimer wallTimer;
+	wallTimer.start();
+
+	// live progress and throughput metrics (--metrics); one worker per channel if multi-threaded:
+	MetricsReporter metrics;
+	if (!ci.metricsDestination.empty() && !metrics.open(ci.metricsDestination, ci.metricsInterval, multiThreaded ? nChannels : 1)) {
+#ifdef COMPILING_ON_ANDROID
+		ANDROID_ERR("Warning: couldn't open metrics destination %s", ANDROID_STDTOC(ci.metricsDestination));
+#else
+		std::cerr << "Warning: couldn't open metrics destination " << ci.metricsDestination << std::endl;
+#endif
+	}
+
+	// range of input to be scanned for peaks (a segment needs the peak of the whole input, but only for normalization):
+	sf_count_t scanStartFrame = startFrame;
+	sf_count_t scanSampleCount = inputSampleCount;
+	if (ci.segment > 0) {
+		ci.bEnablePeakDetection = ci.bEnablePeakDetection && ci.bNormalize;
+		scanStartFrame = 0;
+		scanSampleCount = inputFrames * nChannels;
+	}
+	if (ci.bStitch) { // (segments already converted)
+		ci.bEnablePeakDetection = false;
+	}
+
 	if (ci.bEnablePeakDetection) {
+		ProfileScope peakScanScope(profiler.record("peak scan"));
+		peakScanTimer.start();
+		metrics.setPhase(MetricsReporter::peakScan, 1, scanSampleCount / nChannels, ci.inputSampleRate);
 		peakInputSample = 0.0;
 #ifdef COMPILING_ON_ANDROID
 		ANDROID_OUT("Scanning input file for peaks ...");
@@ -680,15 +823,17 @@ bool convert(ConversionInfo& ci)
 		std::cout << "Scanning input file for peaks ...";
 #endif
 
-		do {
-			samplesRead = infile.read(inputBlock.data(), inputBlockSize);
+		infile.seek(scanStartFrame, SEEK_SET);
+		do { // (scan only the range to be converted)
+			samplesRead = infile.read(inputBlock.data(), std::min(static_cast<sf_count_t>(inputBlockSize), scanSampleCount - totalSamplesRead));
 			for (unsigned int s = 0; s < samplesRead; ++s) { // read all samples, without caring which channel they belong to
 				if (std::abs(inputBlock[s]) > peakInputSample) {
 					peakInputSample = std::abs(inputBlock[s]);
-					peakInputPosition = totalSamplesRead + s;
+					peakInputPosition = scanStartFrame * nChannels + totalSamplesRead + s;
 				}
 			}
 			totalSamplesRead += samplesRead;
+			metrics.update(totalSamplesRead / nChannels, peakInputSample);
 		} while (samplesRead > 0);
 
 #ifdef COMPILING_ON_ANDROID
@@ -705,6 +850,7 @@ bool convert(ConversionInfo& ci)
 		std::cout << std::endl;
 #endif
 		infile.seek(0, SEEK_SET); // rewind back to start of file
+		peakScanTimer.stop();
 	}
 
 	else { // no peak detection
@@ -740,6 +886,13 @@ bool convert(ConversionInfo& ci)
 		std::cout << "Using Minimum-Phase LPF" << std::endl;
 #endif
 	}
+	if (ci.stopbandAttenuation > 0.0) { // (set by quality preset)
+#ifdef COMPILING_ON_ANDROID
+		ANDROID_OUT("LPF stopband attenuation: %G dB", ci.stopbandAttenuation);
+#else
+		std::cout << "LPF stopband attenuation: " << ci.stopbandAttenuation << " dB" << std::endl;
+#endif
+	}
 
 	// echo conversion ratio to user:
 	FloatType resamplingFactor = static_cast<FloatType>(ci.outputSampleRate) / ci.inputSampleRate;
@@ -774,6 +927,10 @@ bool convert(ConversionInfo& ci)
 		}
 	}
 
+	// use native writer for output file, if possible (files with metadata are left to libsndfile):
+	bool bNativeWriter = ci.bNativeWriter && ci.segment == 0 && !ci.csvOutput && PcmFileWriter::canWrite(outputFileFormat) &&
+		!(ci.bWriteMetaData && hasMetaData(m));
+
 	// note: libsndfile has an rf64 auto-downgrade mode:
 	// http://www.mega-nerd.com/libsndfile/command.html#SFC_RF64_AUTO_DOWNGRADE
 	// However, rf64 auto-downgrade is more appropriate for recording applications
@@ -828,21 +985,199 @@ bool convert(ConversionInfo& ci)
 #endif
 	}
 
+	// automatic quality (--quality auto): the filters' stopband need only be deep enough to put images and aliases
+	// below the noise floor of the output format (with a margin, and a deeper one when noise-shaped dither lowers the floor in the most sensitive band),
+	// but never deeper than the default for the conversion ratio (so that auto is never slower than high).
+	// 32-bit and floating-point formats resolve more than any filter can deliver, so keep the default filters.
+	if (ci.quality == qualityAuto) {
+		int subformat = outputFileFormat & SF_FORMAT_SUBMASK;
+		bool bFullResolution = !ci.quantize &&
+			(subformat == SF_FORMAT_PCM_32 || subformat == SF_FORMAT_ALAC_32 || subformat == SF_FORMAT_FLOAT || subformat == SF_FORMAT_DOUBLE);
+		if (!bFullResolution) {
+			const DitherProfile& ditherProfile = ditherProfileList[ci.ditherProfileID];
+			bool bNoiseShaped = ci.bDither && ditherProfile.filterType != bypass && ditherProfile.coeffs != noiseShaperPassThrough;
+			double noiseFloor = 6.02 * outputSignalBits + 1.76; // (dB below full scale)
+			double defaultAttenuation = getDefaultStopbandAttenuation(getFractionFromSamplerates(ci.inputSampleRate, ci.outputSampleRate));
+			ci.stopbandAttenuation = std::min(defaultAttenuation, std::round(noiseFloor + 12.0 + (bNoiseShaped ? 18.0 : 0.0)));
+		}
+		std::string attenuation = bFullResolution ? "default" : std::to_string(static_cast<int>(ci.stopbandAttenuation)) + " dB";
+#ifdef COMPILING_ON_ANDROID
+		ANDROID_OUT("Quality: auto (LPF stopband attenuation: %s)", ANDROID_STDTOC(attenuation));
+#else
+		std::cout << "Quality: auto (LPF stopband attenuation: " << attenuation << ")" << std::endl;
+#endif
+	}
+
 	// make a vector of ditherers (one ditherer for each channel):
 	std::vector<Ditherer<FloatType>> ditherers;
     auto seed = static_cast<int>(ci.bUseSeed ? ci.seed : time(nullptr));
 
 	for (int n = 0; n < nChannels; n++) {
-		// to-do: explore other seed-generation options (remote possibility of overlap)
-		// maybe use a single global RNG ?
-		// or use discard/jump-ahead ... to ensure parallel streams are sufficiently "far away" from each other ?
-		ditherers.emplace_back(outputSignalBits, ci.ditherAmount, ci.bAutoBlankingEnabled, n + seed, static_cast<DitherProfileID>(ci.ditherProfileID));
+		// each channel uses its own independent noise stream (same seed, stream number = channel number)
+		ditherers.emplace_back(outputSignalBits, ci.ditherAmount, ci.bAutoBlankingEnabled, seed, static_cast<DitherProfileID>(ci.ditherProfileID), n);
+	}
+
+	// conditionally assign each channel to a CPU:
+	std::vector<int> channelCpus;
+	if (!ci.affinity.empty()) {
+		channelCpus = CpuAffinity::assignCpus(ci.affinity, nChannels);
+#ifdef COMPILING_ON_ANDROID
+		ANDROID_OUT("%s", ANDROID_STDTOC(CpuAffinity::describe(ci.affinity, channelCpus)));
+#else
+		std::cout << CpuAffinity::describe(ci.affinity, channelCpus) << std::endl;
+#endif
+		if (!multiThreaded) { // all channels processed by this thread
+			CpuAffinity::pinThisThread(channelCpus[0]);
+		}
 	}
 
+	// with --mt, each channel's work is done by a thread of its own
+	// (created once for the whole conversion, so that each thread keeps its per-thread state, and is pinned to its channel's CPU just once):
+	std::vector<std::unique_ptr<ctpl::thread_pool>> channelThreads;
+	if (multiThreaded) {
+		for (int ch = 0; ch < nChannels; ++ch) {
+			channelThreads.emplace_back(new ctpl::thread_pool(1));
+			if (!channelCpus.empty()) {
+				channelThreads[ch]->push([&, ch](int) {
+					CpuAffinity::pinThisThread(channelCpus[ch]);
+				}).get();
+			}
+		}
+	}
+	bool concurrentChannelSetup = multiThreaded && !channelCpus.empty();
+
+	// runOnChannelCpus() : call func(ch) for each channel. With --mt and --affinity, each call is made concurrently on the channel's CPU,
+	// so that memory allocated (and first touched) by func is local to the CPU which will use it
+	auto runOnChannelCpus = [&](const std::function<void(int)>& func) {
+		if (concurrentChannelSetup) {
+			std::vector<std::future<void>> done;
+			for (int ch = 0; ch < nChannels; ++ch) {
+				done.push_back(channelThreads[ch]->push([&, ch](int) {
+					func(ch);
+				}));
+			}
+			for (auto& d : done) {
+				d.get();
+			}
+		}
+		else {
+			for (int ch = 0; ch < nChannels; ++ch) {
+				func(ch);
+			}
+		}
+	};
+
+	// set up FFT planning (used for minimum-phase filter design):
+	unsigned int plannerFlags = FFTW_ESTIMATE;
+	FFTPlanCache::plannerFlagsFromName(ci.fftPlanner, plannerFlags);
+	FFTPlanCache::instance().setPlannerFlags(plannerFlags);
+	// (long transforms may use a thread for each CPU the conversion runs on: just this thread's CPU without --mt,
+	// or the channels' CPUs with --mt and --affinity, or every CPU with --mt alone)
+	int fftThreads = 1;
+	if (multiThreaded) {
+		std::vector<int> cpus(channelCpus);
+		std::sort(cpus.begin(), cpus.end());
+		cpus.erase(std::unique(cpus.begin(), cpus.end()), cpus.end());
+		fftThreads = cpus.empty() ? static_cast<int>(std::thread::hardware_concurrency()) : static_cast<int>(cpus.size());
+	}
+	FFTPlanCache::instance().setMaxThreads(fftThreads);
+	if (!ci.fftWisdomFilename.empty()) {
+		FFTPlanCache::instance().loadWisdom(ci.fftWisdomFilename);
+	}
+
+	// format-only conversion (same sampling rate): the converters would only copy their input, so they are bypassed (along with
+	// the de-interleaving and re-interleaving around them), and gain and dither are applied in a single pass over the interleaved input:
+	bool bFormatOnly = ci.inputSampleRate == ci.outputSampleRate && ci.segment == 0 && !ci.bStitch;
+
+	// --vectoriseChannels: with many channels (and a single conversion thread), convert several channels at once, in the lanes of SIMD vectors
+	// (see mcconvert.h). The results differ slightly from those of per-channel conversion, so this is only done on request:
+	bool bChannelVectorised = ci.bVectoriseChannels && !bFormatOnly && !multiThreaded && useChannelVectorisation<FloatType>(nChannels, ci.bExtendedPrecision);
+
 	// make a vector of Resamplers
+	// (if channel-vectorised, just one, which is the prototype of the multichannel converter - see below - and has no buffers of its own)
 	std::vector<Converter<FloatType>> converters;
-	for (int n = 0; n < nChannels; n++) {
-		converters.emplace_back(ci);
+	if (bChannelVectorised) {
+		converters.emplace_back(ci, true);
+	}
+	else {
+		std::vector<std::unique_ptr<Converter<FloatType>>> channelConverters(nChannels);
+		runOnChannelCpus([&](int ch) {
+			ConversionInfo channelCi = ci;
+			channelCi.bShowStages = ci.bShowStages && (ch == 0 || !concurrentChannelSetup); // (don't interleave output of concurrent channels)
+			channelConverters[ch].reset(new Converter<FloatType>(channelCi));
+			channelConverters[ch]->setProfiling(ci.bProfile);
+		});
+		for (auto& converter : channelConverters) {
+			converters.push_back(std::move(*converter)); // (moves ownership of buffers; they stay where they were allocated)
+		}
+	}
+
+	// choose a block size which keeps the working set of each conversion stage cache-resident (unless specified by user):
+	if (ci.bAutoBlockSize) {
+		ci.blockSize = static_cast<int>(converters[0].chooseBlockSize(CacheInfo::get(), ci.bMultiThreaded ? nChannels : 1));
+		runOnChannelCpus([&](int ch) {
+			if (ch < static_cast<int>(converters.size())) {
+				converters[ch].setBlockSize(ci.blockSize);
+			}
+		});
+		inputChannelBufferSize = static_cast<size_t>(ci.blockSize);
+		inputBlockSize = static_cast<size_t>(ci.blockSize * nChannels);
+		inputBlock.resize(inputBlockSize);
+		for (auto& inputChannelBuffer : inputChannelBuffers) {
+			inputChannelBuffer.resize(inputChannelBufferSize);
+		}
+	}
+
+	std::unique_ptr<MultichannelConverter<FloatType>> mcConverter;
+	if (bChannelVectorised) {
+		mcConverter.reset(new MultichannelConverter<FloatType>(converters[0], nChannels));
+		mcConverter->setProfiling(ci.bProfile);
+	}
+
+	if (ci.bShowStages) {
+		std::ostringstream report;
+		report << "Block size: " << ci.blockSize << " frames (" << (ci.bAutoBlockSize ? "automatic" : "specified") << ")\nCache sizes: ";
+		CacheInfo::get().print(report);
+		report << "\nWorking set (per channel): " << converters[0].getWorkingSetSize(ci.blockSize) / 1024 << " kB";
+		if (!mcConverter) {
+			report << "\nConversion memory (per channel): " << converters[0].getArena().getBytesAllocated() / 1024 << " kB ("
+				<< converters[0].getArena().getHugePageBytes() / 1024 << " kB advised to use huge pages)";
+		}
+		else {
+			report << "\nChannel-vectorised: " << nChannels << " channels, " << SimdLanes<FloatType>::width << " per SIMD vector (filters and buffers: "
+				<< mcConverter->getMemorySize() / 1024 << " kB)";
+		}
+		if (ci.bMultiStage) {
+			report << "\nSub-block size: " << converters[0].getSubBlockSize() << " frames\nIntermediate buffer sizes:";
+			for (size_t size : converters[0].getIntermediateBufferSizes(converters[0].getSubBlockSize())) {
+				report << " " << size;
+			}
+		}
+#ifdef COMPILING_ON_ANDROID
+		ANDROID_OUT("%s", ANDROID_STDTOC(report.str()));
+#else
+		std::cout << report.str() << "\n" << std::endl;
+#endif
+	}
+
+	// allocate output buffers, large enough for the most output the converters can produce from one input block:
+	auto outputChannelBufferSize = static_cast<size_t>(1 + converters[0].getMaxOutputFrames());
+	auto outputBlockSize = static_cast<size_t>(nChannels * (1 + outputChannelBufferSize));
+	std::vector<FloatType> outputBlock(outputBlockSize, 0);		// output buffer for storing interleaved samples to be saved to output file
+	std::vector<std::vector<FloatType>> outputChannelBuffers(nChannels);	// output buffer for each channel to store converted deinterleaved samples
+	if (!mcConverter && !bFormatOnly) { // (multichannel converter writes straight to outputBlock; format-only conversion writes the input block)
+		runOnChannelCpus([&](int ch) {
+			outputChannelBuffers[ch].assign(outputChannelBufferSize, 0);
+		});
+	}
+
+	// save any new FFT wisdom gathered while designing filters:
+	if (!ci.fftWisdomFilename.empty() && !FFTPlanCache::instance().saveWisdom(ci.fftWisdomFilename)) {
+#ifdef COMPILING_ON_ANDROID
+		ANDROID_ERR("Warning: couldn't save FFT wisdom to %s", ANDROID_STDTOC(ci.fftWisdomFilename));
+#else
+		std::cerr << "Warning: couldn't save FFT wisdom to " << ci.fftWisdomFilename << std::endl;
+#endif
 	}
 
 	// Calculate initial gain:
@@ -856,25 +1191,109 @@ bool convert(ConversionInfo& ci)
 		gain *= ditherCompensation;
 	}
 
+	// For format-only conversion, the output is just the input times the gain (plus dither, which the gain leaves room for),
+	// so the peak input sample tells in advance whether the output would clip. Instead of finding that out from a temp file,
+	// adjust the gain now, by the same amount the temp file pass would have, and don't use a temp file (nor convert again).
+	// Clipping protection is then based on the peak before dither, so the (dithered) output isn't tested for clipping afterwards.
+	// (Without a peak scan, clipping is still possible, so keep the temp file)
+	bool bGainPreset = false;
+	if (bFormatOnly && (ci.bEnablePeakDetection || ci.disableClippingProtection)) {
+		FloatType expectedPeak = peakInputSample * gain;
+		if (!ci.disableClippingProtection && expectedPeak > ci.limit) {
+			FloatType gainAdjustment = static_cast<FloatType>(clippingTrim) * ci.limit / expectedPeak;
+			gain *= gainAdjustment;
+			for (auto& ditherer : ditherers) {
+				ditherer.adjustGain(gainAdjustment);
+			}
+#ifdef COMPILING_ON_ANDROID
+			ANDROID_OUT("Clipping expected ! Adjusting gain by %G dB", 20 * log10(gainAdjustment));
+#else
+			std::cout << "Clipping expected ! Adjusting gain by " << 20 * log10(gainAdjustment) << " dB" << std::endl;
+#endif
+		}
+		ci.bTmpFile = false;
+		bGainPreset = true;
+	}
+
     int groupDelay = static_cast<int>(converters[0].getGroupDelay());
 
+	// For a time range, start reading just early enough to fill the filters (pre-roll) before startFrame,
+	// at a position where every conversion stage is in the same phase as in a conversion of the whole file.
+	// The output is then identical to the corresponding part of the output of a whole-file conversion.
+	sf_count_t readStartFrame = 0;
+	if (startFrame > 0) {
+		auto alignment = static_cast<sf_count_t>(converters[0].getAlignment());
+		auto preroll = static_cast<sf_count_t>(converters[0].getPrerollSize());
+		readStartFrame = std::max(static_cast<sf_count_t>(0), startFrame - preroll) / alignment * alignment;
+	}
+
+	// first output frame (of a whole-file conversion) at or after startFrame, and output frames in range:
+	const sf_count_t L = fraction.numerator;
+	const sf_count_t M = fraction.denominator;
+	sf_count_t startOutputFrame = (startFrame * L + M - 1) / M;
+	sf_count_t rangeOutputFrames = (endFrame < inputFrames) ? (endFrame * L + M - 1) / M - startOutputFrame : -1; // (-1: to end of file)
+
+	// number of leading output frames to discard: group delay, plus the output of the pre-roll
+	auto trimFrames = static_cast<size_t>(startOutputFrame + groupDelay - readStartFrame * L / M);
+
 	FloatType peakOutputSample;
 	bool bClippingDetected;
 	RaiiTimer timer(inputDuration);
 
+	// profiling records (nullptr when not profiling):
+	ProfileRecord* readRecord = profiler.record("read");
+	ProfileRecord* deinterleaveRecord = profiler.record("de-interleave");
+	ProfileRecord* writeRecord = profiler.record("write");
+	std::vector<ProfileRecord> ditherRecords(ci.bProfile ? nChannels : 0);		// per-channel, so that channels can be timed concurrently
+	std::vector<ProfileRecord> interleaveRecords(ci.bProfile ? nChannels : 0);
+
+	// applyGain() : apply gain (and dither, unless it is to be done when writing from the temp file) to count samples of channel ch,
+	// spaced stride samples apart in buf, and store them in out (which may be buf), spaced outStride samples apart, in the same pass.
+	// Returns the peak of those from firstFrame to lastFrame (only output which is written counts towards the peak)
+	auto applyGain = [&](int ch, FloatType* buf, size_t count, size_t stride, FloatType* out, size_t outStride, size_t firstFrame, size_t lastFrame) {
+		ProfileScope ditherScope(ci.bProfile ? &ditherRecords[ch] : nullptr);
+		FloatType g = gain;
+		if (ci.bDither && !ci.bTmpFile) {
+			ditherers[ch].ditherBlock(buf, count, gain, stride); // gain, dither (in-place)
+			g = 1.0;
+		}
+		FloatType peak = 0.0;
+		for (size_t f = 0; f < count; ++f) {
+			FloatType outputSample = g * buf[f * stride]; // gain
+			out[f * outStride] = outputSample;
+			if (f - firstFrame < lastFrame - firstFrame) {
+				peak = std::max(peak, std::abs(outputSample)); // peak
+			}
+		}
+		return peak;
+	};
+
 	int clippingProtectionAttempts = 0;
 
 	do { // clipping detection loop (repeats if clipping detected AND not using a temp file)
 
-		infile.seek(0, SEEK_SET);
+		infile.seek(readStartFrame, SEEK_SET);
+		if (mcConverter) {
+			mcConverter->reset(static_cast<uint64_t>(readStartFrame));
+		}
+		else {
+			for (auto& converter : converters) {
+				converter.reset(static_cast<uint64_t>(readStartFrame));
+			}
+		}
 		peakInputSample = 0.0;
 		bClippingDetected = false;
-		std::unique_ptr<SndfileHandle> outFile;
+		std::unique_ptr<AsyncSndfileHandle> outFile;
+		std::unique_ptr<PcmFileWriter> pcmFile;
 		std::unique_ptr<CsvFile> csvFile;
 
-		if (ci.csvOutput) { // csv output
+		if (ci.segment > 0) {
+			// no output file: output goes to segment file (see below)
+		}
+		else if (ci.csvOutput) { // csv output
 			csvFile.reset(new CsvFile(ci.outputFilename));
 			csvFile->setNumChannels(nChannels);
+			csvFile->setMultiThreaded(ci.bMultiThreaded);
 
 			// defaults
 			csvFile->setNumericBase(Decimal);
@@ -917,6 +1336,27 @@ bool convert(ConversionInfo& ci)
             }
 		}
 
+		else if (bNativeWriter) { // native output (preallocated from expected length of output)
+			int64_t expectedFrames = static_cast<int64_t>(inputSampleCount / nChannels) * fraction.numerator / fraction.denominator;
+			pcmFile.reset(new PcmFileWriter(ci.outputFilename, outputFileFormat, nChannels, ci.outputSampleRate, io, expectedFrames));
+			if (!pcmFile->isOpen()) {
+#ifdef COMPILING_ON_ANDROID
+				ANDROID_ERR("Error: Couldn't Open Output File");
+#else
+				std::cerr << "Error: Couldn't Open Output File" << std::endl;
+#endif
+				return false;
+			}
+			if (pcmFile->getFormat() != outputFileFormat) { // (wav file too large: promoted to rf64)
+#ifdef COMPILING_ON_ANDROID
+				ANDROID_OUT("Switching to rf64 format !");
+#else
+				std::cout << "Switching to rf64 format !" << std::endl;
+#endif
+				outputFileFormat = pcmFile->getFormat();
+			}
+		}
+
 		else { // libSndFile output
 
 			try {
@@ -924,7 +1364,7 @@ bool convert(ConversionInfo& ci)
 				// output file may need to be overwriten on subsequent passes,
 				// and the only way to close the file is to destroy the SndfileHandle.
 
-				outFile.reset(new SndfileHandle(ci.outputFilename, SFM_WRITE, outputFileFormat, nChannels, ci.outputSampleRate));
+				outFile.reset(new AsyncSndfileHandle(ci.outputFilename, outputFileFormat, nChannels, ci.outputSampleRate, io));
 
 				if (int e = outFile->error()) {
 #ifdef COMPILING_ON_ANDROID
@@ -987,8 +1427,35 @@ bool convert(ConversionInfo& ci)
 			}
 		}
 
-		// conditionally open a temp file:
-		if (ci.bTmpFile) {
+		// conditionally open a temp file (or, if converting a segment, the segment file; if stitching, the segment files):
+		std::unique_ptr<SegmentReader> segmentReader;
+		if (ci.segment > 0) {
+			std::string segmentFilename = getSegmentFilename(ci.outputFilename, ci.segment);
+			tmpSndfileHandle = new SndfileHandle(segmentFilename, SFM_WRITE, getSegmentFileFormat(sizeof(FloatType)), nChannels, ci.outputSampleRate);
+			if (int e = tmpSndfileHandle->error()) {
+#ifdef COMPILING_ON_ANDROID
+				ANDROID_ERR("Error: Couldn't Open Segment File %s (%s)", ANDROID_STDTOC(segmentFilename), sf_error_number(e));
+#else
+				std::cerr << "Error: Couldn't Open Segment File " << segmentFilename << " (" << sf_error_number(e) << ")" << std::endl;
+#endif
+				return false;
+			}
+			tmpSndfileHandle->command((sizeof(FloatType) == 8) ? SFC_SET_NORM_DOUBLE : SFC_SET_NORM_FLOAT, NULL, SF_FALSE); // (as for temp file)
+		}
+		else if (ci.bStitch) {
+			std::vector<SegmentManifest> manifests;
+			std::string errorMessage;
+			if (!loadSegmentManifests(ci.outputFilename, ci.numSegments, inputFrames, nChannels, ci.outputSampleRate, sizeof(FloatType), manifests, errorMessage)) {
+#ifdef COMPILING_ON_ANDROID
+				ANDROID_ERR("Error: %s", ANDROID_STDTOC(errorMessage));
+#else
+				std::cerr << "Error: " << errorMessage << std::endl;
+#endif
+				return false;
+			}
+			segmentReader.reset(new SegmentReader(ci.outputFilename, manifests));
+		}
+		else if (ci.bTmpFile) {
             tmpSndfileHandle = getTempFile<FloatType>(inputFileFormat, nChannels, ci, tmpFilename);
             if(tmpSndfileHandle == nullptr) {
                 ci.bTmpFile = false;
@@ -996,12 +1463,18 @@ bool convert(ConversionInfo& ci)
 		} // ends opening of temp file
 
 		// echo conversion mode to user (multi-stage/single-stage, multi-threaded/single-threaded)
-		std::string stageness(ci.bMultiStage ? "multi-stage" : "single-stage");
+		std::string stageness(bFormatOnly ? "format only" : ci.bMultiStage ? "multi-stage" : "single-stage");
 		std::string threadedness(ci.bMultiThreaded ? ", multi-threaded" : "");
 #ifdef COMPILING_ON_ANDROID
-		ANDROID_OUT("Converting (%s%s) ...", ANDROID_STDTOC(stageness), ANDROID_STDTOC(threadedness));
+		if (ci.bStitch)
+			ANDROID_OUT("Stitching %d segments ...", ci.numSegments);
+		else
+			ANDROID_OUT("Converting (%s%s) ...", ANDROID_STDTOC(stageness), ANDROID_STDTOC(threadedness));
 #else
-		std::cout << "Converting (" << stageness << threadedness << ") ..." << std::endl;
+		if (ci.bStitch)
+			std::cout << "Stitching " << ci.numSegments << " segments ..." << std::endl;
+		else
+			std::cout << "Converting (" << stageness << threadedness << ") ..." << std::endl;
 #endif
 
 		peakOutputSample = 0.0;
@@ -1009,98 +1482,212 @@ bool convert(ConversionInfo& ci)
 		sf_count_t incrementalProgressThreshold = inputSampleCount / 10;
 		sf_count_t nextProgressThreshold = incrementalProgressThreshold;
 
-		int outStartOffset = std::min(groupDelay * nChannels, static_cast<int>(outputBlockSize) - nChannels);
-
-		do { // central conversion loop (the heart of the matter ...)
-
-			// Grab a block of interleaved samples from file:
-			samplesRead = infile.read(inputBlock.data(), inputBlockSize);
-			totalSamplesRead += samplesRead;
-
-			// de-interleave into channel buffers
-			size_t i = 0;
-			for (size_t s = 0 ; s < samplesRead; s += nChannels) {
-				for (int ch = 0 ; ch < nChannels; ++ch) {
-					inputChannelBuffers[ch][i] = inputBlock[s+ch];
+		sf_count_t samplesWritten = 0; // (number of samples written to segment file)
+		if (ci.bStitch) { // segments have already been converted; the peak of the converted output is the peak of all the segments
+			peakOutputSample = static_cast<FloatType>(segmentReader->getPeak());
+		}
+		else {
+			// number of leading output samples to discard (Group Delay Compensation, and pre-roll),
+			// and number of output samples to write (Note: with small block sizes, the trim may span several blocks)
+			size_t samplesToTrim = trimFrames * nChannels;
+			size_t samplesToWrite = (rangeOutputFrames < 0) ? std::numeric_limits<size_t>::max() : static_cast<size_t>(rangeOutputFrames * nChannels);
+
+			convertTimer.start();
+			metrics.setPhase(MetricsReporter::convert, clippingProtectionAttempts + 1, inputSampleCount / nChannels, ci.inputSampleRate);
+			do { // central conversion loop (the heart of the matter ...)
+
+				// Grab a block of interleaved samples from file:
+				{
+					ProfileScope readScope(readRecord);
+					samplesRead = infile.read(inputBlock.data(), inputBlockSize);
 				}
-				++i;
-			}
-
-			struct Result {
-				size_t outBlockindex;
-				FloatType peak;
-			};
+				totalSamplesRead += samplesRead;
 
-			std::vector<std::future<Result>> results(nChannels);
-			ctpl::thread_pool threadPool(nChannels);
-            size_t outputBlockIndex = 0;
-
-			for (int ch = 0; ch < nChannels; ++ch) { // run convert stage for each channel (concurrently)
+				// de-interleave into channel buffers (unless channel-vectorised: the multichannel converter works on interleaved frames;
+				// or format-only: gain and dither are applied to the interleaved frames)
+				size_t i = 0;
+				if (mcConverter || bFormatOnly) {
+					i = static_cast<size_t>(samplesRead) / nChannels;
+				}
+				else {
+					ProfileScope deinterleaveScope(deinterleaveRecord);
+					for (size_t s = 0; s < samplesRead; s += nChannels) {
+						for (int ch = 0; ch < nChannels; ++ch) {
+							inputChannelBuffers[ch][i] = inputBlock[s + ch];
+						}
+						++i;
+					}
+				}
 
-				auto kernel = [&, ch](int x = 0) {
-					FloatType* iBuf = inputChannelBuffers[ch].data();
-					FloatType* oBuf = outputChannelBuffers[ch].data();
+				size_t outputBlockIndex = 0;
+				const FloatType* output = bFormatOnly ? inputBlock.data() : outputBlock.data();
+				if (bFormatOnly) { // gain, dither and find peak in-place, in inputBlock (one channel at a time, or channels concurrently)
+					size_t firstFrame = std::min(i, samplesToTrim / nChannels);
+					size_t lastFrame = firstFrame + std::min(i - firstFrame, samplesToWrite / nChannels);
+					auto kernel = [&](int ch) {
+						return applyGain(ch, inputBlock.data() + ch, i, nChannels, inputBlock.data() + ch, nChannels, firstFrame, lastFrame);
+					};
+
+					if (multiThreaded) {
+						std::vector<std::future<FloatType>> peaks(nChannels);
+						for (int ch = 0; ch < nChannels; ++ch) {
+							peaks[ch] = channelThreads[ch]->push([&, ch](int) {
+								flushDenormals();
+								MetricsReporter::BusyScope busyScope(metrics.busyCounter(ch));
+								return kernel(ch);
+							});
+						}
+						for (auto& peak : peaks) {
+							peakOutputSample = std::max(peakOutputSample, peak.get());
+						}
+					}
+					else {
+						MetricsReporter::BusyScope busyScope(metrics.busyCounter(0));
+						for (int ch = 0; ch < nChannels; ++ch) {
+							peakOutputSample = std::max(peakOutputSample, kernel(ch));
+						}
+					}
+					outputBlockIndex = i * nChannels;
+				}
+				else if (mcConverter) { // convert all channels at once, straight into outputBlock
 					size_t o = 0;
-					FloatType localPeak = 0.0;
-					size_t localOutputBlockIndex = 0;
-					converters[ch].convert(oBuf, o, iBuf, i);
-					for (size_t f = 0; f < o; ++f) {
-						// note: disable dither for temp files (dithering to be done in post)
-						FloatType outputSample = (ci.bDither && !ci.bTmpFile) ? ditherers[ch].dither(gain * oBuf[f]) : gain * oBuf[f]; // gain, dither
-						localPeak = std::max(localPeak, std::abs(outputSample)); // peak
-						outputBlock[localOutputBlockIndex + ch] = outputSample; // interleave
-						localOutputBlockIndex += nChannels;
+					MetricsReporter::BusyScope busyScope(metrics.busyCounter(0));
+					mcConverter->convert(outputBlock.data(), o, inputBlock.data(), i);
+					size_t firstFrame = std::min(o, samplesToTrim / nChannels);
+					size_t lastFrame = firstFrame + std::min(o - firstFrame, samplesToWrite / nChannels);
+					for (int ch = 0; ch < nChannels; ++ch) {
+						peakOutputSample = std::max(peakOutputSample, applyGain(ch, outputBlock.data() + ch, o, nChannels, outputBlock.data() + ch, nChannels, firstFrame, lastFrame));
 					}
-					Result res;
-					res.outBlockindex = localOutputBlockIndex;
-					res.peak = localPeak;
-					return res;
-				};
-
-				if (multiThreaded) {
-					results[ch] = threadPool.push(kernel);
+					outputBlockIndex = o * nChannels;
 				}
 				else {
-					Result res = kernel();
-					peakOutputSample = std::max(peakOutputSample, res.peak);
-					outputBlockIndex = res.outBlockindex;
-				}
-			}
+					struct Result {
+						size_t outBlockindex;
+						FloatType peak;
+					};
+
+					std::vector<std::future<Result>> results(nChannels);
+
+					for (int ch = 0; ch < nChannels; ++ch) { // run convert stage for each channel (concurrently)
+
+						auto kernel = [&, ch](int x = 0) {
+							if (multiThreaded) {
+								flushDenormals();
+							}
+							MetricsReporter::BusyScope busyScope(metrics.busyCounter(multiThreaded ? ch : 0));
+							FloatType* iBuf = inputChannelBuffers[ch].data();
+							FloatType* oBuf = outputChannelBuffers[ch].data();
+							size_t o = 0;
+							converters[ch].convert(oBuf, o, iBuf, i);
+							size_t firstFrame = std::min(o, samplesToTrim / nChannels);
+							size_t lastFrame = firstFrame + std::min(o - firstFrame, samplesToWrite / nChannels);
+							FloatType localPeak;
+							if (ci.bProfile) { // gain / dither and interleave in separate passes, so that they can be timed separately
+								localPeak = applyGain(ch, oBuf, o, 1, oBuf, 1, firstFrame, lastFrame);
+								ProfileScope interleaveScope(&interleaveRecords[ch]);
+								for (size_t f = 0; f < o; ++f) {
+									outputBlock[f * nChannels + ch] = oBuf[f]; // interleave
+								}
+							}
+							else { // gain, dither, peak and interleave in a single pass
+								localPeak = applyGain(ch, oBuf, o, 1, outputBlock.data() + ch, nChannels, firstFrame, lastFrame);
+							}
+							Result res;
+							res.outBlockindex = o * nChannels;
+							res.peak = localPeak;
+							return res;
+						};
+
+						if (multiThreaded) {
+							results[ch] = channelThreads[ch]->push(kernel);
+						}
+						else {
+							Result res = kernel();
+							peakOutputSample = std::max(peakOutputSample, res.peak);
+							outputBlockIndex = res.outBlockindex;
+						}
+					}
 
-			if (multiThreaded) { // collect results:
-				for (int ch = 0; ch < nChannels; ++ch) {
-					Result res = results[ch].get();
-					peakOutputSample = std::max(peakOutputSample, res.peak);
-					outputBlockIndex = res.outBlockindex;
+					if (multiThreaded) { // collect results:
+						for (int ch = 0; ch < nChannels; ++ch) {
+							Result res = results[ch].get();
+							peakOutputSample = std::max(peakOutputSample, res.peak);
+							outputBlockIndex = res.outBlockindex;
+						}
+					}
 				}
-			}
 
-			// write to either temp file or outfile (with Group Delay Compensation):
-			if (ci.bTmpFile) {
-				tmpSndfileHandle->write(outputBlock.data() + outStartOffset, outputBlockIndex - outStartOffset);
-			}
-			else {
-				if (ci.csvOutput) {
-					csvFile->write(outputBlock.data() + outStartOffset, outputBlockIndex - outStartOffset);
+				// write to either temp file or outfile (with Group Delay Compensation):
+				ProfileScope writeScope(writeRecord);
+				size_t outStartOffset = std::min(samplesToTrim, outputBlockIndex);
+				size_t outputSamples = std::min(outputBlockIndex - outStartOffset, samplesToWrite);
+				samplesToTrim -= outStartOffset;
+				samplesToWrite -= outputSamples;
+				samplesWritten += outputSamples;
+				if (ci.bTmpFile) {
+					tmpSndfileHandle->write(output + outStartOffset, outputSamples);
 				}
 				else {
-					outFile->write(outputBlock.data() + outStartOffset, outputBlockIndex - outStartOffset);
+					if (ci.csvOutput) {
+						csvFile->write(output + outStartOffset, outputSamples);
+					}
+					else if (pcmFile) {
+						pcmFile->write(output + outStartOffset, outputSamples);
+					}
+					else {
+						outFile->write(output + outStartOffset, outputSamples);
+					}
 				}
-			}
-			outStartOffset = 0; // reset after first use
 
-			// conditionally send progress update:
-			if (totalSamplesRead > nextProgressThreshold) {
-				int progressPercentage = std::min(static_cast<int>(99), static_cast<int>(100 * totalSamplesRead / inputSampleCount));
+				// conditionally send progress update:
+				if (totalSamplesRead > nextProgressThreshold) {
+					int progressPercentage = std::min(static_cast<int>(99), static_cast<int>(100 * totalSamplesRead / inputSampleCount));
 #ifdef COMPILING_ON_ANDROID
-        		ANDROID_OUT("%d%%", progressPercentage); // logcat cannot handle backspace '\b' formatter
+	        		ANDROID_OUT("%d%%", progressPercentage); // logcat cannot handle backspace '\b' formatter
 #else
-				std::cout << progressPercentage << "%\b\b\b" << std::flush;
+					std::cout << progressPercentage << "%\b\b\b" << std::flush;
 #endif
-				nextProgressThreshold += incrementalProgressThreshold;
-			}
+					nextProgressThreshold += incrementalProgressThreshold;
+				}
+				metrics.update(totalSamplesRead / nChannels, peakOutputSample);
 
-		} while (samplesRead > 0); // ends central conversion loop
+			} while (samplesRead > 0 && samplesToWrite > 0); // ends central conversion loop (at end of file, or end of time range)
+			convertTimer.stop();
+		}
+
+		if (ci.segment > 0) { // close segment file, and write its manifest (clipping protection and dither are done when stitching)
+			delete tmpSndfileHandle;
+			tmpSndfileHandle = nullptr;
+			SegmentManifest manifest;
+			manifest.inputFilename = ci.inputFilename;
+			manifest.inputFrames = inputFrames;
+			manifest.segment = ci.segment;
+			manifest.numSegments = ci.numSegments;
+			manifest.startFrame = startFrame;
+			manifest.endFrame = endFrame;
+			manifest.channels = nChannels;
+			manifest.sampleRate = ci.outputSampleRate;
+			manifest.bytesPerSample = sizeof(FloatType);
+			manifest.firstOutputFrame = startOutputFrame;
+			manifest.outputFrames = samplesWritten / nChannels;
+			manifest.peak = peakOutputSample;
+			std::string manifestFilename = getSegmentManifestFilename(ci.outputFilename, ci.segment);
+			if (!manifest.write(manifestFilename)) {
+#ifdef COMPILING_ON_ANDROID
+				ANDROID_ERR("Error: Couldn't write segment manifest %s", ANDROID_STDTOC(manifestFilename));
+#else
+				std::cerr << "Error: Couldn't write segment manifest " << manifestFilename << std::endl;
+#endif
+				return false;
+			}
+#ifdef COMPILING_ON_ANDROID
+			ANDROID_OUT("Done (segment %d of %d: %lld frames)", ci.segment, ci.numSegments, static_cast<long long>(manifest.outputFrames));
+#else
+			std::cout << "Done (segment " << ci.segment << " of " << ci.numSegments << ": " << manifest.outputFrames << " frames, written to "
+				<< getSegmentFilename(ci.outputFilename, ci.segment) << ")" << std::endl;
+#endif
+			break;
+		}
 
 		if (ci.bTmpFile) {
 			gain = 1.0; // output file must start with unity gain relative to temp file
@@ -1122,7 +1709,7 @@ bool convert(ConversionInfo& ci)
 
 		do {
 			// test for clipping:
-			if (!ci.disableClippingProtection && peakOutputSample > ci.limit) {
+			if (!ci.disableClippingProtection && !bGainPreset && peakOutputSample > ci.limit) {
 
 #ifdef COMPILING_ON_ANDROID
         		ANDROID_OUT("Clipping detected !");
@@ -1158,11 +1745,6 @@ bool convert(ConversionInfo& ci)
 					}
 				}
 
-				// reset the converters
-				for (auto &converter : converters) {
-					converter.reset();
-				}
-
 			} // ends test for clipping
 
 			// if using temp file, write to outFile
@@ -1173,38 +1755,58 @@ bool convert(ConversionInfo& ci)
 #else
 				std::cout << "Writing to output file ...\n";
 #endif
-				std::vector<FloatType> outBuf(inputBlockSize, 0);
+				tmpFileTimer.start();
+				ProfileScope tmpFileScope(profiler.record("temp file pass"));
+				metrics.setPhase(MetricsReporter::tempPass, clippingProtectionAttempts + 1,
+					static_cast<int64_t>(inputSampleCount / nChannels) * fraction.numerator / fraction.denominator, ci.outputSampleRate);
 				peakOutputSample = 0.0;
 				totalSamplesRead = 0;
 				incrementalProgressThreshold = inputSampleCount / 10;
 				nextProgressThreshold = incrementalProgressThreshold;
 
-				tmpSndfileHandle->seek(0, SEEK_SET);
-				if (!ci.csvOutput) {
+				if (segmentReader) {
+					segmentReader->seek(0, SEEK_SET);
+				}
+				else {
+					tmpSndfileHandle->seek(0, SEEK_SET);
+				}
+				if (pcmFile) {
+					pcmFile->seek(0, SEEK_SET);
+				}
+				else if (!ci.csvOutput) {
 					outFile->seek(0, SEEK_SET);
 				}
 
 				do { // Grab a block of interleaved samples from temp file:
-					samplesRead = tmpSndfileHandle->read(inputBlock.data(), inputBlockSize);
+					samplesRead = segmentReader ? segmentReader->read(inputBlock.data(), inputBlockSize) : tmpSndfileHandle->read(inputBlock.data(), inputBlockSize);
 					totalSamplesRead += samplesRead;
 
-					// de-interleave into channels, apply gain, add dither, and save to output buffer
-					size_t i = 0;
-					for (size_t s = 0; s < samplesRead; s += nChannels) {
+					// apply gain and add dither (in-place, one channel at a time), and find peak
+					size_t i = static_cast<size_t>(samplesRead);
+					if (ci.bDither) {
+						size_t frames = i / nChannels;
 						for (int ch = 0; ch < nChannels; ++ch) {
-							FloatType smpl = ci.bDither ? ditherers[ch].dither(gain * inputBlock[i]) :
-								gain * inputBlock[i];
-							peakOutputSample = std::max(std::abs(smpl), peakOutputSample);
-							outBuf[i++] = smpl;
+							ditherers[ch].ditherBlock(inputBlock.data() + ch, frames, gain, nChannels);
+						}
+					}
+					else {
+						for (size_t s = 0; s < i; ++s) {
+							inputBlock[s] *= gain;
 						}
 					}
+					for (size_t s = 0; s < i; ++s) {
+						peakOutputSample = std::max(std::abs(inputBlock[s]), peakOutputSample);
+					}
 
-					// write output buffer to outfile
+					// write buffer to outfile
 					if (ci.csvOutput) {
-						csvFile->write(outBuf.data(), i);
+						csvFile->write(inputBlock.data(), i);
+					}
+					else if (pcmFile) {
+						pcmFile->write(inputBlock.data(), i);
 					}
 					else {
-						outFile->write(outBuf.data(), i);
+						outFile->write(inputBlock.data(), i);
 					}
 
 					// conditionally send progress update:
@@ -1218,8 +1820,10 @@ bool convert(ConversionInfo& ci)
 #endif
 						nextProgressThreshold += incrementalProgressThreshold;
 					}
+					metrics.update(totalSamplesRead / nChannels, peakOutputSample);
 
 				} while (samplesRead > 0);
+				tmpFileTimer.stop();
 
 #ifdef COMPILING_ON_ANDROID
 		        ANDROID_OUT("Done");
@@ -1236,7 +1840,7 @@ bool convert(ConversionInfo& ci)
 
 			} // ends if (ci.bTmpFile)
 
-			bClippingDetected = peakOutputSample > ci.limit;
+			bClippingDetected = !bGainPreset && peakOutputSample > ci.limit;
 			if (bClippingDetected)
 				clippingProtectionAttempts++;
 
@@ -1246,8 +1850,64 @@ bool convert(ConversionInfo& ci)
 			// (This whole control structure might be better served with good old gotos ...)
 
 		} while (ci.bTmpFile && !ci.disableClippingProtection && bClippingDetected && clippingProtectionAttempts < maxClippingProtectionAttempts); // if using temp file, do another round if clipping detected
+
+		if ((outFile && !outFile->close()) || (pcmFile && !pcmFile->close())) { // (with --asyncIO or native writer, writes may fail after the event; native writer also fails if the file is too large for its format)
+#ifdef COMPILING_ON_ANDROID
+			ANDROID_ERR("Error: Couldn't write output file");
+#else
+			std::cerr << "Error: Couldn't write output file" << std::endl;
+#endif
+			return false;
+		}
+
 	} while (!ci.bTmpFile && !ci.disableClippingProtection && bClippingDetected && clippingProtectionAttempts < maxClippingProtectionAttempts); // if NOT using temp file, do another round if clipping detected
 
+	metrics.finish(peakOutputSample);
+
+	if (ci.bProfile) {
+		if (mcConverter) {
+			for (auto& stageProfile : mcConverter->getStageProfiles()) {
+				profiler.add(stageProfile.first, stageProfile.second);
+			}
+		}
+		for (int ch = 0; ch < nChannels; ++ch) {
+			std::string channel = "ch" + std::to_string(ch) + " ";
+			if (!mcConverter) {
+				for (auto& stageProfile : converters[ch].getStageProfiles()) {
+					profiler.add(channel + stageProfile.first, stageProfile.second);
+				}
+			}
+			profiler.add(channel + "dither", ditherRecords[ch]);
+			profiler.add(channel + "interleave", interleaveRecords[ch]);
+		}
+		wallTimer.stop();
+		profiler.setWallTime(wallTimer.getElapsed());
+		profiler.printTable(std::cout);
+		if (ci.profileFilename.empty()) {
+			std::cout << profiler.toJson() << std::endl;
+		}
+		else if (!profiler.writeJson(ci.profileFilename)) {
+			std::cerr << "Warning: couldn't write profile to " << ci.profileFilename << std::endl;
+		}
+	}
+
+	if (ci.bShowTimings) {
+		auto flags = std::cout.flags();
+		auto prec = std::cout.precision();
+#ifdef COMPILING_ON_ANDROID
+		ANDROID_OUT("Timings: peak scan=%.1f ms, convert=%.1f ms, temp file pass=%.1f ms, peak RSS=%ld kB",
+			peakScanTimer.getElapsed(), convertTimer.getElapsed(), tmpFileTimer.getElapsed(), getPeakRSS());
+#else
+		std::cout << std::fixed << std::setprecision(1)
+			<< "Timings: peak scan=" << peakScanTimer.getElapsed() << " ms"
+			<< ", convert=" << convertTimer.getElapsed() << " ms"
+			<< ", temp file pass=" << tmpFileTimer.getElapsed() << " ms"
+			<< ", peak RSS=" << getPeakRSS() << " kB" << std::endl;
+#endif
+		std::cout.flags(flags);
+		std::cout.precision(prec);
+	}
+
 	// clean-up temp file:
 	delete tmpSndfileHandle; // dealllocate SndFileHandle
 
@@ -1466,6 +2126,13 @@ bool setMetaData(const MetaData& metadata, SndfileHandle& outfile) {
 	return (outfile.error() == 0);
 }
 
+// hasMetaData() : true if there is any metadata to be written
+bool hasMetaData(const MetaData& metadata) {
+	return !metadata.title.empty() || !metadata.copyright.empty() || !metadata.software.empty() || !metadata.artist.empty() ||
+		!metadata.comment.empty() || !metadata.date.empty() || !metadata.album.empty() || !metadata.license.empty() ||
+		!metadata.trackNumber.empty() || !metadata.genre.empty() || metadata.has_bext_fields || metadata.has_cart_chunk;
+}
+
 bool testSetMetaData(SndfileHandle& outfile) {
 	MetaData m;
     memset(&m, 0, sizeof(m));
@@ -1587,9 +2254,14 @@ bool getMetaData(MetaData& metadata, const DsfFile& f) {
 	return true;
 }
 
+bool getMetaData(MetaData& metadata, const MappedPcmFile& f) {
+	SndfileHandle infile(f.getPath(), SFM_READ); // (let libsndfile read the metadata chunks; sound data is read from the mapped file)
+	return getMetaData(metadata, infile);
+}
+
 #ifndef FIR_QUAD_PRECISION
 
-void generateExpSweep(const std::string& filename, int sampleRate, int format, double duration, int nOctaves, double amplitude_dB) {
+void generateExpSweep(const std::string& filename, int sampleRate, int format, double duration, int nOctaves, double amplitude_dB, int numChannels) {
 	int pow2P = 1 << nOctaves;
 	int pow2P1 = 1 << (nOctaves + 1);
 	double amplitude = pow(10.0, (amplitude_dB / 20.0));
@@ -1599,19 +2271,28 @@ void generateExpSweep(const std::string& filename, int sampleRate, int format, d
 	double C = (N * M_PI / pow2P) / y;
 	double TWOPI = 2.0 * M_PI;
 
-	SndfileHandle outFile(filename, SFM_WRITE, format, 1, sampleRate);
+	SndfileHandle outFile(filename, SFM_WRITE, format, numChannels, sampleRate);
 	std::vector<double> signal(N, 0.0);
 
 	for(int n = 0; n < N; n++) {
 		signal[n] = amplitude * sin(fmod(C * exp(y * n / N), TWOPI));
 	}
 
-	outFile.write(signal.data(), N);
+	if (numChannels == 1) {
+		outFile.write(signal.data(), N);
+	}
+	else { // copy the signal to every channel
+		std::vector<double> interleaved(static_cast<size_t>(N) * numChannels);
+		for (int n = 0; n < N; n++) {
+			std::fill_n(interleaved.begin() + static_cast<size_t>(n) * numChannels, numChannels, signal[n]);
+		}
+		outFile.writef(interleaved.data(), N);
+	}
 }
 
 #else // QUAD PRECISION VERSION
 
-void generateExpSweep(const std::string& filename, int sampleRate, int format, double duration, int nOctaves, double amplitude_dB) {
+void generateExpSweep(const std::string& filename, int sampleRate, int format, double duration, int nOctaves, double amplitude_dB, int numChannels) {
 
 	int pow2P = 1 << nOctaves;
 	int pow2P1 = 1 << (nOctaves + 1);
@@ -1622,14 +2303,23 @@ void generateExpSweep(const std::string& filename, int sampleRate, int format, d
 	__float128 C = (N * M_PIq / pow2P) / y;
 	__float128 TWOPI = 2.0Q * M_PIq;
 
-	SndfileHandle outFile(filename, SFM_WRITE, format, 1, sampleRate);
+	SndfileHandle outFile(filename, SFM_WRITE, format, numChannels, sampleRate);
 	std::vector<double> signal(N, 0.0);
 
 	for (int n = 0; n < N; n++) {
 		signal[n] = amplitude * sinq(fmodq(C * expq(y * n / N), TWOPI));
 	}
 
-	outFile.write(signal.data(), N);
+	if (numChannels == 1) {
+		outFile.write(signal.data(), N);
+	}
+	else { // copy the signal to every channel
+		std::vector<double> interleaved(static_cast<size_t>(N) * numChannels);
+		for (int n = 0; n < N; n++) {
+			std::fill_n(interleaved.begin() + static_cast<size_t>(n) * numChannels, numChannels, signal[n]);
+		}
+		outFile.writef(interleaved.data(), N);
+	}
 }
 
 #endif
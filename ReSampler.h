@@ -27,18 +27,30 @@ const std::string strExtraOptions(
 	"--sndfile-version\n"
 	"--listsubformats <ext>\n"
 	"--showDitherProfiles\n"
+	"--selfTest\n"
 	"--gain [<amount>]\n"
 	"--doubleprecision\n"
+	"--extendedPrecision\n"
 	"--dither [<amount>] [--autoblank] [--ns [<ID>]] [--flat-tpdf] [--seed [<num>]] [--quantize-bits <number of bits>]\n"
 	"--noDelayTrim\n"
 	"--minphase\n"
 	"--flacCompression <compressionlevel>\n"
 	"--vorbisQuality <quality>\n"
 	"--noClippingProtection\n"
+	"--start <time>\n"
+	"--end <time>\n"
+	"--segment <k> --segments <N>\n"
+	"--stitch --segments <N>\n"
 	"--relaxedLPF\n"
 	"--steepLPF\n"
 	"--lpf-cutoff <percentage> [--lpf-transition <percentage>]\n"
+	"--quality <draft|standard|high|mastering|auto>\n"
 	"--mt\n"
+	"--vectoriseChannels\n"
+	"--affinity [<compact|scatter|cpu list>]\n"
+	"--asyncIO [--ioDepth <n>] [--directIO]\n"
+	"--mmap\n"
+	"--nativeWriter\n"
 	"--rf64\n"
 	"--noPeakChunk\n"
 	"--noMetadata\n"
@@ -46,6 +58,16 @@ const std::string strExtraOptions(
     "--multiStage\n"
 	"--maxStages\n"
 	"--showStages\n"
+	"--noSpecialisedKernels\n"
+	"--noSilenceFastPath\n"
+	"--showTimings\n"
+	"--profile [<json filename>]\n"
+	"--metrics <fd:N|filename|filename.prom> [--metricsInterval <seconds>]\n"
+	"--fftWisdom <filename>\n"
+	"--fftPlanner <estimate|measure|patient|exhaustive>\n"
+	"--blockSize <frames>\n"
+	"--lowLatency\n"
+	"--realtimeTest [--inputRate <samplerate>] [--channels <num>] [--duration <seconds>]\n"
 
 #if defined (_WIN32) || defined (_WIN64)
 	"--tempDir <path>\n"
@@ -58,7 +80,9 @@ const std::string strExtraOptions(
 const double clippingTrim = 1.0 - (1.0 / (1 << 23));
 const int maxClippingProtectionAttempts = 3;
 
-#define BUFFERSIZE 32768 // buffer size for file reads
+#define BUFFERSIZE 32768 // largest (and fallback) buffer size (frames) for file reads (see --blockSize)
+#define MIN_AUTO_BLOCKSIZE 4096 // smallest block size chosen automatically (frames)
+#define REALTIME_BLOCKSIZE 64 // default block size for --realtimeTest (frames)
 
 // map of commandline subformats to libsndfile subformats:
 const std::map<std::string,int> subFormats = { 
@@ -135,11 +159,11 @@ struct MetaData
 	std::string genre;
 
 	// The following is only relevant for bext chunks in Broadcast Wave files:
-	bool has_bext_fields;
+	bool has_bext_fields = false;
 	SF_BROADCAST_INFO broadcastInfo;
 
 	// The following is only relevant for cart chunks:
-	bool has_cart_chunk;
+	bool has_cart_chunk = false;
 	LargeSFCartInfo cartInfo;
 
 };
@@ -189,11 +213,13 @@ void generateExpSweep(const std::string & filename,
 	int format = SF_FORMAT_WAV | SF_FORMAT_FLOAT, // format of generated file
 	double duration = 10.0, // approximate duration in seconds 
 	int octaves = 12, // number of octaves below Nyquist for lowest frequency 
-	double amplitude_dB = -3.0 // amplitude in dB relative to FS
+	double amplitude_dB = -3.0, // amplitude in dB relative to FS
+	int numChannels = 1 // number of channels (same signal on each channel)
 );
 
 bool getMetaData(MetaData& metadata, SndfileHandle& infile);
 bool setMetaData(const MetaData& metadata, SndfileHandle& outfile);
+bool hasMetaData(const MetaData& metadata);
 void showCompiler();
 
 #endif // RESAMPLER_H
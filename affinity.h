@@ -0,0 +1,213 @@
+/*
+* Copyright (C) 2016 - 2019 Judd Niemann - All Rights Reserved.
+* You may use, distribute and modify this code under the
+* terms of the GNU Lesser General Public License, version 2.1
+*
+* You should have received a copy of GNU Lesser General Public License v2.1
+* with this file. If not, please refer to: https://github.com/jniemann66/ReSampler
+*/
+
+// affinity.h : placement of conversion work on CPUs (--affinity)
+
+// Each channel is assigned a CPU according to a policy:
+//  compact : fill the CPUs of one NUMA node before moving on to the next
+//  scatter : spread channels evenly across the NUMA nodes
+//  <list>  : explicit list of CPUs (eg 0,2,4-7), used in turn
+// Work for a channel is always done on the channel's CPU (the thread doing the work pins itself to that CPU first),
+// and each channel's conversion state is allocated on its own CPU, so that (with Linux's first-touch policy) its memory is local to the CPU's node.
+// Pinning is supported on Linux and Windows; elsewhere, the placement is reported but not enforced.
+
+#ifndef AFFINITY_H
+#define AFFINITY_H 1
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#if defined(_WIN32) || defined(_WIN64)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+class CpuAffinity {
+public:
+	// isValidPolicy() : true if policy is "compact", "scatter" or a valid list of CPUs
+	static bool isValidPolicy(const std::string& policy) {
+		return policy == "compact" || policy == "scatter" || !parseCpuList(policy).empty();
+	}
+
+	// assignCpus() : choose a CPU for each of numChannels channels, according to policy
+	static std::vector<int> assignCpus(const std::string& policy, int numChannels) {
+		std::vector<int> order;
+		if (policy == "compact" || policy == "scatter") {
+			std::vector<std::pair<int, int>> nodeCpus; // (node, cpu)
+			for (int cpu : getAvailableCpus()) {
+				nodeCpus.emplace_back(getNodeOfCpu(cpu), cpu);
+			}
+			std::sort(nodeCpus.begin(), nodeCpus.end());
+			if (policy == "compact") {
+				for (auto& nc : nodeCpus) {
+					order.push_back(nc.second);
+				}
+			}
+			else { // scatter: take one CPU from each node in turn
+				std::vector<std::vector<int>> nodes;
+				for (size_t i = 0; i < nodeCpus.size(); i++) {
+					if (i == 0 || nodeCpus[i].first != nodeCpus[i - 1].first)
+						nodes.emplace_back();
+					nodes.back().push_back(nodeCpus[i].second);
+				}
+				for (size_t round = 0; order.size() < nodeCpus.size(); round++) {
+					for (auto& node : nodes) {
+						if (round < node.size())
+							order.push_back(node[round]);
+					}
+				}
+			}
+		}
+		else {
+			order = parseCpuList(policy);
+		}
+
+		std::vector<int> cpus;
+		for (int ch = 0; ch < numChannels && !order.empty(); ch++) {
+			cpus.push_back(order[ch % order.size()]);
+		}
+		return cpus;
+	}
+
+	// pinThisThread() : restrict the calling thread to the given CPU (does nothing if already pinned to it).
+	// Returns false if pinning isn't supported or failed.
+	static bool pinThisThread(int cpu) {
+		static thread_local int pinnedCpu = -1;
+		if (cpu == pinnedCpu)
+			return true;
+
+#if defined(_WIN32) || defined(_WIN64)
+		if (cpu >= static_cast<int>(8 * sizeof(DWORD_PTR)) || SetThreadAffinityMask(GetCurrentThread(), static_cast<DWORD_PTR>(1) << cpu) == 0)
+			return false;
+#elif defined(__linux__)
+		if (cpu < 0 || cpu >= CPU_SETSIZE)
+			return false;
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		CPU_SET(cpu, &set);
+		if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0)
+			return false;
+#else
+		return false;
+#endif
+
+		pinnedCpu = cpu;
+		return true;
+	}
+
+	// getNodeOfCpu() : returns the NUMA node of a CPU (0 if unknown)
+	static int getNodeOfCpu(int cpu) {
+
+#if defined(_WIN32) || defined(_WIN64)
+		UCHAR node = 0;
+		if (cpu < 256 && GetNumaProcessorNode(static_cast<UCHAR>(cpu), &node) && node != 0xff)
+			return node;
+		return 0;
+#else
+		static const std::vector<int> nodeOfCpu = readNodeMap();
+		return (cpu >= 0 && cpu < static_cast<int>(nodeOfCpu.size())) ? nodeOfCpu[cpu] : 0;
+#endif
+
+	}
+
+	// describe() : description of the placement, for reporting to user
+	static std::string describe(const std::string& policy, const std::vector<int>& cpus) {
+		std::ostringstream os;
+		os << "Thread affinity (" << policy << "):";
+		for (size_t ch = 0; ch < cpus.size(); ch++) {
+			os << (ch == 0 ? " " : ", ") << "channel " << ch << " -> CPU " << cpus[ch] << " (node " << getNodeOfCpu(cpus[ch]) << ")";
+		}
+
+#if !defined(_WIN32) && !defined(_WIN64) && !defined(__linux__)
+		os << " (note: pinning not supported on this OS)";
+#endif
+
+		return os.str();
+	}
+
+	// parseCpuList() : parse a list of CPUs (eg "0,2,4-7"). Returns an empty list if malformed.
+	static std::vector<int> parseCpuList(const std::string& list) {
+		std::vector<int> cpus;
+		std::istringstream ss(list);
+		std::string range;
+		while (std::getline(ss, range, ',')) {
+			if (range.empty() || range.find_first_not_of("0123456789-") != std::string::npos)
+				return std::vector<int>();
+			auto dash = range.find('-');
+			try {
+				int first = std::stoi(range.substr(0, dash));
+				int last = (dash == std::string::npos) ? first : std::stoi(range.substr(dash + 1));
+				if (last < first)
+					return std::vector<int>();
+				for (int cpu = first; cpu <= last; cpu++) {
+					cpus.push_back(cpu);
+				}
+			}
+			catch (std::exception&) {
+				return std::vector<int>();
+			}
+		}
+		return cpus;
+	}
+
+private:
+	// getAvailableCpus() : CPUs this process is allowed to run on
+	static std::vector<int> getAvailableCpus() {
+		std::vector<int> cpus;
+
+#if defined(__linux__)
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+			for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+				if (CPU_ISSET(cpu, &set))
+					cpus.push_back(cpu);
+			}
+		}
+#endif
+
+		if (cpus.empty()) {
+			int n = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+			for (int cpu = 0; cpu < n; cpu++) {
+				cpus.push_back(cpu);
+			}
+		}
+		return cpus;
+	}
+
+	// readNodeMap() : read NUMA node of each CPU from sysfs (Linux)
+	static std::vector<int> readNodeMap() {
+		std::vector<int> nodeOfCpu;
+		for (int node = 0; ; node++) {
+			std::ifstream f("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+			if (!f.is_open())
+				break;
+			std::string list;
+			f >> list;
+			for (int cpu : parseCpuList(list)) {
+				if (cpu >= static_cast<int>(nodeOfCpu.size()))
+					nodeOfCpu.resize(cpu + 1, 0);
+				nodeOfCpu[cpu] = node;
+			}
+		}
+		return nodeOfCpu;
+	}
+};
+
+#endif // AFFINITY_H
@@ -0,0 +1,186 @@
+/*
+* Copyright (C) 2016 - 2019 Judd Niemann - All Rights Reserved.
+* You may use, distribute and modify this code under the
+* terms of the GNU Lesser General Public License, version 2.1
+*
+* You should have received a copy of GNU Lesser General Public License v2.1
+* with this file. If not, please refer to: https://github.com/jniemann66/ReSampler
+*/
+
+// arena.h : arena allocation of conversion memory (filter kernels, signal histories and intermediate buffers)
+
+// An Arena hands out (zero-filled, aligned) memory for the lifetime of a conversion job (eg a Converter),
+// and releases it all at once when it is destroyed:
+//  - small allocations are carved out of shared chunks, so that a job's buffers sit together, and setting up a job doesn't hit the heap repeatedly
+//  - large allocations get a region of their own. On Linux, those of a huge page or more (eg the kernel tables and history
+//    of a filter with 100k+ taps) are aligned to, and a whole number of, huge pages, and are advised to be backed by
+//    transparent huge pages (MADV_HUGEPAGE), so that stepping through the kernel takes far fewer TLB misses
+// On Linux, the memory is only touched (and so, with the first-touch policy, only placed on a NUMA node) when first written by the user;
+// elsewhere, it is zero-filled by the thread which allocates it.
+// An Arena can be moved (the memory stays where it is), but not copied.
+
+#ifndef ARENA_H
+#define ARENA_H 1
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+#include "alignedmalloc.h"
+
+#define ARENA_CHUNK_SIZE (1 << 20)				// size of chunks shared by small allocations
+#define ARENA_LARGE_ALLOCATION (1 << 18)		// allocations at least this large get a region of their own
+#define ARENA_HUGE_PAGE_SIZE (1 << 21)			// (2 MB: x86-64 and arm64, with 4 KB base pages)
+
+class Arena
+{
+public:
+	Arena() = default;
+
+	~Arena() {
+		release();
+	}
+
+	Arena(const Arena&) = delete;
+	Arena& operator=(const Arena&) = delete;
+
+	Arena(Arena&& other) noexcept :
+		regions(std::move(other.regions)), chunk(other.chunk), chunkUsed(other.chunkUsed), bytesAllocated(other.bytesAllocated), hugePageBytes(other.hugePageBytes)
+	{
+		other.regions.clear();
+		other.chunk = nullptr;
+		other.chunkUsed = ARENA_CHUNK_SIZE;
+		other.bytesAllocated = 0;
+		other.hugePageBytes = 0;
+	}
+
+	Arena& operator=(Arena&& other) noexcept {
+		if (this != &other) {
+			release();
+			regions = std::move(other.regions);
+			chunk = other.chunk;
+			chunkUsed = other.chunkUsed;
+			bytesAllocated = other.bytesAllocated;
+			hugePageBytes = other.hugePageBytes;
+			other.regions.clear();
+			other.chunk = nullptr;
+			other.chunkUsed = ARENA_CHUNK_SIZE;
+			other.bytesAllocated = 0;
+			other.hugePageBytes = 0;
+		}
+		return *this;
+	}
+
+	// allocate() : returns zero-filled memory for bytes bytes, aligned to alignment (a power of 2, no more than 4096),
+	// which stays valid until the Arena is destroyed. Returns nullptr if out of memory
+	void* allocate(size_t bytes, size_t alignment) {
+		if (bytes == 0)
+			return nullptr;
+		if (bytes >= ARENA_LARGE_ALLOCATION) {
+			void* p = allocateRegion(bytes);
+			if (p != nullptr)
+				bytesAllocated += bytes;
+			return p;
+		}
+		size_t offset = (chunkUsed + alignment - 1) & ~(alignment - 1);
+		if (chunk == nullptr || offset + bytes > ARENA_CHUNK_SIZE) {
+			chunk = static_cast<char*>(allocateRegion(ARENA_CHUNK_SIZE));
+			if (chunk == nullptr) {
+				chunkUsed = ARENA_CHUNK_SIZE;
+				return nullptr;
+			}
+			offset = 0;
+		}
+		chunkUsed = offset + bytes;
+		bytesAllocated += bytes;
+		return chunk + offset;
+	}
+
+	// allocateArray() : allocate (zero-filled) memory for count objects of (trivial) type T
+	template<typename T>
+	T* allocateArray(size_t count, size_t alignment = alignof(T)) {
+		return static_cast<T*>(allocate(count * sizeof(T), std::max(alignment, alignof(T))));
+	}
+
+	// getBytesAllocated() : total size of allocations
+	size_t getBytesAllocated() const {
+		return bytesAllocated;
+	}
+
+	// getHugePageBytes() : size of the regions advised to be backed by huge pages
+	size_t getHugePageBytes() const {
+		return hugePageBytes;
+	}
+
+private:
+	struct Region {
+		void* p;
+		size_t size;	// (mapped size; 0 if from aligned_malloc())
+	};
+
+	std::vector<Region> regions;
+	char* chunk = nullptr;			// chunk currently used for small allocations
+	size_t chunkUsed = ARENA_CHUNK_SIZE;
+	size_t bytesAllocated = 0;
+	size_t hugePageBytes = 0;
+
+	// allocateRegion() : allocate a region of memory of its own (huge-page aligned and advised, if at least a huge page in size)
+	void* allocateRegion(size_t bytes) {
+
+#if defined(__linux__)
+		bool hugePages = bytes >= ARENA_HUGE_PAGE_SIZE;
+		size_t alignment = hugePages ? ARENA_HUGE_PAGE_SIZE : 4096;
+		size_t size = (bytes + alignment - 1) & ~(alignment - 1);
+		size_t extra = hugePages ? ARENA_HUGE_PAGE_SIZE : 0; // (map a little more than needed, and trim it to a huge-page aligned range)
+		void* mapping = mmap(nullptr, size + extra, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (mapping != MAP_FAILED) {
+			auto start = reinterpret_cast<uintptr_t>(mapping);
+			auto aligned = (start + alignment - 1) & ~static_cast<uintptr_t>(alignment - 1);
+			if (aligned != start)
+				munmap(mapping, aligned - start);
+			if (aligned - start != extra)
+				munmap(reinterpret_cast<void*>(aligned + size), extra - (aligned - start));
+
+#ifdef MADV_HUGEPAGE
+			if (hugePages && madvise(reinterpret_cast<void*>(aligned), size, MADV_HUGEPAGE) == 0)
+				hugePageBytes += size;
+#endif
+
+			regions.push_back({ reinterpret_cast<void*>(aligned), size }); // (anonymous mappings are zero-filled)
+			return reinterpret_cast<void*>(aligned);
+		}
+#endif
+
+		void* p = aligned_malloc(bytes, 4096);
+		if (p == nullptr)
+			return nullptr;
+		memset(p, 0, bytes);
+		regions.push_back({ p, 0 });
+		return p;
+	}
+
+	void release() {
+		for (auto& r : regions) {
+
+#if defined(__linux__)
+			if (r.size != 0) {
+				munmap(r.p, r.size);
+				continue;
+			}
+#endif
+
+			aligned_free(r.p);
+		}
+		regions.clear();
+		chunk = nullptr;
+		chunkUsed = ARENA_CHUNK_SIZE;
+	}
+};
+
+#endif // ARENA_H
@@ -0,0 +1,719 @@
+/*
+* Copyright (C) 2016 - 2019 Judd Niemann - All Rights Reserved.
+* You may use, distribute and modify this code under the
+* terms of the GNU Lesser General Public License, version 2.1
+*
+* You should have received a copy of GNU Lesser General Public License v2.1
+* with this file. If not, please refer to: https://github.com/jniemann66/ReSampler
+*/
+
+// asyncio.h : asynchronous file I/O (--asyncIO, --directIO, --ioDepth)
+
+// An AsyncFile keeps several large requests in flight at once, using a small pool of I/O threads doing positional reads and writes
+// (pread() / pwrite(), or ReadFile() / WriteFile() with an offset on Windows), so that I/O overlaps with filtering:
+//  reading : sequential reads are served from a window of blocks read ahead of the current position
+//  writing : data is collected into blocks, which are written behind, while the caller carries on
+// Blocks are aligned (ASYNCIO_ALIGNMENT), so that with --directIO, whole blocks can bypass the OS page cache
+// (O_DIRECT on Linux, F_NOCACHE on macOS, FILE_FLAG_NO_BUFFERING on Windows). Anything which isn't a whole block
+// (eg file headers, and the last block of a file) goes through the page cache as usual.
+// libsndfile uses an AsyncFile through SF_VIRTUAL_IO (see AsyncSndfileHandle), and the DSD readers through a std::streambuf (AsyncFileBuf).
+// (The native output file writer, PcmFileWriter, converts samples straight into the block being filled; see pcmwriter.h)
+
+#ifndef ASYNCIO_H
+#define ASYNCIO_H 1
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <streambuf>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(_WIN32) || defined(_WIN64)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "sndfile.hh"
+#include "alignedmalloc.h"
+
+#define ASYNCIO_ALIGNMENT 4096 // alignment of buffers, file offsets and lengths of direct I/O (covers the sector sizes of all common devices)
+#define ASYNCIO_MAX_DEPTH 64
+
+// struct IOOptions : how files are read and written
+
+struct IOOptions {
+	bool async = false;				// asynchronous I/O (AsyncFile)
+	bool direct = false;			// bypass OS page cache for whole blocks
+	int depth = 4;					// number of requests in flight
+	size_t blockSize = 1 << 20;		// size of each request (bytes; multiple of ASYNCIO_ALIGNMENT)
+	bool mmap = false;				// read input file by memory-mapping it (see mmapfile.h)
+};
+
+class AsyncFile
+{
+public:
+	enum OpenMode {
+		asyncio_read,
+		asyncio_write	// (creates or truncates file; reading back is also allowed)
+	};
+
+	AsyncFile(const std::string& path, OpenMode mode, const IOOptions& options) :
+		blockSize(std::max<size_t>(ASYNCIO_ALIGNMENT, options.blockSize - options.blockSize % ASYNCIO_ALIGNMENT)),
+		depth(std::max(1, std::min(options.depth, ASYNCIO_MAX_DEPTH)))
+	{
+		file = openNative(path, mode, false);
+		if (file == invalidHandle())
+			return;
+		if (options.direct) {
+			directFile = openNative(path, mode, true); // (stays invalid if not supported by OS or file system)
+		}
+		length = getNativeLength(file);
+
+		// one block is being filled (or read from) by the caller, while the others are in flight:
+		requests.resize(depth + 1);
+		for (auto& r : requests) {
+			r.data = static_cast<char*>(aligned_malloc(blockSize, ASYNCIO_ALIGNMENT));
+			if (r.data == nullptr) {
+				close();
+				return;
+			}
+		}
+		for (int t = 0; t < depth; t++) {
+			workers.emplace_back(&AsyncFile::worker, this);
+		}
+	}
+
+	AsyncFile(const AsyncFile&) = delete;
+	AsyncFile& operator=(const AsyncFile&) = delete;
+
+	~AsyncFile() {
+		close();
+	}
+
+	bool isOpen() const {
+		return file != invalidHandle();
+	}
+
+	bool isDirect() const {
+		return directFile != invalidHandle();
+	}
+
+	// error() : true if any I/O request has failed
+	bool error() {
+		std::lock_guard<std::mutex> lock(mutex);
+		return ioError;
+	}
+
+	int64_t getLength() const {
+		return length;
+	}
+
+	int64_t tell() const {
+		return position;
+	}
+
+	int64_t seek(int64_t offset, int whence) {
+		switch (whence) {
+		case SEEK_SET:
+			position = offset;
+			break;
+		case SEEK_CUR:
+			position += offset;
+			break;
+		case SEEK_END:
+			position = length + offset;
+			break;
+		default:
+			return -1;
+		}
+		position = std::max<int64_t>(0, position);
+		return position;
+	}
+
+	int64_t read(void* ptr, int64_t count) {
+		std::unique_lock<std::mutex> lock(mutex);
+		if (writeRequest != nullptr || hasPending(true)) { // (reading back what has been written)
+			flushLocked(lock);
+		}
+
+		int64_t done = 0;
+		count = std::min(count, length - position);
+		while (done < count) {
+			int64_t blockOffset = position - position % static_cast<int64_t>(blockSize);
+			Request* r = findRead(blockOffset);
+			if (r == nullptr) {
+				r = getFreeRequest(blockOffset, lock);
+				startRead(r, blockOffset);
+			}
+			readAhead(blockOffset); // keep the window ahead of the current block in flight
+			requestDone.wait(lock, [r] { return r->state != Request::pending; });
+			if (r->state != Request::ready)
+				break;
+
+			auto within = static_cast<size_t>(position - blockOffset);
+			if (within >= r->end)
+				break; // (file is shorter than expected)
+			auto n = static_cast<size_t>(std::min<int64_t>(r->end - within, count - done));
+			lock.unlock();
+			memcpy(static_cast<char*>(ptr) + done, r->data + within, n); // (only the caller recycles requests, so r stays put)
+			lock.lock();
+			done += n;
+			position += n;
+		}
+		return done;
+	}
+
+	int64_t write(const void* ptr, int64_t count) {
+		int64_t done = 0;
+		while (done < count) {
+			size_t n = 0;
+			char* p = getWriteBuffer(count - done, n);
+			if (p == nullptr)
+				break;
+			memcpy(p, static_cast<const char*>(ptr) + done, n); // (not in flight, so not touched by workers)
+			commitWrite(n);
+			done += n;
+		}
+		return done;
+	}
+
+	// getWriteBuffer() : space for writing (up to) count bytes at the current position, directly into the block being filled.
+	// The caller fills available (<= count) bytes of it, and then calls commitWrite(). Returns nullptr if any I/O has failed
+	char* getWriteBuffer(int64_t count, size_t& available) {
+		std::unique_lock<std::mutex> lock(mutex);
+		dropReadCache(lock);
+		if (ioError)
+			return nullptr;
+
+		if (writeRequest != nullptr && (position != writeRequest->offset + static_cast<int64_t>(writeRequest->end) || writeRequest->end == blockSize)) {
+			submit(writeRequest); // (not contiguous with the block being filled, or block is full)
+			writeRequest = nullptr;
+		}
+		if (writeRequest == nullptr) {
+			int64_t blockOffset = position - position % static_cast<int64_t>(blockSize);
+			requestDone.wait(lock, [this, blockOffset] { return !isBeingWritten(blockOffset); }); // (keep overlapping writes in order)
+			writeRequest = getFreeRequest(blockOffset, lock);
+			writeRequest->write = true;
+			writeRequest->offset = blockOffset;
+			writeRequest->begin = writeRequest->end = static_cast<size_t>(position - blockOffset);
+		}
+		available = static_cast<size_t>(std::min<int64_t>(blockSize - writeRequest->end, count));
+		return writeRequest->data + writeRequest->end;
+	}
+
+	// commitWrite() : count bytes have been written into the space returned by getWriteBuffer()
+	void commitWrite(size_t count) {
+		std::lock_guard<std::mutex> lock(mutex);
+		writeRequest->end += count;
+		position += count;
+		length = std::max(length, position);
+	}
+
+	// preallocate() : reserve disk space for a file of (at least) the given size, so that it doesn't have to grow one block at a time.
+	// (The file is truncated to the length actually written, when closed.) Returns false if not supported by OS or file system
+	bool preallocate(int64_t size) {
+		std::lock_guard<std::mutex> lock(mutex);
+		if (size <= length || !preallocateNative(file, size))
+			return false;
+		preallocated = true;
+		return true;
+	}
+
+	// flush() : write out everything written so far, and wait for it to complete. Returns false if any I/O has failed
+	bool flush() {
+		std::unique_lock<std::mutex> lock(mutex);
+		flushLocked(lock);
+		return !ioError;
+	}
+
+	// close() : write out everything written so far, and close the file. Returns false if any I/O has failed
+	bool close() {
+		bool ok = true;
+		if (!workers.empty()) {
+			ok = flush();
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				stopping = true;
+			}
+			workAvailable.notify_all();
+			for (auto& t : workers) {
+				t.join();
+			}
+			workers.clear();
+		}
+		for (auto& r : requests) {
+			aligned_free(r.data);
+		}
+		requests.clear();
+		if (preallocated && !truncateNative(file, length)) // (give back whatever wasn't used)
+			ok = false;
+		preallocated = false;
+		closeNative(directFile);
+		closeNative(file);
+		return ok;
+	}
+
+	// getVirtualIO() : callbacks for using an AsyncFile (passed as user_data) with libsndfile
+	static SF_VIRTUAL_IO& getVirtualIO() {
+		static SF_VIRTUAL_IO vio = {
+			[](void* user_data) -> sf_count_t {
+				return static_cast<AsyncFile*>(user_data)->getLength();
+			},
+			[](sf_count_t offset, int whence, void* user_data) -> sf_count_t {
+				return static_cast<AsyncFile*>(user_data)->seek(offset, whence);
+			},
+			[](void* ptr, sf_count_t count, void* user_data) -> sf_count_t {
+				return static_cast<AsyncFile*>(user_data)->read(ptr, count);
+			},
+			[](const void* ptr, sf_count_t count, void* user_data) -> sf_count_t {
+				return static_cast<AsyncFile*>(user_data)->write(ptr, count);
+			},
+			[](void* user_data) -> sf_count_t {
+				return static_cast<AsyncFile*>(user_data)->tell();
+			}
+		};
+		return vio;
+	}
+
+private:
+
+#if defined(_WIN32) || defined(_WIN64)
+	typedef HANDLE NativeHandle;
+	static NativeHandle invalidHandle() {
+		return INVALID_HANDLE_VALUE;
+	}
+#else
+	typedef int NativeHandle;
+	static NativeHandle invalidHandle() {
+		return -1;
+	}
+#endif
+
+	struct Request {
+		enum State {
+			idle,
+			pending,	// queued or in progress
+			ready,
+			failed
+		};
+
+		char* data = nullptr;
+		int64_t offset = 0;		// file position of data[0] (multiple of blockSize)
+		size_t begin = 0;		// range of valid (read) or new (written) data: [begin, end)
+		size_t end = 0;
+		bool write = false;
+		State state = idle;
+	};
+
+	size_t blockSize;
+	int depth;
+	NativeHandle file = invalidHandle();
+	NativeHandle directFile = invalidHandle();
+	int64_t position = 0;
+	int64_t length = 0;
+	std::vector<Request> requests;
+	Request* writeRequest = nullptr;	// block being filled by write()
+	std::deque<Request*> queue;
+	std::mutex mutex;
+	std::condition_variable workAvailable;
+	std::condition_variable requestDone;
+	std::vector<std::thread> workers;
+	bool stopping = false;
+	bool ioError = false;
+	bool preallocated = false;
+
+	void worker() {
+		std::unique_lock<std::mutex> lock(mutex);
+		for (;;) {
+			workAvailable.wait(lock, [this] { return stopping || !queue.empty(); });
+			if (queue.empty())
+				return;
+			Request* r = queue.front();
+			queue.pop_front();
+			lock.unlock();
+			bool ok = r->write ? doWrite(r) : doRead(r);
+			lock.lock();
+			r->state = ok ? Request::ready : Request::failed;
+			ioError = ioError || !ok;
+			requestDone.notify_all();
+		}
+	}
+
+	bool doRead(Request* r) {
+		// (a whole block is requested, even at the end of the file, so direct reads stay aligned)
+		int64_t n = preadNative(isDirect() ? directFile : file, r->data, blockSize, r->offset);
+		if (n < 0)
+			return false;
+		r->begin = 0;
+		r->end = static_cast<size_t>(n);
+		return true;
+	}
+
+	bool doWrite(Request* r) {
+		if (isDirect() && r->begin == 0 && r->end == blockSize)
+			return pwriteNative(directFile, r->data, blockSize, r->offset) == static_cast<int64_t>(blockSize);
+		size_t n = r->end - r->begin;
+		return pwriteNative(file, r->data + r->begin, n, r->offset + r->begin) == static_cast<int64_t>(n);
+	}
+
+	void submit(Request* r) {
+		r->state = Request::pending;
+		queue.push_back(r);
+		workAvailable.notify_one();
+	}
+
+	void startRead(Request* r, int64_t blockOffset) {
+		r->write = false;
+		r->offset = blockOffset;
+		r->begin = r->end = 0;
+		submit(r);
+	}
+
+	// readAhead() : start reading the blocks following blockOffset (up to depth blocks in total), if not already read or being read
+	void readAhead(int64_t blockOffset) {
+		for (int k = 1; k < depth; k++) {
+			int64_t offset = blockOffset + k * static_cast<int64_t>(blockSize);
+			if (offset >= length)
+				break;
+			if (findRead(offset) != nullptr)
+				continue;
+			Request* r = findFreeRequest(blockOffset);
+			if (r == nullptr)
+				break;
+			startRead(r, offset);
+		}
+	}
+
+	Request* findRead(int64_t offset) {
+		for (auto& r : requests) {
+			if (!r.write && r.offset == offset && (r.state == Request::pending || r.state == Request::ready))
+				return &r;
+		}
+		return nullptr;
+	}
+
+	bool isBeingWritten(int64_t offset) const {
+		for (auto& r : requests) {
+			if (r.write && r.offset == offset && r.state == Request::pending)
+				return true;
+		}
+		return false;
+	}
+
+	bool hasPending(bool writes) const {
+		for (auto& r : requests) {
+			if (r.state == Request::pending && r.write == writes)
+				return true;
+		}
+		return false;
+	}
+
+	// findFreeRequest() : a request which isn't in use, preferably one which has never been used (or nullptr if there isn't one).
+	// Blocks already read, which are not within the window of blocks from windowStart, may be recycled.
+	Request* findFreeRequest(int64_t windowStart) {
+		Request* candidate = nullptr;
+		for (auto& r : requests) {
+			if (&r == writeRequest || r.state == Request::pending)
+				continue;
+			if (r.state == Request::idle)
+				return &r;
+			bool inWindow = !r.write && r.state == Request::ready && r.offset >= windowStart && r.offset < windowStart + depth * static_cast<int64_t>(blockSize);
+			if (!inWindow && candidate == nullptr)
+				candidate = &r;
+		}
+		return candidate;
+	}
+
+	Request* getFreeRequest(int64_t windowStart, std::unique_lock<std::mutex>& lock) {
+		Request* r = nullptr;
+		requestDone.wait(lock, [&] { return (r = findFreeRequest(windowStart)) != nullptr; });
+		r->state = Request::idle;
+		return r;
+	}
+
+	void flushLocked(std::unique_lock<std::mutex>& lock) {
+		if (writeRequest != nullptr) {
+			submit(writeRequest);
+			writeRequest = nullptr;
+		}
+		requestDone.wait(lock, [this] { return !hasPending(true); });
+		for (auto& r : requests) {
+			if (r.write)
+				r.state = Request::idle;
+		}
+	}
+
+	// dropReadCache() : forget blocks read (before writing, which may change them)
+	void dropReadCache(std::unique_lock<std::mutex>& lock) {
+		requestDone.wait(lock, [this] { return !hasPending(false); });
+		for (auto& r : requests) {
+			if (!r.write)
+				r.state = Request::idle;
+		}
+	}
+
+	// OS-specific functions:
+
+#if defined(_WIN32) || defined(_WIN64)
+
+	static NativeHandle openNative(const std::string& path, OpenMode mode, bool direct) {
+		DWORD access = (mode == asyncio_write) ? (GENERIC_READ | GENERIC_WRITE) : GENERIC_READ;
+		DWORD disposition = (mode == asyncio_write && !direct) ? CREATE_ALWAYS : OPEN_EXISTING;
+		DWORD flags = FILE_ATTRIBUTE_NORMAL | (direct ? FILE_FLAG_NO_BUFFERING : 0);
+		return CreateFileA(path.c_str(), access, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, disposition, flags, nullptr);
+	}
+
+	static void closeNative(NativeHandle& h) {
+		if (h != invalidHandle())
+			CloseHandle(h);
+		h = invalidHandle();
+	}
+
+	static int64_t getNativeLength(NativeHandle h) {
+		LARGE_INTEGER size;
+		return GetFileSizeEx(h, &size) ? size.QuadPart : 0;
+	}
+
+	static int64_t preadNative(NativeHandle h, char* data, size_t count, int64_t offset) {
+		OVERLAPPED ov = {};
+		ov.Offset = static_cast<DWORD>(offset);
+		ov.OffsetHigh = static_cast<DWORD>(offset >> 32);
+		DWORD n = 0;
+		if (!ReadFile(h, data, static_cast<DWORD>(count), &n, &ov) && GetLastError() != ERROR_HANDLE_EOF)
+			return -1;
+		return n;
+	}
+
+	static int64_t pwriteNative(NativeHandle h, const char* data, size_t count, int64_t offset) {
+		OVERLAPPED ov = {};
+		ov.Offset = static_cast<DWORD>(offset);
+		ov.OffsetHigh = static_cast<DWORD>(offset >> 32);
+		DWORD n = 0;
+		if (!WriteFile(h, data, static_cast<DWORD>(count), &n, &ov))
+			return -1;
+		return n;
+	}
+
+	static bool preallocateNative(NativeHandle h, int64_t size) {
+		FILE_ALLOCATION_INFO info;
+		info.AllocationSize.QuadPart = size;
+		return SetFileInformationByHandle(h, FileAllocationInfo, &info, sizeof(info)) != 0;
+	}
+
+	static bool truncateNative(NativeHandle h, int64_t size) {
+		FILE_END_OF_FILE_INFO info;
+		info.EndOfFile.QuadPart = size;
+		return SetFileInformationByHandle(h, FileEndOfFileInfo, &info, sizeof(info)) != 0;
+	}
+
+#else
+
+	static NativeHandle openNative(const std::string& path, OpenMode mode, bool direct) {
+		int flags = (mode == asyncio_write) ? (O_RDWR | (direct ? 0 : (O_CREAT | O_TRUNC))) : O_RDONLY;
+		if (direct) {
+
+#if defined(O_DIRECT)
+			flags |= O_DIRECT;
+#elif !defined(__APPLE__)
+			return invalidHandle(); // (not supported)
+#endif
+
+		}
+		int fd = open(path.c_str(), flags, 0644);
+
+#if defined(__APPLE__)
+		if (fd != -1 && direct && fcntl(fd, F_NOCACHE, 1) == -1) {
+			::close(fd);
+			fd = -1;
+		}
+#endif
+
+		return fd;
+	}
+
+	static void closeNative(NativeHandle& h) {
+		if (h != invalidHandle())
+			::close(h);
+		h = invalidHandle();
+	}
+
+	static int64_t getNativeLength(NativeHandle h) {
+		struct stat st;
+		return (fstat(h, &st) == 0) ? static_cast<int64_t>(st.st_size) : 0;
+	}
+
+	static int64_t preadNative(NativeHandle h, char* data, size_t count, int64_t offset) {
+		size_t done = 0;
+		while (done < count) {
+			ssize_t n = pread(h, data + done, count - done, static_cast<off_t>(offset + done));
+			if (n < 0 && errno == EINTR)
+				continue;
+			if (n < 0)
+				return -1;
+			if (n == 0)
+				break; // end of file
+			done += static_cast<size_t>(n);
+		}
+		return static_cast<int64_t>(done);
+	}
+
+	static int64_t pwriteNative(NativeHandle h, const char* data, size_t count, int64_t offset) {
+		size_t done = 0;
+		while (done < count) {
+			ssize_t n = pwrite(h, data + done, count - done, static_cast<off_t>(offset + done));
+			if (n < 0 && errno == EINTR)
+				continue;
+			if (n <= 0)
+				return -1;
+			done += static_cast<size_t>(n);
+		}
+		return static_cast<int64_t>(done);
+	}
+
+	static bool preallocateNative(NativeHandle h, int64_t size) {
+
+#if defined(__linux__)
+		return fallocate(h, 0, 0, static_cast<off_t>(size)) == 0; // (not posix_fallocate(), which falls back to writing zeros)
+#elif defined(__APPLE__)
+		fstore_t store = { F_ALLOCATEALL, F_PEOFPOSMODE, 0, static_cast<off_t>(size), 0 };
+		return fcntl(h, F_PREALLOCATE, &store) != -1;
+#else
+		return false;
+#endif
+
+	}
+
+	static bool truncateNative(NativeHandle h, int64_t size) {
+		return ftruncate(h, static_cast<off_t>(size)) == 0;
+	}
+
+#endif
+
+};
+
+// struct AsyncFileOwner : holds the AsyncFile used by an AsyncSndfileHandle
+// (a base class, so that the AsyncFile is opened before, and closed after, the SndfileHandle)
+
+struct AsyncFileOwner {
+	std::unique_ptr<AsyncFile> asyncFile;
+
+	AsyncFileOwner(const std::string& path, AsyncFile::OpenMode mode, const IOOptions& io) {
+		if (io.async) {
+			asyncFile.reset(new AsyncFile(path, mode, io));
+			if (!asyncFile->isOpen())
+				asyncFile.reset(); // (let libsndfile open the file, and report the problem)
+		}
+	}
+};
+
+// class AsyncSndfileHandle : a SndfileHandle which does its I/O through an AsyncFile when io.async is set (or directly, if not)
+
+class AsyncSndfileHandle : private AsyncFileOwner, public SndfileHandle
+{
+public:
+	// open for reading:
+	AsyncSndfileHandle(const std::string& path, const IOOptions& io) :
+		AsyncFileOwner(path, AsyncFile::asyncio_read, io),
+		SndfileHandle(asyncFile ? SndfileHandle(AsyncFile::getVirtualIO(), asyncFile.get(), SFM_READ) : SndfileHandle(path))
+	{}
+
+	// open for writing:
+	AsyncSndfileHandle(const std::string& path, int format, int channels, int samplerate, const IOOptions& io) :
+		AsyncFileOwner(path, AsyncFile::asyncio_write, io),
+		SndfileHandle(asyncFile ? SndfileHandle(AsyncFile::getVirtualIO(), asyncFile.get(), SFM_WRITE, format, channels, samplerate) : SndfileHandle(path, SFM_WRITE, format, channels, samplerate))
+	{}
+
+	bool isAsync() const {
+		return asyncFile != nullptr;
+	}
+
+	bool isDirect() const {
+		return asyncFile != nullptr && asyncFile->isDirect();
+	}
+
+	// close() : close the file, and wait for any writes still in flight. Returns false if any I/O has failed
+	bool close() {
+		static_cast<SndfileHandle&>(*this) = SndfileHandle(); // (releasing the handle closes it)
+		return asyncFile == nullptr || asyncFile->flush();
+	}
+};
+
+// class AsyncFileBuf : an input std::streambuf which reads through an AsyncFile (for the DSD file readers)
+
+class AsyncFileBuf : public std::streambuf
+{
+public:
+	AsyncFileBuf(const std::string& path, const IOOptions& io) : file(path, AsyncFile::asyncio_read, io), buffer(65536) {}
+
+	bool isOpen() const {
+		return file.isOpen();
+	}
+
+protected:
+	int_type underflow() override {
+		if (gptr() < egptr())
+			return traits_type::to_int_type(*gptr());
+		int64_t n = file.read(buffer.data(), static_cast<int64_t>(buffer.size()));
+		if (n <= 0)
+			return traits_type::eof();
+		setg(buffer.data(), buffer.data(), buffer.data() + n);
+		return traits_type::to_int_type(*gptr());
+	}
+
+	std::streamsize xsgetn(char* s, std::streamsize count) override {
+		// (large reads go straight to the AsyncFile, after using up what's left in the buffer)
+		std::streamsize n = std::min<std::streamsize>(count, egptr() - gptr());
+		memcpy(s, gptr(), static_cast<size_t>(n));
+		gbump(static_cast<int>(n));
+		if (n < count)
+			n += static_cast<std::streamsize>(file.read(s + n, count - n));
+		return n;
+	}
+
+	pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which) override {
+		int64_t current = file.tell() - (egptr() - gptr());
+		int64_t target = (dir == std::ios_base::beg) ? off : (dir == std::ios_base::cur) ? current + off : file.getLength() + off;
+		return seekpos(target, which);
+	}
+
+	pos_type seekpos(pos_type pos, std::ios_base::openmode which) override {
+		if (!(which & std::ios_base::in) || pos < 0)
+			return pos_type(off_type(-1));
+		setg(buffer.data(), buffer.data(), buffer.data()); // (empty)
+		return file.seek(static_cast<int64_t>(pos), SEEK_SET);
+	}
+
+private:
+	AsyncFile file;
+	std::vector<char> buffer;
+};
+
+// openInputStreamBuf() : opens a file for reading through a std::streambuf, using an AsyncFile if io.async is set. Returns nullptr if the file can't be opened.
+
+inline std::unique_ptr<std::streambuf> openInputStreamBuf(const std::string& path, const IOOptions& io) {
+	if (io.async) {
+		std::unique_ptr<AsyncFileBuf> asyncBuf(new AsyncFileBuf(path, io));
+		if (asyncBuf->isOpen())
+			return std::move(asyncBuf);
+	}
+	std::unique_ptr<std::filebuf> fileBuf(new std::filebuf);
+	if (fileBuf->open(path, std::ios::in | std::ios::binary) == nullptr)
+		return nullptr;
+	return std::move(fileBuf);
+}
+
+#endif // ASYNCIO_H
@@ -0,0 +1,191 @@
+/*
+* Copyright (C) 2016 - 2019 Judd Niemann - All Rights Reserved.
+* You may use, distribute and modify this code under the
+* terms of the GNU Lesser General Public License, version 2.1
+*
+* You should have received a copy of GNU Lesser General Public License v2.1
+* with this file. If not, please refer to: https://github.com/jniemann66/ReSampler
+*/
+
+// cacheinfo.h : detection of CPU data cache sizes (used for choosing the conversion block size automatically)
+// Linux / Android: read from sysfs (/sys/devices/system/cpu/cpu0/cache)
+// macOS: read from sysctl (hw.l1dcachesize etc)
+// Windows: read from GetLogicalProcessorInformation()
+// Any size which can't be determined is reported as 0.
+
+#ifndef CACHEINFO_H
+#define CACHEINFO_H 1
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#if defined(_WIN32) || defined(_WIN64)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Windows.h>
+#elif defined(__APPLE__)
+#include <sys/types.h>
+#include <sys/sysctl.h>
+#endif
+
+struct CacheLevel {
+	size_t size = 0;		// bytes (0 = unknown)
+	int sharedBy = 1;		// number of logical CPUs sharing this cache
+};
+
+struct CacheInfo {
+	CacheLevel l1d;
+	CacheLevel l2;
+	CacheLevel l3;
+
+	// get() : detect cache sizes (once) and return them
+	static const CacheInfo& get() {
+		static const CacheInfo cacheInfo = detect();
+		return cacheInfo;
+	}
+
+	void print(std::ostream& os) const {
+		os << "L1d: " << describe(l1d) << ", L2: " << describe(l2) << ", L3: " << describe(l3);
+	}
+
+private:
+	static std::string describe(const CacheLevel& c) {
+		if (c.size == 0)
+			return "unknown";
+		std::string s = std::to_string(c.size / 1024) + " kB";
+		if (c.sharedBy > 1)
+			s += " (shared by " + std::to_string(c.sharedBy) + " CPUs)";
+		return s;
+	}
+
+	static CacheInfo detect() {
+		CacheInfo info;
+
+#if defined(_WIN32) || defined(_WIN64)
+		DWORD bufferSize = 0;
+		GetLogicalProcessorInformation(nullptr, &bufferSize);
+		std::vector<SYSTEM_LOGICAL_PROCESSOR_INFORMATION> buffer(bufferSize / sizeof(SYSTEM_LOGICAL_PROCESSOR_INFORMATION));
+		if (!buffer.empty() && GetLogicalProcessorInformation(buffer.data(), &bufferSize)) {
+			for (auto& item : buffer) {
+				if (item.Relationship != RelationCache || item.Cache.Type == CacheInstruction)
+					continue;
+				CacheLevel c;
+				c.size = item.Cache.Size;
+				c.sharedBy = 0;
+				for (ULONG_PTR mask = item.ProcessorMask; mask != 0; mask >>= 1) {
+					c.sharedBy += static_cast<int>(mask & 1);
+				}
+				c.sharedBy = std::max(1, c.sharedBy);
+				info.setLevel(item.Cache.Level, c);
+			}
+		}
+
+#elif defined(__APPLE__)
+		const char* names[] = { "hw.l1dcachesize", "hw.l2cachesize", "hw.l3cachesize" };
+		for (int level = 1; level <= 3; level++) {
+			int64_t value = 0;
+			size_t length = sizeof(value);
+			if (sysctlbyname(names[level - 1], &value, &length, nullptr, 0) == 0 && value > 0) {
+				CacheLevel c;
+				c.size = static_cast<size_t>(value);
+				info.setLevel(level, c);
+			}
+		}
+
+#else // sysfs
+		for (int index = 0; ; index++) {
+			std::string path = "/sys/devices/system/cpu/cpu0/cache/index" + std::to_string(index) + "/";
+			std::ifstream levelFile(path + "level");
+			if (!levelFile.is_open())
+				break;
+			int level = 0;
+			std::string type;
+			std::string size;
+			std::string sharedCpuList;
+			levelFile >> level;
+			std::ifstream(path + "type") >> type;
+			std::ifstream(path + "size") >> size;
+			std::ifstream(path + "shared_cpu_list") >> sharedCpuList;
+			if (type == "Instruction")
+				continue;
+			CacheLevel c;
+			c.size = parseSize(size);
+			c.sharedBy = std::max(1, countCpus(sharedCpuList));
+			info.setLevel(level, c);
+		}
+#endif
+
+		return info;
+	}
+
+	void setLevel(int level, const CacheLevel& c) {
+		switch (level) {
+		case 1:
+			l1d = c;
+			break;
+		case 2:
+			l2 = c;
+			break;
+		case 3:
+			l3 = c;
+			break;
+		default:
+			break;
+		}
+	}
+
+	// parseSize() : convert sysfs size string (eg "48K", "2048K", "32M") to bytes
+	static size_t parseSize(const std::string& s) {
+		size_t value = 0;
+		size_t pos = 0;
+		while (pos < s.size() && s[pos] >= '0' && s[pos] <= '9') {
+			value = value * 10 + (s[pos++] - '0');
+		}
+		if (pos < s.size()) {
+			switch (s[pos]) {
+			case 'K':
+				value *= 1024;
+				break;
+			case 'M':
+				value *= 1024 * 1024;
+				break;
+			case 'G':
+				value *= 1024 * 1024 * 1024;
+				break;
+			}
+		}
+		return value;
+	}
+
+	// countCpus() : count the CPUs in a sysfs cpu list (eg "0-3,8-11" => 8)
+	static int countCpus(const std::string& list) {
+		int count = 0;
+		std::istringstream ss(list);
+		std::string range;
+		while (std::getline(ss, range, ',')) {
+			auto dash = range.find('-');
+			try {
+				if (dash == std::string::npos) {
+					std::stoi(range);
+					count++;
+				}
+				else {
+					count += std::stoi(range.substr(dash + 1)) - std::stoi(range.substr(0, dash)) + 1;
+				}
+			}
+			catch (std::exception&) {
+				// ignore malformed entries
+			}
+		}
+		return count;
+	}
+};
+
+#endif // CACHEINFO_H
@@ -16,10 +16,12 @@
 
 #include "ditherer.h"
 #include "csv.h"
+#include "affinity.h"
 
 #include <iostream>
 #include <vector>
 #include <string>
+#include <sstream>
 #include <algorithm>
 #include <stdexcept>
 
@@ -30,6 +32,15 @@ typedef enum {
 	custom
 } LPFMode;
 
+// quality / speed presets (--quality):
+typedef enum {
+	qualityDraft,		// 100 dB stopband, relaxed LPF: quick previews
+	qualityStandard,	// 120 dB stopband: 16- and 20-bit deliverables
+	qualityHigh,		// (default) 195 dB stopband for integer ratios, 160 dB otherwise
+	qualityMastering,	// 195 dB stopband for all ratios, steep LPF, double precision
+	qualityAuto			// stopband chosen from the resolution of the output format and the dither settings
+} QualityPreset;
+
 // The following functions are used for fetching commandline parameters:
 
 // sanitize() : function to allow more permissive parsing.
@@ -100,6 +111,29 @@ bool getCmdlineParam(char** begin, char** end, const std::string& option)
 	return found;
 }
 
+// parseTime() : convert a time given as seconds (eg 90.5) or [hh:]mm:ss[.sss] (eg 1:30.5) to seconds.
+// Returns false if not a valid time.
+inline bool parseTime(const std::string& str, double& seconds) {
+	if (str.empty() || str.find_first_not_of("0123456789:.") != std::string::npos)
+		return false;
+	double t = 0.0;
+	std::string field;
+	std::istringstream ss(str);
+	int numFields = 0;
+	while (std::getline(ss, field, ':')) {
+		if (field.empty() || ++numFields > 3)
+			return false;
+		try {
+			t = 60.0 * t + std::stod(field);
+		}
+		catch (std::exception&) {
+			return false;
+		}
+	}
+	seconds = t;
+	return true;
+}
+
 // struct ConversionInfo : structure for holding all the parameters required for a conversion job
 
 struct ConversionInfo
@@ -111,6 +145,7 @@ struct ConversionInfo
 	double gain;
 	double limit;
 	bool bUseDoublePrecision;
+	bool bExtendedPrecision;
 	bool bNormalize;
 	double normalizeAmount;
 	int outputFormat;
@@ -127,6 +162,8 @@ struct ConversionInfo
 	double vorbisQuality;
 	bool disableClippingProtection;
 	LPFMode lpfMode;
+	QualityPreset quality;
+	double stopbandAttenuation;	// stopband attenuation of filters (dB; 0 = according to conversion ratio)
 	double lpfCutoff;
 	double lpfTransitionWidth;
 	bool bUseSeed;
@@ -136,6 +173,7 @@ struct ConversionInfo
 	bool csvOutput;
 	bool bEnablePeakDetection;
 	bool bMultiThreaded;
+	bool bVectoriseChannels;	// convert the channels together, in the lanes of SIMD vectors (see mcconvert.h)
 	bool bRf64;
 	bool bNoPeakChunk;
 	bool bWriteMetaData;
@@ -143,6 +181,30 @@ struct ConversionInfo
 	bool bSingleStage;
 	bool bMultiStage;
 	bool bShowStages;
+	bool bSpecialisedKernels;	// use the conversion kernels specialised for common stage ratios (see SPECIALISED_STAGE_RATIOS)
+	bool bSilenceFastPath;		// convert blocks of digital silence without filtering, where possible
+	bool bShowTimings;
+	bool bProfile;
+	std::string profileFilename;
+	std::string metricsDestination;	// where to report live metrics: fd:N, a JSON lines file, or a Prometheus textfile (.prom)
+	double metricsInterval;			// time between metrics snapshots (seconds)
+	std::string fftWisdomFilename;
+	std::string fftPlanner;
+	int blockSize;
+	bool bAutoBlockSize;
+	bool bLowLatency;
+	bool bRealtimeTest;
+	std::string affinity;
+	double startTime;	// start of range to be converted (seconds)
+	double endTime;		// end of range to be converted (seconds; 0 = end of file)
+	int segment;		// segment to be converted (1 .. numSegments; 0 = whole file)
+	int numSegments;
+	bool bStitch;		// stitch segments together into output file
+	bool bAsyncIO;
+	bool bDirectIO;
+	int ioDepth;		// number of I/O requests in flight (--asyncIO)
+	bool bMmap;			// read input file by memory-mapping it
+	bool bNativeWriter;	// write uncompressed output files with PcmFileWriter
 	int overSamplingFactor;
 	bool bBadParams;
 	std::string appName;
@@ -176,6 +238,9 @@ inline std::string ConversionInfo::toCmdLineArgs() {
 	if(bUseDoublePrecision)
 		args.emplace_back("--doubleprecision");
 
+	if(bExtendedPrecision)
+		args.emplace_back("--extendedPrecision");
+
 	if(bNormalize) {
 		args.emplace_back("-n");
 		args.push_back(std::to_string(normalizeAmount));
@@ -184,6 +249,11 @@ inline std::string ConversionInfo::toCmdLineArgs() {
 	if(bMinPhase)
 		args.emplace_back("--minphase");
 
+	if (!bAutoBlockSize) {
+		args.emplace_back("--blockSize");
+		args.push_back(std::to_string(blockSize));
+	}
+
 	if (lpfMode == custom) {
 		args.emplace_back("--lpf-cutoff");
 		args.push_back(std::to_string(lpfCutoff));
@@ -191,6 +261,12 @@ inline std::string ConversionInfo::toCmdLineArgs() {
 		args.push_back(std::to_string(lpfTransitionWidth));
 	}
 
+	if (quality != qualityHigh) {
+		static const char* qualityNames[] = { "draft", "standard", "high", "mastering", "auto" };
+		args.emplace_back("--quality");
+		args.emplace_back(qualityNames[quality]);
+	}
+
 	if (maxStages == 1) {
 		args.emplace_back("--maxStages");
 		args.push_back(std::to_string(maxStages));
@@ -220,6 +296,7 @@ inline bool ConversionInfo::fromCmdLineArgs(int argc, char* argv[]) {
 	gain = 1.0;
 	limit = 1.0;
 	bUseDoublePrecision = false;
+	bExtendedPrecision = false;
 	bNormalize = false;
 	normalizeAmount = 1.0;
 	outputFormat = 0;
@@ -238,12 +315,15 @@ inline bool ConversionInfo::fromCmdLineArgs(int argc, char* argv[]) {
 	lpfMode = normal;
 	lpfCutoff = 100.0 * (10.0 / 11.0);
 	lpfTransitionWidth = 100.0 - lpfCutoff;
+	quality = qualityHigh;
+	stopbandAttenuation = 0.0;
 	bUseSeed = false;
 	seed = 0;
 	dsfInput = false;
 	dffInput = false;
 	bEnablePeakDetection = true;
 	bMultiThreaded = false;
+	bVectoriseChannels = false;
 	bRf64 = false;
 	bNoPeakChunk = false;
 	bWriteMetaData = true;
@@ -251,6 +331,30 @@ inline bool ConversionInfo::fromCmdLineArgs(int argc, char* argv[]) {
 	bSingleStage = false;
 	bMultiStage = true;
 	bShowStages = false;
+	bSpecialisedKernels = true;
+	bSilenceFastPath = true;
+	bShowTimings = false;
+	bProfile = false;
+	profileFilename.clear();
+	metricsDestination.clear();
+	metricsInterval = 1.0;
+	fftWisdomFilename.clear();
+	fftPlanner = "estimate";
+	blockSize = BUFFERSIZE;
+	bAutoBlockSize = true;
+	bLowLatency = false;
+	bRealtimeTest = false;
+	affinity.clear();
+	startTime = 0.0;
+	endTime = 0.0;
+	segment = 0;
+	numSegments = 0;
+	bStitch = false;
+	bAsyncIO = false;
+	bDirectIO = false;
+	ioDepth = 4;
+	bMmap = false;
+	bNativeWriter = false;
 	bTmpFile = true;
 	bShowTempFile = false;
 	overSamplingFactor = 1;
@@ -266,6 +370,10 @@ inline bool ConversionInfo::fromCmdLineArgs(int argc, char* argv[]) {
 	// get extended parameters
 	getCmdlineParam(argv, argv + argc, "--gain", gain);
 	bUseDoublePrecision = getCmdlineParam(argv, argv + argc, "--doubleprecision");
+	bExtendedPrecision = getCmdlineParam(argv, argv + argc, "--extendedPrecision");
+	if (bExtendedPrecision) { // extended precision implies double precision
+		bUseDoublePrecision = true;
+	}
 	disableClippingProtection = getCmdlineParam(argv, argv + argc, "--noClippingProtection");
 	bNormalize = getCmdlineParam(argv, argv + argc, "-n", normalizeAmount);
 	bDither = getCmdlineParam(argv, argv + argc, "--dither", ditherAmount);
@@ -279,6 +387,7 @@ inline bool ConversionInfo::fromCmdLineArgs(int argc, char* argv[]) {
 	bSetFlacCompression = getCmdlineParam(argv, argv + argc, "--flacCompression", flacCompressionLevel);
 	bSetVorbisQuality = getCmdlineParam(argv, argv + argc, "--vorbisQuality", vorbisQuality);
 	bMultiThreaded = getCmdlineParam(argv, argv + argc, "--mt");
+	bVectoriseChannels = getCmdlineParam(argv, argv + argc, "--vectoriseChannels");
 	bRf64 = getCmdlineParam(argv, argv + argc, "--rf64");
 	bNoPeakChunk = getCmdlineParam(argv, argv + argc, "--noPeakChunk");
 	bWriteMetaData = !getCmdlineParam(argv, argv + argc, "--noMetadata");
@@ -310,6 +419,46 @@ inline bool ConversionInfo::fromCmdLineArgs(int argc, char* argv[]) {
 		bSingleStage = false;
 
 	bShowStages = getCmdlineParam(argv, argv + argc, "--showStages");
+	bSpecialisedKernels = !getCmdlineParam(argv, argv + argc, "--noSpecialisedKernels");
+	bSilenceFastPath = !getCmdlineParam(argv, argv + argc, "--noSilenceFastPath");
+	bShowTimings = getCmdlineParam(argv, argv + argc, "--showTimings");
+	bProfile = getCmdlineParam(argv, argv + argc, "--profile", profileFilename);
+	if (!profileFilename.empty() && profileFilename[0] == '-') { // next arg is another option, not a filename
+		profileFilename.clear();
+	}
+	bool bBadMetrics = getCmdlineParam(argv, argv + argc, "--metrics", metricsDestination) && (metricsDestination.empty() || metricsDestination[0] == '-');
+	getCmdlineParam(argv, argv + argc, "--metricsInterval", metricsInterval);
+	getCmdlineParam(argv, argv + argc, "--fftWisdom", fftWisdomFilename);
+	getCmdlineParam(argv, argv + argc, "--fftPlanner", fftPlanner);
+	bAutoBlockSize = !getCmdlineParam(argv, argv + argc, "--blockSize", blockSize);
+	bLowLatency = getCmdlineParam(argv, argv + argc, "--lowLatency");
+	bRealtimeTest = getCmdlineParam(argv, argv + argc, "--realtimeTest");
+	if (getCmdlineParam(argv, argv + argc, "--affinity", affinity) && (affinity.empty() || affinity[0] == '-')) {
+		affinity = "compact"; // no policy given
+	}
+	std::string strStart;
+	std::string strEnd;
+	bool bBadTime = (getCmdlineParam(argv, argv + argc, "--start", strStart) && !parseTime(strStart, startTime)) ||
+		(getCmdlineParam(argv, argv + argc, "--end", strEnd) && !parseTime(strEnd, endTime));
+	getCmdlineParam(argv, argv + argc, "--segment", segment);
+	getCmdlineParam(argv, argv + argc, "--segments", numSegments);
+	bStitch = getCmdlineParam(argv, argv + argc, "--stitch");
+	bDirectIO = getCmdlineParam(argv, argv + argc, "--directIO");
+	bAsyncIO = getCmdlineParam(argv, argv + argc, "--asyncIO") || bDirectIO;
+	getCmdlineParam(argv, argv + argc, "--ioDepth", ioDepth);
+	bMmap = getCmdlineParam(argv, argv + argc, "--mmap");
+	bNativeWriter = getCmdlineParam(argv, argv + argc, "--nativeWriter");
+	if (segment > 0 || bStitch) { // segments are written (and read back when stitching) in the same way as the temp file
+		bTmpFile = true;
+	}
+	if (bRealtimeTest) { // no input file: input rate is specified on the command line
+		inputSampleRate = 44100;
+		getCmdlineParam(argv, argv + argc, "--inputRate", inputSampleRate);
+		if (bAutoBlockSize) {
+			blockSize = REALTIME_BLOCKSIZE;
+			bAutoBlockSize = false;
+		}
+	}
 
 	// LPFilter settings:
 	if (getCmdlineParam(argv, argv + argc, "--relaxedLPF")) {
@@ -331,6 +480,54 @@ inline bool ConversionInfo::fromCmdLineArgs(int argc, char* argv[]) {
 		}
 	}
 
+	if (bLowLatency) { // minimum-phase, with a shorter (relaxed) filter, unless another filter has been requested
+		bMinPhase = true;
+		if (lpfMode == normal) {
+			lpfMode = relaxed;
+			lpfCutoff = 100.0 * (21.0 / 22.0);
+			lpfTransitionWidth = 2 * (100.0 - lpfCutoff);
+		}
+	}
+
+	// quality presets (a preset's choice of LPF only applies if no other filter has been requested):
+	std::string strQuality;
+	bool bBadQuality = false;
+	if (getCmdlineParam(argv, argv + argc, "--quality", strQuality)) {
+		std::transform(strQuality.begin(), strQuality.end(), strQuality.begin(), ::tolower);
+		if (strQuality == "draft") {
+			quality = qualityDraft;
+			stopbandAttenuation = 100.0;
+			if (lpfMode == normal) {
+				lpfMode = relaxed;
+				lpfCutoff = 100.0 * (21.0 / 22.0);
+				lpfTransitionWidth = 2 * (100.0 - lpfCutoff);
+			}
+		}
+		else if (strQuality == "standard") {
+			quality = qualityStandard;
+			stopbandAttenuation = 120.0;
+		}
+		else if (strQuality == "high") {
+			quality = qualityHigh;
+		}
+		else if (strQuality == "mastering") {
+			quality = qualityMastering;
+			stopbandAttenuation = 195.0;
+			bUseDoublePrecision = true;
+			if (lpfMode == normal) {
+				lpfMode = steep;
+				lpfCutoff = 100.0 * (21.0 / 22.0);
+				lpfTransitionWidth = 100.0 - lpfCutoff;
+			}
+		}
+		else if (strQuality == "auto") {
+			quality = qualityAuto; // (stopband attenuation is set once the output format is known)
+		}
+		else {
+			bBadQuality = true;
+		}
+	}
+
 	double qb = 0.0;
 	quantize = getCmdlineParam(argv, argv + argc, "--quantize-bits", qb);
 	quantizeBits = static_cast<int>(std::floor(qb));
@@ -348,6 +545,9 @@ inline bool ConversionInfo::fromCmdLineArgs(int argc, char* argv[]) {
 	constrainInt(flacCompressionLevel, 0, 8);
 	constrainDouble(vorbisQuality, -1, 10);
 	constrainInt(maxStages, 1, 10);
+	constrainInt(blockSize, 1, 1048576);
+	constrainInt(ioDepth, 1, 64);
+	constrainDouble(metricsInterval, 0.05, 3600.0);
 	constrainDouble(lpfCutoff, 1.0, 99.9);
 	constrainDouble(lpfTransitionWidth, 0.1, 400.0);
 
@@ -371,7 +571,10 @@ inline bool ConversionInfo::fromCmdLineArgs(int argc, char* argv[]) {
 
 	// test for bad parameters:
 	bBadParams = false;
-	if (outputFilename.empty()) {
+	if (bRealtimeTest) {
+		// (no files involved)
+	}
+	else if (outputFilename.empty()) {
 		if (inputFilename.empty()) {
 			std::cout << "Error: Input filename not specified" << std::endl;
 			bBadParams = true;
@@ -395,11 +598,62 @@ inline bool ConversionInfo::fromCmdLineArgs(int argc, char* argv[]) {
 		bBadParams = true;
 	}
 
+	if (fftPlanner != "estimate" && fftPlanner != "measure" && fftPlanner != "patient" && fftPlanner != "exhaustive") {
+		std::cout << "Error: --fftPlanner must be one of: estimate, measure, patient, exhaustive" << std::endl;
+		bBadParams = true;
+	}
+
+	if (!affinity.empty() && !CpuAffinity::isValidPolicy(affinity)) {
+		std::cout << "Error: --affinity must be compact, scatter, or a list of CPUs (eg 0,2,4-7)" << std::endl;
+		bBadParams = true;
+	}
+
+	if (bBadQuality) {
+		std::cout << "Error: --quality must be one of: draft, standard, high, mastering, auto" << std::endl;
+		bBadParams = true;
+	}
+
+	if (bBadMetrics) {
+		std::cout << "Error: --metrics requires a destination (fd:N, or a filename)" << std::endl;
+		bBadParams = true;
+	}
+
+	if (bBadTime) {
+		std::cout << "Error: --start and --end must be given in seconds (eg 90.5), or as [hh:]mm:ss[.sss] (eg 1:30.5)" << std::endl;
+		bBadParams = true;
+	}
+	else if (endTime > 0.0 && endTime <= startTime) {
+		std::cout << "Error: --end must be later than --start" << std::endl;
+		bBadParams = true;
+	}
+
+	if ((segment != 0 || bStitch) && numSegments < 1) {
+		std::cout << "Error: --segment and --stitch require --segments <number of segments>" << std::endl;
+		bBadParams = true;
+	}
+	else if (segment < 0 || segment > numSegments || (numSegments > 0 && segment == 0 && !bStitch)) {
+		std::cout << "Error: --segment must be from 1 to the number of segments" << std::endl;
+		bBadParams = true;
+	}
+	else if (segment > 0 && bStitch) {
+		std::cout << "Error: --segment and --stitch cannot be used together" << std::endl;
+		bBadParams = true;
+	}
+	else if ((segment > 0 || bStitch) && (startTime > 0.0 || endTime > 0.0)) {
+		std::cout << "Error: --segment and --stitch cannot be used with --start or --end" << std::endl;
+		bBadParams = true;
+	}
+
 	if (outputSampleRate == 0) {
 		std::cout << "Error: Target sample rate not specified" << std::endl;
 		bBadParams = true;
 	}
 
+	if (bRealtimeTest && inputSampleRate <= 0) {
+		std::cout << "Error: --inputRate must be greater than zero" << std::endl;
+		bBadParams = true;
+	}
+
 	if (bBadParams) {
 		std::cout << strUsage << std::endl;
 		return false;
@@ -9,6 +9,9 @@
 
 // csv.h : defines module for exporting audio data as a csv file
 
+// Values are rendered directly into a byte buffer (without iostreams), with large blocks
+// split across a thread pool, and then written to the file with a single write per block.
+
 #ifndef RESAMPLER_CSV_H
 #define RESAMPLER_CSV_H
 
@@ -18,8 +21,15 @@
 #include <string>
 #include <fstream>
 #include <cmath>
-#include <string>
+#include <cstdio>
+#include <cstring>
+#include <future>
+#include <memory>
+#include <thread>
 #include <vector>
+#include <algorithm>
+
+#include "ctpl/ctpl_stl.h"
 
 enum CsvOpenMode {
     csv_read,
@@ -53,7 +63,7 @@ enum IntegerWriteScalingStyle {
 class CsvFile {
 public:
     CsvFile(const std::string& path, CsvOpenMode mode = csv_write) : path(path), mode(mode), numChannels(2), numericFormat(Integer), signedness(Signed), numericBase(Decimal), numBits(16), precision(10), integerWriteScalingStyle(Pow2Minus1),
-        intMaxAmplitude(32767), unsignedOffset(0)
+        intMaxAmplitude(32767), unsignedOffset(0), bMultiThreaded(false)
     {
 
 		file.exceptions(std::ifstream::failbit | std::ifstream::badbit);
@@ -98,29 +108,66 @@ public:
 
     template <typename T>
     int64_t write(const T* buffer, int64_t count) {
-        if(err) {
+        if(err || count <= 0) {
             return 0;
         }
-        int64_t i;
-        for(i = 0; i < count; i++) {
-            switch(numericFormat) {
-                case CsvNumericFormat::FloatingPoint:
-                    file << buffer[i];
-                    break;
-
-                default:
-                    file << scaleToInt<int>(buffer[i]);
-                    break;
+
+        // each chunk of values is formatted into its own region of formatBuffer, which is large enough for the longest possible values
+        const size_t maxLength = maxFormattedLength();
+        const int64_t numChunks = (count + chunkSize - 1) / chunkSize;
+        if(formatBuffer.size() < static_cast<size_t>(count) * maxLength) {
+            formatBuffer.resize(static_cast<size_t>(count) * maxLength);
+        }
+        std::vector<size_t> chunkLengths(numChunks);
+
+        auto formatChunk = [this, buffer, count, maxLength, &chunkLengths](int64_t c) {
+            int64_t first = c * chunkSize;
+            int64_t last = std::min(count, first + chunkSize);
+            char* start = formatBuffer.data() + first * maxLength;
+            char* p = start;
+            int channel = static_cast<int>((currentChannel + first) % numChannels);
+            for(int64_t i = first; i < last; i++) {
+                p = formatValue(p, buffer[i]);
+                if(++channel < numChannels) {
+                    *p++ = ',';
+                } else {
+                    *p++ = '\r';
+                    *p++ = '\n';
+                    channel = 0;
+                }
             }
+            chunkLengths[c] = static_cast<size_t>(p - start);
+        };
 
-            if(++currentChannel < numChannels) {
-                file << ",";
-            } else {
-                file  << "\r\n";
-                currentChannel = 0;
+        if(numChunks == 1 || !bMultiThreaded) {
+            for(int64_t c = 0; c < numChunks; c++) {
+                formatChunk(c);
+            }
+        } else {
+            if(!threadPool) {
+                threadPool.reset(new ctpl::thread_pool(std::max(1, static_cast<int>(std::thread::hardware_concurrency()))));
+            }
+            std::vector<std::future<void>> results(numChunks);
+            for(int64_t c = 0; c < numChunks; c++) {
+                results[c] = threadPool->push([&formatChunk, c](int) {
+                    formatChunk(c);
+                });
+            }
+            for(auto& r : results) {
+                r.get();
             }
         }
-        return i;
+
+        // close the gaps between chunks, and write everything in one go:
+        size_t length = chunkLengths[0];
+        for(int64_t c = 1; c < numChunks; c++) {
+            memmove(formatBuffer.data() + length, formatBuffer.data() + c * chunkSize * maxLength, chunkLengths[c]);
+            length += chunkLengths[c];
+        }
+        file.write(formatBuffer.data(), static_cast<std::streamsize>(length));
+
+        currentChannel = static_cast<int>((currentChannel + count) % numChannels);
+        return count;
     }
 
 private:
@@ -139,43 +186,73 @@ private:
     bool err;
 	int intMaxAmplitude;
 	int unsignedOffset;
+	std::vector<char> formatBuffer;
+	bool bMultiThreaded; // format chunks concurrently
+	std::unique_ptr<ctpl::thread_pool> threadPool;
+	static const int64_t chunkSize = 16384; // number of values formatted per task
 
 	template <typename IntType, typename FloatType>
 	IntType scaleToInt(FloatType x) {
 		return unsignedOffset + std::min(std::max(-intMaxAmplitude, static_cast<IntType>(std::round(scaleFactor * x))), intMaxAmplitude - 1);
 	}
 
-	void setStreamFormat() {
-	    if(file.is_open()) {
-			file.unsetf(std::ios_base::floatfield);
-	        if(numericFormat == FloatingPoint) {
-	            file << std::setprecision(precision);
-	        } else if (numericFormat == Integer) {
-	            file.setf(std::ios_base::fixed);
-	            file << std::setprecision(0);
-			}
-			else if (numericFormat == Fixed) {
-				file.setf(std::ios_base::fixed);
-				file << std::setprecision(precision);
-			}
-			else if (numericFormat == Scientific) {
-				file.setf(std::ios_base::scientific, std::ios_base::floatfield);
-				file << std::setprecision(precision);
-			}
+	// maxFormattedLength() : upper bound on number of characters used by one value (including separator)
+	size_t maxFormattedLength() const {
+		return (numericFormat == FloatingPoint) ? static_cast<size_t>(std::max(precision, 1)) + 32 : 16;
+	}
+
+	// formatValue() : render a value at p, and return pointer to end.
+	// Note: only FloatingPoint format writes floating-point values; all other formats write scaled integers
+	template <typename T>
+	char* formatValue(char* p, T x) {
+		if(numericFormat == FloatingPoint) {
+			return formatFloat(p, static_cast<double>(x));
+		}
+		return formatInt(p, scaleToInt<int>(x));
+	}
 
-			if (numericBase == Hexadecimal) {
-				file.setf(std::ios_base::hex, std::ios_base::basefield);
-				file.setf(std::ios_base::showbase);
+	// formatFloat() : general format with 'precision' significant digits (same as std::ostream with default floatfield)
+	char* formatFloat(char* p, double x) const {
+		int n = snprintf(p, maxFormattedLength(), "%.*g", precision, x);
+		return p + n;
+	}
+
+	// formatInt() : decimal (signed), or octal / hexadecimal (two's complement, with base prefix on non-zero values)
+	char* formatInt(char* p, int x) const {
+		switch(numericBase) {
+		case Hexadecimal:
+			if(x != 0) {
+				*p++ = '0';
+				*p++ = 'x';
 			}
-			else if (numericBase == Octal) {
-				file.setf(std::ios_base::oct, std::ios_base::basefield);
-                file.setf(std::ios_base::showbase);
+			return formatUnsigned<16>(p, static_cast<unsigned int>(x));
+		case Octal:
+			if(x != 0) {
+				*p++ = '0';
 			}
-			else {
-				file.setf(std::ios_base::dec, std::ios_base::basefield);
+			return formatUnsigned<8>(p, static_cast<unsigned int>(x));
+		default:
+			if(x < 0) {
+				*p++ = '-';
+				return formatUnsigned<10>(p, 0u - static_cast<unsigned int>(x));
 			}
+			return formatUnsigned<10>(p, static_cast<unsigned int>(x));
+		}
+	}
 
-	    }
+	template <unsigned int base>
+	static char* formatUnsigned(char* p, unsigned int x) {
+		static const char digits[] = "0123456789abcdef";
+		char tmp[16];
+		char* t = tmp;
+		do {
+			*t++ = digits[x % base];
+			x /= base;
+		} while(x != 0);
+		while(t != tmp) {
+			*p++ = *--t;
+		}
+		return p;
 	}
 
 public:
@@ -185,7 +262,6 @@ public:
 
     void setNumericFormat(CsvNumericFormat numericFormat) {
         CsvFile::numericFormat = numericFormat;
-        setStreamFormat();
     }
 
     CsvSignedness getSignedness() const {
@@ -194,7 +270,6 @@ public:
 
     void setSignedness(CsvSignedness signedness) {
         CsvFile::signedness = signedness;
-        setStreamFormat();
     }
 
     CsvNumericBase getNumericBase() const {
@@ -203,7 +278,6 @@ public:
 
     void setNumericBase(CsvNumericBase numericBase) {
         CsvFile::numericBase = numericBase;
-        setStreamFormat();
     }
 
     int getNumBits() const {
@@ -221,7 +295,6 @@ public:
 			<< unsignedOffset +  std::min(intMaxAmplitude - 1, static_cast<int>(std::round(scaleFactor * 1.0)))
 			<< std::endl;
         CsvFile::numBits = numBits;
-        setStreamFormat();
     }
 
     int getPrecision() const {
@@ -230,7 +303,6 @@ public:
 
     void setPrecision(int precision) {
         CsvFile::precision = precision;
-        setStreamFormat();
     }
 
     IntegerWriteScalingStyle getIntegerWriteScalingStyle() const {
@@ -249,6 +321,11 @@ public:
         CsvFile::numChannels = numChannels;
     }
 
+    // setMultiThreaded() : format large blocks of values using a pool of threads (one per hardware thread), rather than in the calling thread
+    void setMultiThreaded(bool bMultiThreaded) {
+        CsvFile::bMultiThreaded = bMultiThreaded;
+    }
+
 };
 
 #endif //RESAMPLER_CSV_H
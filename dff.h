@@ -15,10 +15,13 @@
 #include <cstdint>
 #include <string>
 #include <fstream>
+#include <memory>
 
 #include "osspecific.h"
+#include "asyncio.h"
+#include "mmapfile.h"
 
-#define DFF_MAX_CHANNELS 6 
+#define DFF_MAX_CHANNELS 64 // (eg 7th-order ambisonics)
 #define DFF_FORMAT 0x00300000 // note: take care to make sure this doesn't clash with future libsndfile formats (unlikely)
 
 #pragma pack(push, r1, 1)
@@ -131,22 +134,18 @@ class DffFile
 {
 public:
 	// Construction / destruction
-    explicit DffFile(const std::string& path, dffOpenMode mode = dff_read) : path(path), mode(mode)
+    explicit DffFile(const std::string& path, dffOpenMode mode = dff_read, const IOOptions& io = IOOptions()) : path(path), mode(mode)
 	{
-		file.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-
 		switch (mode) {
 		case dff_read:
-			try {
-				file.open(path, std::ios::in | std::ios::binary);
-				err = false;
-			}
-
-			catch (std::ios_base::failure& e) {
-				e.what();
+			fileBuf = openInputStreamBuf(path, io);
+			if (!fileBuf) {
 				err = true;
 				return;
 			}
+			file.rdbuf(fileBuf.get());
+			file.exceptions(std::ifstream::failbit | std::ifstream::badbit);
+			err = false;
 
 			makeTbl();
 			readHeaders();
@@ -156,6 +155,12 @@ public:
 
 			bufferSize = blockSize * numChannels;
 			inputBuffer = new uint8_t[bufferSize];
+			blockData = inputBuffer;
+			if (io.mmap) { // read sound data straight from mapped file
+				map.reset(new MappedFile(path));
+				if (!map->isOpen())
+					map.reset();
+			}
 			totalBytesRead = 0;
 			endOfBlock = bufferSize;
 			bufferIndex = endOfBlock; // empty (zero -> full)
@@ -168,10 +173,10 @@ public:
 		}
     }
 
+	// open for reading (through an AsyncFile, if io.async is set, or from a MappedFile, if io.mmap is set):
+	DffFile(const std::string& path, const IOOptions& io) : DffFile(path, dff_read, io) {}
+
 	~DffFile() {
-		if (file.is_open())
-			file.close();
-		
 		delete[] inputBuffer;	
 	}
 
@@ -227,7 +232,7 @@ public:
 				bufferIndex = 0;
 			}
 
-			buffer[i] = samplTbl[inputBuffer[bufferIndex + currentChannel]][currentBit];
+			buffer[i] = samplTbl[blockData[bufferIndex + currentChannel]][currentBit];
 			++samplesRead;
 
 			// cycle through channels, then bits, then bufferIndex
@@ -257,19 +262,31 @@ public:
 		std::cout << "total samples retrieved: " << totalSamplesRead << std::endl;
 	}
 
+	// seek() : set read position to frame number pos (whence: SEEK_SET only)
 	uint64_t seek(uint64_t pos, int whence) {
 
-		// To-do: allow seeks to positions other than beginning (requires proper calculations)
-		// reset state to initial conditions: 
-		totalBytesRead = 0;
+		// reset state to initial conditions:
 		endOfBlock = bufferSize;
 		bufferIndex = endOfBlock; // empty (zero -> full)
 		currentBit = 0;
 		currentChannel = 0;
 
-		// rewind file pointer
-		file.clear(); // in case of eof
-		file.seekg(startOfData + pos);
+		// seek to the byte containing pos (each group of numChannels bytes holds 8 frames):
+		totalBytesRead = std::min(totalSoundDataBytes, (pos / 8) * numChannels);
+		if (map) {
+			map->willNeed(static_cast<size_t>(startOfData + totalBytesRead), MMAPFILE_WILLNEED_SIZE);
+		}
+		else {
+			file.clear(); // in case of eof
+			file.seekg(startOfData + totalBytesRead);
+		}
+
+		// position within byte:
+		if (pos % 8 != 0) {
+			endOfBlock = readBlocks();
+			bufferIndex = 0;
+			currentBit = static_cast<uint32_t>(pos % 8);
+		}
 		return pos;
 	}
 
@@ -277,7 +294,8 @@ private:
 	FormDSDChunk formDSDChunk{};
 	std::string path;
 	dffOpenMode mode;
-	std::fstream file;
+	std::unique_ptr<std::streambuf> fileBuf;
+	std::istream file{nullptr};
 	bool err;
 	const uint32_t blockSize = 4096;
 	uint64_t endOfBlock;
@@ -288,7 +306,9 @@ private:
 	uint32_t _sampleRate{};
 	uint64_t numSamples{};
 	uint64_t numFrames{};
-	uint8_t* inputBuffer;
+	uint8_t* inputBuffer = nullptr;
+	const uint8_t* blockData = nullptr; // current block (in inputBuffer, or in mapped file)
+	std::unique_ptr<MappedFile> map;
 	uint64_t bufferIndex;
 	uint32_t currentChannel;
 	uint32_t currentBit;
@@ -509,12 +529,21 @@ private:
 	}
 
 	uint64_t readBlocks() {
+		uint64_t bytesRemaining = totalSoundDataBytes - totalBytesRead;
+		uint64_t bytesToRead = std::min(bufferSize, bytesRemaining);
+
+		if (map) {
+			uint64_t offset = std::min<uint64_t>(startOfData + totalBytesRead, map->size());
+			bytesToRead = std::min<uint64_t>(bytesToRead, map->size() - offset); // (in case file is truncated)
+			blockData = map->data() + offset;
+			totalBytesRead += bytesToRead;
+			return bytesToRead;
+		}
+
 		if (file.eof()) {
 			return 0;
 		}
 
-		uint64_t bytesRemaining = totalSoundDataBytes - totalBytesRead;
-		uint64_t bytesToRead = std::min(bufferSize, bytesRemaining);
 		file.read((char*)inputBuffer, static_cast<std::streamsize>(bytesToRead));
 		uint64_t bytesActuallyRead = static_cast<uint64_t>(file.gcount());
 		totalBytesRead += bytesActuallyRead;
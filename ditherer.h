@@ -16,12 +16,14 @@
 // configuration:
 #define MAX_FIR_FILTER_SIZE 41
 
+#include <algorithm>
 #include <cmath>
-#include <random>
 #include <cstring>
+#include <vector>
 
 #include "biquad.h"
 #include "noiseshape.h"
+#include "philox.h"
 
 enum FilterType {
 	bypass,
@@ -69,7 +71,7 @@ struct DitherProfile {
 	bool bUseFeedback;
 };
 
-const DitherProfile ditherProfileList[] = {
+constexpr DitherProfile ditherProfileList[] = {
 
 	// id, name, noiseGeneratorType, filterType, intendedSampleRate, N, coeffs, bUseFeedback
 	
@@ -91,6 +93,13 @@ const DitherProfile ditherProfileList[] = {
     { Rpdf_f, "flat rpdf (with error-correction feedback)", RPDF, bypass, 44100, 1, noiseShaperPassThrough, true }
 };
 
+// ditherBlock() must round exactly as dither() does: so (with GCC) don't let the compiler fuse multiplies and adds into FMA instructions here,
+// as it may not fuse them in the same places in both
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC push_options
+#pragma GCC optimize("fp-contract=off")
+#endif
+
 template<typename FloatType>
 class Ditherer
 {
@@ -101,13 +110,13 @@ public:
 	// bAutoBlankingEnabled: if true, enable auto-blanking of dither (on Silence)
 	// seed: seed for PRNG
 	// filterID: noise-shaping filter to use
+	// stream: identifies an independent noise stream for the given seed (eg channel number)
 
-	Ditherer(unsigned int signalBits, FloatType ditherBits, bool bAutoBlankingEnabled, int seed, DitherProfileID ditherProfileID = standard) :
+	Ditherer(unsigned int signalBits, FloatType ditherBits, bool bAutoBlankingEnabled, int seed, DitherProfileID ditherProfileID = standard, unsigned int stream = 0) :
         seed(seed),
         Z1(0),
         masterVolume(1.0),
-        randGenerator(static_cast<unsigned int>(seed)),		// initialize (seed) RNG
-        dist(0, randMax),		// set the range of the random number distribution
+        randGenerator(static_cast<uint32_t>(seed), stream),		// initialize (seed) RNG
         signalBits(signalBits),
         ditherBits(ditherBits),
         selectedDitherProfile(ditherProfileList[ditherProfileID]),
@@ -127,22 +136,28 @@ public:
 		switch (selectedDitherProfile.noiseGeneratorType) {
 		case flatTPDF:
 			noiseGenerator = &Ditherer::noiseGeneratorFlatTPDF;
+			drawsPerSample = 2;
 			break;
 		case RPDF:
 			noiseGenerator = &Ditherer::noiseGeneratorRPDF;
+			drawsPerSample = 1;
 			break;
 		case GPDF:
 			noiseGenerator = &Ditherer::noiseGeneratorGPDF;
+			drawsPerSample = 5;
 			break;
 		case impulse:
 			noiseGenerator = &Ditherer::noiseGeneratorImpulse;
+			drawsPerSample = 0;
 			break;
 		case legacyTPDF:
 			noiseGenerator = &Ditherer::noiseGeneratorLegacy;
+			drawsPerSample = 1;
 			break;
 		case slopedTPDF:
 		default:
 			noiseGenerator = &Ditherer::noiseGeneratorSlopedTPDF;
+			drawsPerSample = 1;
 		}
 
 		// set-up filter type:
@@ -197,7 +212,13 @@ public:
 			FIRCoeffs[n] = static_cast<FloatType>(scale * selectedDitherProfile.coeffs[n]);
 		}
 
-		memset(FIRHistory, 0, MAX_FIR_FILTER_SIZE * sizeof(FloatType));
+		memset(FIRHistory, 0, 2 * MAX_FIR_FILTER_SIZE * sizeof(FloatType));
+		historyIndex = FIRLength - 1;
+
+		// select block-processing function for this profile:
+		blockFunction = bAutoBlankingEnabled ?
+			selectBlockFunction<true>(ditherProfileID) :
+			selectBlockFunction<false>(ditherProfileID);
 
 		// set-up Auto-blanking:
 		if (bAutoBlankingEnabled) {	// initial state: silence
@@ -225,11 +246,11 @@ public:
 		f2.reset();
 		f3.reset();
 
-		memset(FIRHistory, 0, MAX_FIR_FILTER_SIZE * sizeof(FloatType));
+		memset(FIRHistory, 0, 2 * MAX_FIR_FILTER_SIZE * sizeof(FloatType));
+		historyIndex = FIRLength - 1;
 		
-		// re-seed PRNG
-		randGenerator.seed(static_cast<unsigned int>(seed));
-		oldRandom = 0;
+		// rewind PRNG
+		seek(0);
 		Z1 = 0;
 		zeroCount = 0;
 		masterVolume = 1.0;
@@ -241,6 +262,23 @@ public:
 		}
 	}
 
+	// seek() : position the noise generator at the noise for sample number samplePosition, in O(1) time.
+	// Noise depends only on (seed, stream, samplePosition), so a channel may be processed in separate chunks
+	// (eg in parallel), with each chunk seeking to its starting position to get the same noise.
+	// (Note: this doesn't affect the state of the noise-shaping filters)
+	void seek(uint64_t samplePosition) {
+		uint64_t position = samplePosition * drawsPerSample;
+		if (position > 0) {
+			randGenerator.seek(position - 1);
+			oldRandom = nextRandom(); // sloped TPDF uses the previous random number
+		}
+		else {
+			randGenerator.seek(0);
+			oldRandom = 0;
+		}
+		bPulseEmitted = (samplePosition > 0);
+	}
+
 // The dither function ///////////////////////////////////////////////////////
 //
 // Ditherer Topology:
@@ -293,6 +331,65 @@ FloatType dither(FloatType inSample) {
 	return postQuantize;
 } // ends function: dither()
 
+// ditherBlock() : apply gain and dither to count samples (spaced stride samples apart), in-place.
+// Produces exactly the same result as buffer[i] = dither(inputGain * buffer[i]) for each sample,
+// but uses a version of the dither function which has been specialised at compile-time for the selected dither profile.
+
+void ditherBlock(FloatType* buffer, size_t count, FloatType inputGain = 1.0, size_t stride = 1) {
+	(this->*blockFunction)(buffer, count, inputGain, stride);
+}
+
+// test() : checks that ditherBlock() gives exactly the same output as dither() (the per-sample reference), for every dither profile,
+// with and without auto-blanking, for several bit depths and amounts of dither. The (seeded) test signal has a stretch of silence
+// long enough to set off auto-blanking, and is processed in blocks of various sizes, spaced out with a stride (as in interleaved frames).
+// Returns true if all outputs are identical.
+
+static bool test() {
+	const size_t length = 50000;
+	const size_t stride = 3;
+	const FloatType inputGain = static_cast<FloatType>(0.9);
+	std::vector<FloatType> signal(length);
+	for (size_t i = 0; i < length; i++) {
+		signal[i] = (i >= 10000 && i < 45000) ? 0 : static_cast<FloatType>(0.5 * sin(0.001 * i) + 0.25 * sin(0.37 * i));
+	}
+
+	bool ok = true;
+	std::vector<FloatType> expected(length);
+	std::vector<FloatType> output(length * stride);
+	for (int id = 0; id < end; id++) {
+		for (bool bAutoBlank : { false, true }) {
+			for (unsigned int signalBits : { 8u, 16u, 24u }) {
+				for (FloatType ditherBits : { static_cast<FloatType>(1.0), static_cast<FloatType>(2.5) }) {
+					Ditherer reference(signalBits, ditherBits, bAutoBlank, 1234, static_cast<DitherProfileID>(id), 1);
+					Ditherer block(signalBits, ditherBits, bAutoBlank, 1234, static_cast<DitherProfileID>(id), 1);
+					reference.adjustGain(static_cast<FloatType>(0.99));
+					block.adjustGain(static_cast<FloatType>(0.99));
+
+					for (size_t i = 0; i < length; i++) {
+						expected[i] = reference.dither(inputGain * signal[i]);
+						for (size_t s = 0; s < stride; s++) {
+							output[i * stride + s] = signal[i];
+						}
+					}
+
+					size_t blockSize = 1;
+					for (size_t i = 0; i < length; i += blockSize, blockSize = blockSize * 2 % 4093 + 1) {
+						block.ditherBlock(output.data() + i * stride, std::min(blockSize, length - i), inputGain, stride);
+					}
+
+					for (size_t i = 0; i < length; i++) {
+						ok &= (output[i * stride] == expected[i]);
+						for (size_t s = 1; s < stride; s++) {
+							ok &= (output[i * stride + s] == signal[i]); // (samples in between must be left alone)
+						}
+					}
+				}
+			}
+		}
+	}
+	return ok;
+}
+
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 private:
@@ -305,8 +402,8 @@ private:
 	FloatType masterVolume;
 	int64_t zeroCount; // number of consecutive zeroes in input;
 	FloatType autoBlankDecayCutoff;	// threshold at which ditherScaleFactor is set to zero during active blanking
-	std::mt19937 randGenerator; // Mersenne Twister - one of the best random number algorithms available
-	std::uniform_int_distribution<int> dist; // random number distribution
+	Philox4x32 randGenerator; // counter-based PRNG (allows jumping to any position in the stream)
+	int drawsPerSample; // number of random numbers used by noise generator for each sample
 	static const int randMax = 16777215; // 2^24 - 1 */
 	unsigned int signalBits;
 	FloatType ditherBits;
@@ -333,15 +430,25 @@ private:
 	// FIR Filter-related stuff:
 	int FIRLength;
 	FloatType FIRCoeffs[MAX_FIR_FILTER_SIZE];
-	FloatType FIRHistory[MAX_FIR_FILTER_SIZE]; // (circular) buffer for noise history
+	FloatType FIRHistory[2 * MAX_FIR_FILTER_SIZE]; // double-length circular buffer for noise history (newest sample at historyIndex)
+	int historyIndex;
+
+	// block-processing function (specialised for dither profile):
+	typedef void (Ditherer::*BlockFunction)(FloatType* buffer, size_t count, FloatType inputGain, size_t stride);
+	BlockFunction blockFunction;
+
+	// nextRandom() : return next random number, uniformly distributed in range [0, randMax]
+	int nextRandom() {
+		return static_cast<int>(randGenerator() >> 8); // top 24 bits
+	}
 
 	// --- Noise-generating functions ---
 
 	// pure flat tpdf generator
 	// calculate two random numbers and subtracts them, yielding a triangular distribution (which is 'fattest' at zero).
 	FloatType noiseGeneratorFlatTPDF() {
-		int a = dist(randGenerator);
-		int b = dist(randGenerator);
+		int a = nextRandom();
+		int b = nextRandom();
 		return static_cast<FloatType>(a - b);
 	}
 
@@ -351,7 +458,7 @@ private:
 	// Thus, the resulting noise is violet noise instead of white, which is quite effective for dithering purposes. 
 	// It also has the advantage of only calcluating one random number on each iteration, instead of two.
 	FloatType noiseGeneratorSlopedTPDF() {
-		int newRandom = dist(randGenerator);
+		int newRandom = nextRandom();
         auto tpdfNoise = static_cast<FloatType>(newRandom - oldRandom);
 		oldRandom = newRandom;
 		return tpdfNoise;
@@ -359,7 +466,7 @@ private:
 
 	FloatType noiseGeneratorRPDF() { // rectangular PDF (single PRNG)
 		static constexpr int halfRand = (randMax + 1) >> 1;
-		return static_cast<FloatType>(halfRand - dist(randGenerator));
+		return static_cast<FloatType>(halfRand - nextRandom());
 	}
 
 	FloatType noiseGeneratorGPDF() { // Gaussian PDF (n PRNGs)
@@ -368,7 +475,7 @@ private:
 		const int n = 5;
 		FloatType r = 0;
 		for (int i = 0; i < n; ++i) {
-			r += dist(randGenerator);
+			r += nextRandom();
 		}
 		return static_cast<FloatType>(halfRand - r/n);
 	}
@@ -382,7 +489,7 @@ private:
 	}
 
 	FloatType noiseGeneratorLegacy() { // legacy noise generator (from previous version of ReSampler) - applies filter to noise _before_ injection into dither engine
-		int newRandom = dist(randGenerator);
+		int newRandom = nextRandom();
         auto tpdfNoise = static_cast<FloatType>(newRandom - oldRandom); // sloped TDPF
 		oldRandom = newRandom;
 		return static_cast<FloatType>(f2.filter(f1.filter(tpdfNoise)));
@@ -400,23 +507,148 @@ private:
 
 	FloatType noiseShaperFIR(FloatType x) { // very simple FIR ...
 
-		// put sample at end of buffer:
-		FloatType* historyPtr = &FIRHistory[FIRLength - 1];
-		*historyPtr = x;
-		
+		// put sample into both halves of circular buffer:
+		FIRHistory[historyIndex] = x;
+		FIRHistory[historyIndex + FIRLength] = x;
+
+		// macc with coefficients (history is contiguous, from newest to oldest):
+		const FloatType* history = &FIRHistory[historyIndex];
 		FloatType filterOutput = 0.0;
-		
-		// macc with coefficients:
-		for (size_t k = 0; k < FIRLength; k++) {
-			filterOutput += *historyPtr-- * FIRCoeffs[k];
+		for (int k = 0; k < FIRLength; k++) {
+			filterOutput += history[k] * FIRCoeffs[k];
 		}
 
-		// shift buffer backwards for next time:
-		memmove(FIRHistory, &FIRHistory[1],
-			(FIRLength - 1) * sizeof(FloatType));
-
+		// move to next position:
+		historyIndex = (historyIndex == 0) ? FIRLength - 1 : historyIndex - 1;
 		return filterOutput;
 	}
+
+	// --- Block processing ---
+
+	// nextNoise() : noise generator selected at compile-time
+	template<NoiseGeneratorType generatorType>
+	FloatType nextNoise() {
+		switch (generatorType) {
+		case flatTPDF:
+			return noiseGeneratorFlatTPDF();
+		case RPDF:
+			return noiseGeneratorRPDF();
+		case GPDF:
+			return noiseGeneratorGPDF();
+		case impulse:
+			return noiseGeneratorImpulse();
+		case legacyTPDF:
+			return noiseGeneratorLegacy();
+		case slopedTPDF:
+		default:
+			return noiseGeneratorSlopedTPDF();
+		}
+	}
+
+	// ditherBlockT() : block version of dither(), specialised for a given profile.
+	// The noise generator, noise-shaping filter type, FIR length and feedback option are known at compile-time.
+	// If auto-blanking is disabled, ditherScaleFactor and masterVolume (= 1.0) are constant, so all auto-blanking logic is removed.
+
+	template<int profileID, bool autoBlank>
+	void ditherBlockT(FloatType* buffer, size_t count, FloatType inputGain, size_t stride) {
+		constexpr NoiseGeneratorType generatorType = ditherProfileList[profileID].noiseGeneratorType;
+		constexpr FilterType filterType = ditherProfileList[profileID].filterType;
+		constexpr int N = ditherProfileList[profileID].N;
+		constexpr bool useFeedback = ditherProfileList[profileID].bUseFeedback;
+		static_assert(N >= 1 && N <= MAX_FIR_FILTER_SIZE, "FIR length out of range");
+
+		// local copies of state:
+		FloatType coeffs[N];
+		for (int k = 0; k < N; k++) {
+			coeffs[k] = FIRCoeffs[k];
+		}
+		int index = historyIndex;
+		FloatType z1 = Z1;
+		const FloatType scale = ditherScaleFactor; // (only used if auto-blanking disabled)
+
+		FloatType* p = buffer;
+		for (size_t i = 0; i < count; ++i, p += stride) {
+			FloatType inSample = inputGain * *p;
+
+			if (autoBlank) {
+				if (std::abs(inSample) < autoBlankLevelThreshold) {
+					++zeroCount;
+					if (zeroCount > autoBlankTimeThreshold) {
+						ditherScaleFactor *= autoBlankDecayFactor; // decay
+						if (ditherScaleFactor < autoBlankDecayCutoff) {
+							ditherScaleFactor = 0.0; // decay cutoff
+							masterVolume = 0.0; // mute
+						}
+					}
+				}
+				else {
+					zeroCount = 0; // reset
+					ditherScaleFactor = maxDitherScaleFactor; // restore
+					masterVolume = 1.0;
+				}
+			}
+
+			FloatType noise = nextNoise<generatorType>() * (autoBlank ? ditherScaleFactor : scale);
+			FloatType preDither = inSample;
+			if (useFeedback) {
+				FloatType filterOutput;
+				if (filterType == fir) {
+					FIRHistory[index] = z1;
+					FIRHistory[index + N] = z1;
+					filterOutput = 0.0;
+					for (int k = 0; k < N; k++) {
+						filterOutput += FIRHistory[index + k] * coeffs[k];
+					}
+					index = (index == 0) ? N - 1 : index - 1;
+				}
+				else if (filterType == cascadedBiquad) {
+					filterOutput = noiseShaperCascadedBiquad(z1);
+				}
+				else {
+					filterOutput = z1;
+				}
+				preDither = inSample - filterOutput;
+			}
+
+			FloatType preQuantize = autoBlank ? masterVolume * (preDither + noise) : preDither + noise;
+			FloatType postQuantize = reciprocalSignalMagnitude * round(maxSignalMagnitude * preQuantize); // quantize
+			z1 = postQuantize - preDither;
+			*p = postQuantize;
+		}
+
+		// save state:
+		historyIndex = index;
+		Z1 = z1;
+	}
+
+	// selectBlockFunction() : get specialised block function for a given dither profile
+	template<bool autoBlank>
+	static BlockFunction selectBlockFunction(DitherProfileID ditherProfileID) {
+		switch (ditherProfileID) {
+		case flat: return &Ditherer::ditherBlockT<flat, autoBlank>;
+		case legacy: return &Ditherer::ditherBlockT<legacy, autoBlank>;
+		case flat_f: return &Ditherer::ditherBlockT<flat_f, autoBlank>;
+		case ModEWeighted44k: return &Ditherer::ditherBlockT<ModEWeighted44k, autoBlank>;
+		case Wannamaker3tap: return &Ditherer::ditherBlockT<Wannamaker3tap, autoBlank>;
+		case Lipshitz44k: return &Ditherer::ditherBlockT<Lipshitz44k, autoBlank>;
+		case Wannamaker24tap: return &Ditherer::ditherBlockT<Wannamaker24tap, autoBlank>;
+		case Wannamaker9tap: return &Ditherer::ditherBlockT<Wannamaker9tap, autoBlank>;
+		case High28: return &Ditherer::ditherBlockT<High28, autoBlank>;
+		case ImpEWeighted44k: return &Ditherer::ditherBlockT<ImpEWeighted44k, autoBlank>;
+		case High30: return &Ditherer::ditherBlockT<High30, autoBlank>;
+		case High32: return &Ditherer::ditherBlockT<High32, autoBlank>;
+		case Blue: return &Ditherer::ditherBlockT<Blue, autoBlank>;
+		case Rpdf: return &Ditherer::ditherBlockT<Rpdf, autoBlank>;
+		case Rpdf_f: return &Ditherer::ditherBlockT<Rpdf_f, autoBlank>;
+		case standard:
+		default:
+			return &Ditherer::ditherBlockT<standard, autoBlank>;
+		}
+	}
 };
 
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC pop_options
+#endif
+
 #endif // DITHERER_H
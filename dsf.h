@@ -18,8 +18,12 @@
 #include <string>
 #include <iostream>
 #include <fstream>
+#include <memory>
+#include <vector>
 
 #include "osspecific.h"
+#include "asyncio.h"
+#include "mmapfile.h"
 
 #define DSF_FORMAT 0x00310000 // note: take care to make sure this doesn't clash with future libsndfile formats (unlikely)
 
@@ -84,28 +88,32 @@ class DsfFile
 {
 public:
 	// Construction / destruction
-	DsfFile(const std::string& path, OpenMode mode = dsf_read) : path(path), mode(mode)
+	DsfFile(const std::string& path, OpenMode mode = dsf_read, const IOOptions& io = IOOptions()) : path(path), mode(mode)
 	{
 		assertSizes();
-		file.exceptions(std::ifstream::failbit | std::ifstream::badbit);
 
 		switch (mode) {
 		case dsf_read:
-			try {
-				file.open(path, std::ios::in | std::ios::binary);
-				err = false;
-			}
-
-			catch (std::ios_base::failure& e) {
-				e.what();
-				err = true; 
+			fileBuf = openInputStreamBuf(path, io);
+			if (!fileBuf) {
+				err = true;
 				return;
 			}
+			file.rdbuf(fileBuf.get());
+			file.exceptions(std::ifstream::failbit | std::ifstream::badbit);
+			err = false;
 
 			makeTbl();
 			readHeaders();
-			for (int n = 0; n < 6; ++n) {
-				channelBuffer[n] = new uint8_t[blockSize];
+			if (!err) {
+				channelBuffer.assign(numChannels, std::vector<uint8_t>(blockSize));
+				channelData.assign(numChannels, nullptr);
+				if (io.mmap) { // read sound data straight from mapped file
+					map.reset(new MappedFile(path));
+					if (!map->isOpen())
+						map.reset();
+				}
+				readPosition = startOfData;
 			}
 			bufferIndex = blockSize; // empty (zero -> full)
 			currentBit = 0;
@@ -117,13 +125,8 @@ public:
 		}
     }
 
-	~DsfFile() {
-		if(file.is_open())
-			file.close();
-		for (int n = 0; n < 6; ++n) {
-			delete[] channelBuffer[n];
-		}
-	}
+	// open for reading (through an AsyncFile, if io.async is set, or from a MappedFile, if io.mmap is set):
+	DsfFile(const std::string& path, const IOOptions& io) : DsfFile(path, dsf_read, io) {}
 
 	// API:
 
@@ -188,7 +191,7 @@ public:
 				bufferIndex = 0;
 			}
 
-            buffer[i] = static_cast<FloatType>(samplTbl[channelBuffer[currentChannel][bufferIndex]][currentBit]);
+            buffer[i] = static_cast<FloatType>(samplTbl[channelData[currentChannel][bufferIndex]][currentBit]);
 		
 			++samplesRead;
 
@@ -224,15 +227,30 @@ public:
 		std::cout << "total samples retrieved: " << totalSamplesRead << std::endl;
 	}
 
+	// seek() : set read position to frame number pos (whence: SEEK_SET only)
 	uint64_t seek(uint64_t pos, int whence) {
 		// reset initial conditions:
 		bufferIndex = blockSize; // empty (zero -> full)
 		currentBit = 0;
 		currentChannel = 0;
 
-		// seek:
-		file.clear();
-		file.seekg(startOfData + pos);
+		// seek to the start of the group of channel blocks containing pos:
+		const uint64_t framesPerBlock = 8 * static_cast<uint64_t>(blockSize);
+		readPosition = startOfData + (pos / framesPerBlock) * blockSize * numChannels;
+		if (map) {
+			map->willNeed(static_cast<size_t>(readPosition), MMAPFILE_WILLNEED_SIZE);
+		}
+		else {
+			file.clear();
+			file.seekg(readPosition);
+		}
+
+		// position within block:
+		uint64_t framesIntoBlock = pos % framesPerBlock;
+		if (framesIntoBlock != 0 && readBlocks() != 0) {
+			bufferIndex = framesIntoBlock / 8;
+			currentBit = static_cast<uint32_t>(framesIntoBlock % 8);
+		}
 		return pos;
 	}
 
@@ -243,14 +261,18 @@ private:
 	DsfChannelType dsfChannelType;
 	std::string path;
 	OpenMode mode;
-	std::fstream file;
+	std::unique_ptr<std::streambuf> fileBuf;
+	std::istream file{nullptr};
 	bool err;
 	uint32_t blockSize;
 	uint32_t numChannels;
 	uint32_t _sampleRate;
 	uint64_t numSamples;
 	uint64_t numFrames;
-	uint8_t* channelBuffer[6];
+	std::vector<std::vector<uint8_t>> channelBuffer; // one block for each channel
+	std::vector<const uint8_t*> channelData; // current block of each channel (in channelBuffer, or in mapped file)
+	std::unique_ptr<MappedFile> map;
+	uint64_t readPosition; // (file offset of next group of channel blocks)
 	uint64_t bufferIndex;
 	uint32_t currentChannel;
 	uint32_t currentBit;
@@ -349,13 +371,25 @@ private:
 	}
 
 	// readBlocks() : reads blockSize bytes into each channelBuffer for numChannels channels
+	// (or, if file is mapped, points channelData at the blocks in the mapped file)
 	uint32_t readBlocks() {
-        if (file.tellg() >= static_cast<std::istream::pos_type>(endOfData))
+		if (readPosition >= endOfData)
 			return 0;
 
-		for (size_t ch = 0; ch < numChannels; ++ch) {
-			file.read((char*)channelBuffer[ch], blockSize);
+		if (map) {
+			if (readPosition + static_cast<uint64_t>(blockSize) * numChannels > map->size())
+				return 0;
+			for (size_t ch = 0; ch < numChannels; ++ch) {
+				channelData[ch] = map->data() + readPosition + ch * blockSize;
+			}
+		}
+		else {
+			for (size_t ch = 0; ch < numChannels; ++ch) {
+				file.read((char*)channelBuffer[ch].data(), blockSize);
+				channelData[ch] = channelBuffer[ch].data();
+			}
 		}
+		readPosition += static_cast<uint64_t>(blockSize) * numChannels;
 		return blockSize;
 	}
 
@@ -0,0 +1,189 @@
+/*
+* Copyright (C) 2016 - 2019 Judd Niemann - All Rights Reserved.
+* You may use, distribute and modify this code under the
+* terms of the GNU Lesser General Public License, version 2.1
+*
+* You should have received a copy of GNU Lesser General Public License v2.1
+* with this file. If not, please refer to: https://github.com/jniemann66/ReSampler
+*/
+
+// fftplancache.h : process-wide cache of FFTW plans, with optional persistence of FFTW wisdom (--fftWisdom, --fftPlanner)
+
+// Plans are created once for each (kind, size, in-place, alignment) combination, on scratch buffers owned by the cache,
+// and are then executed on the caller's buffers using FFTW's new-array execute functions.
+// This means that expensive planner modes (measure / patient / exhaustive) only cost time the first time a size is used,
+// and (with a wisdom file) only the first time on a given machine.
+
+#ifndef FFTPLANCACHE_H
+#define FFTPLANCACHE_H 1
+
+#include <algorithm>
+#include <complex>
+#include <map>
+#include <mutex>
+#include <string>
+#include <tuple>
+
+#include <fftw3.h>
+
+#define FFT_THREADED_PLAN_THRESHOLD 65536 // transforms at least this long use multi-threaded plans (if USE_FFTW_THREADS defined, and setMaxThreads() allows it)
+
+class FFTPlanCache {
+public:
+	enum Kind {
+		ComplexForward,
+		ComplexBackward,
+		RealToComplex,
+		ComplexToReal
+	};
+
+	static FFTPlanCache& instance() {
+		static FFTPlanCache cache;
+		return cache;
+	}
+
+	// plannerFlagsFromName() : convert planner name (estimate, measure, patient, exhaustive) to FFTW flags.
+	// Returns false if name not recognised.
+	static bool plannerFlagsFromName(const std::string& name, unsigned int& flags) {
+		if (name == "estimate")
+			flags = FFTW_ESTIMATE;
+		else if (name == "measure")
+			flags = FFTW_MEASURE;
+		else if (name == "patient")
+			flags = FFTW_PATIENT;
+		else if (name == "exhaustive")
+			flags = FFTW_EXHAUSTIVE;
+		else
+			return false;
+		return true;
+	}
+
+	void setPlannerFlags(unsigned int flags) {
+		std::lock_guard<std::mutex> lock(mutex);
+		plannerFlags = flags;
+	}
+
+	// setMaxThreads() : set the number of threads used by plans for long transforms (default: 1)
+	void setMaxThreads(int n) {
+		std::lock_guard<std::mutex> lock(mutex);
+		maxThreads = std::max(1, n);
+	}
+
+	// loadWisdom() : import FFTW wisdom from file. Returns false if file doesn't exist or couldn't be read.
+	bool loadWisdom(const std::string& filename) {
+		std::lock_guard<std::mutex> lock(mutex);
+		return fftw_import_wisdom_from_filename(filename.c_str()) != 0;
+	}
+
+	// saveWisdom() : export FFTW wisdom to file, if any plans have been created since wisdom was last loaded / saved
+	bool saveWisdom(const std::string& filename) {
+		std::lock_guard<std::mutex> lock(mutex);
+		if (!bNewPlans)
+			return true;
+		bNewPlans = false;
+		return fftw_export_wisdom_to_filename(filename.c_str()) != 0;
+	}
+
+	// getPlan() : get a plan suitable for executing with the given buffers (created if it doesn't exist yet).
+	// Buffers are not touched. 'in' and 'out' may be the same (in-place transform).
+	fftw_plan getPlan(Kind kind, int size, const void* in, const void* out) {
+		bool inPlace = (in == out);
+		bool aligned = fftw_alignment_of(const_cast<double*>(static_cast<const double*>(in))) == 0 &&
+			fftw_alignment_of(const_cast<double*>(static_cast<const double*>(out))) == 0;
+		Key key(kind, size, inPlace, aligned);
+
+		std::lock_guard<std::mutex> lock(mutex);
+		auto it = plans.find(key);
+		if (it != plans.end())
+			return it->second;
+
+		fftw_plan plan = createPlan(kind, size, inPlace, aligned);
+		plans.emplace(key, plan);
+		bNewPlans = true;
+		return plan;
+	}
+
+	~FFTPlanCache() {
+		for (auto& p : plans) {
+			fftw_destroy_plan(p.second);
+		}
+	}
+
+	FFTPlanCache(const FFTPlanCache&) = delete;
+	FFTPlanCache& operator=(const FFTPlanCache&) = delete;
+
+private:
+	typedef std::tuple<Kind, int, bool, bool> Key; // kind, size, in-place, aligned
+
+	std::mutex mutex; // (FFTW planner is not thread-safe)
+	std::map<Key, fftw_plan> plans;
+	unsigned int plannerFlags;
+	int maxThreads;
+	bool bNewPlans;
+
+	FFTPlanCache() : plannerFlags(FFTW_ESTIMATE), maxThreads(1), bNewPlans(false) {
+
+#ifdef USE_FFTW_THREADS
+		fftw_init_threads();
+#endif
+
+	}
+
+	// createPlan() : plan on scratch buffers (planners other than FFTW_ESTIMATE overwrite the buffers)
+	fftw_plan createPlan(Kind kind, int size, bool inPlace, bool aligned) {
+
+#ifdef USE_FFTW_THREADS
+		int numThreads = (size >= FFT_THREADED_PLAN_THRESHOLD) ? maxThreads : 1;
+		fftw_plan_with_nthreads(numThreads);
+#endif
+
+		unsigned int flags = plannerFlags | (aligned ? 0 : FFTW_UNALIGNED);
+		size_t complexSize = (kind == ComplexForward || kind == ComplexBackward) ? size : size / 2 + 1;
+		size_t bytes = complexSize * sizeof(fftw_complex);
+		void* in = fftw_malloc(bytes);
+		void* out = inPlace ? in : fftw_malloc(bytes);
+
+		fftw_plan plan = nullptr;
+		switch (kind) {
+		case ComplexForward:
+		case ComplexBackward:
+			plan = fftw_plan_dft_1d(size, static_cast<fftw_complex*>(in), static_cast<fftw_complex*>(out),
+				(kind == ComplexForward) ? FFTW_FORWARD : FFTW_BACKWARD, flags);
+			break;
+		case RealToComplex:
+			plan = fftw_plan_dft_r2c_1d(size, static_cast<double*>(in), static_cast<fftw_complex*>(out), flags);
+			break;
+		case ComplexToReal:
+			plan = fftw_plan_dft_c2r_1d(size, static_cast<fftw_complex*>(in), static_cast<double*>(out), flags);
+			break;
+		}
+
+		if (!inPlace)
+			fftw_free(out);
+		fftw_free(in);
+		return plan;
+	}
+};
+
+// convenience functions for executing cached plans:
+
+// fftComplex() : unnormalised complex FFT (sign: FFTW_FORWARD or FFTW_BACKWARD)
+inline void fftComplex(int size, std::complex<double>* in, std::complex<double>* out, int sign) {
+	fftw_plan plan = FFTPlanCache::instance().getPlan(
+		(sign == FFTW_FORWARD) ? FFTPlanCache::ComplexForward : FFTPlanCache::ComplexBackward, size, in, out);
+	fftw_execute_dft(plan, reinterpret_cast<fftw_complex*>(in), reinterpret_cast<fftw_complex*>(out));
+}
+
+// fftRealToComplex() : real input (size values) to complex output (size / 2 + 1 bins)
+inline void fftRealToComplex(int size, double* in, std::complex<double>* out) {
+	fftw_plan plan = FFTPlanCache::instance().getPlan(FFTPlanCache::RealToComplex, size, in, out);
+	fftw_execute_dft_r2c(plan, in, reinterpret_cast<fftw_complex*>(out));
+}
+
+// fftComplexToReal() : complex input (size / 2 + 1 bins) to real output (size values, unnormalised). Note: input is destroyed.
+inline void fftComplexToReal(int size, std::complex<double>* in, double* out) {
+	fftw_plan plan = FFTPlanCache::instance().getPlan(FFTPlanCache::ComplexToReal, size, in, out);
+	fftw_execute_dft_c2r(plan, reinterpret_cast<fftw_complex*>(in), out);
+}
+
+#endif // FFTPLANCACHE_H
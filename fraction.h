@@ -253,6 +253,7 @@ void dumpConversionStageCandidates(std::vector<std::vector<Fraction>> candidates
 
 // test functions:
 void testConverterStageSelection(int numStages, bool unique = true) {
+	// (tests/benchmark.sh --full reads this list of rates from here: keep it on one line)
 	std::vector<int> rates{8000, 11025, 16000, 22050, 32000, 37800, 44056, 44100, 47250, 48000, 50000, 50400, 88200, 96000, 176400, 192000, 352800, 384000, 2822400, 5644800};
 	struct Result {
 		Fraction fraction;
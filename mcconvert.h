@@ -0,0 +1,594 @@
+/*
+* Copyright (C) 2016 - 2019 Judd Niemann - All Rights Reserved.
+* You may use, distribute and modify this code under the
+* terms of the GNU Lesser General Public License, version 2.1
+*
+* You should have received a copy of GNU Lesser General Public License v2.1
+* with this file. If not, please refer to: https://github.com/jniemann66/ReSampler
+*/
+
+// mcconvert.h : channel-vectorised sample rate conversion, for files with many channels.
+
+// All channels of a conversion use the same filter taps, and the same interpolation / decimation schedule.
+// So instead of running a separate Converter for each channel (each of which does its own horizontal SIMD sum for every output sample),
+// the MultichannelConverter keeps the signal history of all channels together, frame-interleaved (one frame per filter position),
+// with the channels in the lanes of SIMD vectors. Each filter tap is broadcast once, and multiplied against all the channels at the same time,
+// so no horizontal sums are needed, and the input and output stay interleaved (no de-interleaving or interleaving).
+// Note: the results are not bit-identical to those of Converter: the products are summed in a different order from FIRFilter::get(),
+// and every tap is used at every position (FIRFilter's SIMD get() leaves out the last few taps at some positions, depending on the filter length).
+
+#ifndef MCCONVERT_H
+#define MCCONVERT_H 1
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+
+#if defined(USE_AVX) || defined(USE_SIMD)
+#include <emmintrin.h>
+#endif
+
+#include "FIRFilter.h"
+#include "alignedmalloc.h"
+#include "profiler.h"
+#include "srconvert.h"
+
+#define MC_MIN_CHANNELS 4		// minimum number of channels for which channel-vectorised conversion is used
+#define MC_VECTORS_PER_PASS 4	// number of SIMD vectors (of channels) accumulated at the same time
+
+// SimdLanes<FloatType> : vector type holding several channels (one per lane), and the operations used on it.
+// The generic version has a single lane.
+
+template<typename FloatType>
+struct SimdLanes {
+	typedef FloatType Vector;
+	static const int width = 1;
+	static Vector zero() { return 0.0; }
+	static Vector load(const FloatType* p) { return *p; }
+	static void store(FloatType* p, Vector v) { *p = v; }
+	static Vector broadcast(FloatType x) { return x; }
+	static Vector multiplyAdd(Vector accumulator, Vector a, Vector b) { return accumulator + a * b; }
+};
+
+#if defined(USE_AVX)
+
+template<>
+struct SimdLanes<float> {
+	typedef __m256 Vector;
+	static const int width = 8;
+	static Vector zero() { return _mm256_setzero_ps(); }
+	static Vector load(const float* p) { return _mm256_load_ps(p); }
+	static void store(float* p, Vector v) { _mm256_store_ps(p, v); }
+	static Vector broadcast(float x) { return _mm256_set1_ps(x); }
+	static Vector multiplyAdd(Vector accumulator, Vector a, Vector b) {
+#ifdef USE_FMA
+		return _mm256_fmadd_ps(a, b, accumulator);
+#else
+		return _mm256_add_ps(_mm256_mul_ps(a, b), accumulator);
+#endif
+	}
+};
+
+template<>
+struct SimdLanes<double> {
+	typedef __m256d Vector;
+	static const int width = 4;
+	static Vector zero() { return _mm256_setzero_pd(); }
+	static Vector load(const double* p) { return _mm256_load_pd(p); }
+	static void store(double* p, Vector v) { _mm256_store_pd(p, v); }
+	static Vector broadcast(double x) { return _mm256_set1_pd(x); }
+	static Vector multiplyAdd(Vector accumulator, Vector a, Vector b) {
+#ifdef USE_FMA
+		return _mm256_fmadd_pd(a, b, accumulator);
+#else
+		return _mm256_add_pd(_mm256_mul_pd(a, b), accumulator);
+#endif
+	}
+};
+
+#elif defined(USE_SIMD)
+
+template<>
+struct SimdLanes<float> {
+	typedef __m128 Vector;
+	static const int width = 4;
+	static Vector zero() { return _mm_setzero_ps(); }
+	static Vector load(const float* p) { return _mm_load_ps(p); }
+	static void store(float* p, Vector v) { _mm_store_ps(p, v); }
+	static Vector broadcast(float x) { return _mm_set1_ps(x); }
+	static Vector multiplyAdd(Vector accumulator, Vector a, Vector b) { return _mm_add_ps(_mm_mul_ps(a, b), accumulator); }
+};
+
+#ifdef USE_SIMD_FOR_DOUBLES
+template<>
+struct SimdLanes<double> {
+	typedef __m128d Vector;
+	static const int width = 2;
+	static Vector zero() { return _mm_setzero_pd(); }
+	static Vector load(const double* p) { return _mm_load_pd(p); }
+	static void store(double* p, Vector v) { _mm_store_pd(p, v); }
+	static Vector broadcast(double x) { return _mm_set1_pd(x); }
+	static Vector multiplyAdd(Vector accumulator, Vector a, Vector b) { return _mm_add_pd(_mm_mul_pd(a, b), accumulator); }
+};
+#endif
+
+#endif
+
+// useChannelVectorisation() : true if channel-vectorised conversion is possible, and worthwhile, for this number of channels and precision.
+// (It is not used with extended precision, whose compensated accumulation it doesn't implement. Its results differ slightly
+// from those of per-channel conversion - see note above - so it is only used with --vectoriseChannels)
+template<typename FloatType>
+bool useChannelVectorisation(int numChannels, bool bExtendedPrecision) {
+
+#ifdef FIR_QUAD_PRECISION
+	return false;
+#else
+	return !bExtendedPrecision && numChannels >= std::max(MC_MIN_CHANNELS, SimdLanes<FloatType>::width);
+#endif
+
+}
+
+// class MultichannelFIRFilter : FIR filter for several channels, with frame-interleaved signal history.
+// put() and get() take / produce one interleaved frame (numChannels samples) at a time.
+// The arrangement of the history (reverse order, in a double-length buffer) and the taps is the same as in FIRFilter.
+
+template<typename FloatType>
+class MultichannelFIRFilter {
+public:
+	// (if an arena is given, the buffers are allocated from it; see FIRFilter)
+	MultichannelFIRFilter(const std::vector<FloatType>& taps, int numChannels, Arena* arena = nullptr) :
+		taps(taps), length(static_cast<int>(taps.size())), numChannels(numChannels), currentIndex(length - 1), lastPut(0), ownsBuffers(arena == nullptr)
+	{
+		const int width = SimdLanes<FloatType>::width;
+		stride = (numChannels + width - 1) / width * width; // (channels padded to a whole number of vectors)
+		if (arena != nullptr) {
+			signal = arena->allocateArray<FloatType>(static_cast<size_t>(2 * length) * stride, ALIGNMENT_SIZE);
+			result = arena->allocateArray<FloatType>(stride, ALIGNMENT_SIZE);
+		}
+		else {
+			signal = static_cast<FloatType*>(aligned_malloc(2 * length * stride * sizeof(FloatType), ALIGNMENT_SIZE));
+			result = static_cast<FloatType*>(aligned_malloc(stride * sizeof(FloatType), ALIGNMENT_SIZE));
+		}
+		reset();
+	}
+
+	~MultichannelFIRFilter() {
+		if (ownsBuffers) {
+			aligned_free(signal);
+			aligned_free(result);
+		}
+	}
+
+	MultichannelFIRFilter(const MultichannelFIRFilter&) = delete;
+	MultichannelFIRFilter& operator= (const MultichannelFIRFilter&) = delete;
+
+	MultichannelFIRFilter(MultichannelFIRFilter&& other) noexcept :
+		taps(std::move(other.taps)), length(other.length), numChannels(other.numChannels), stride(other.stride),
+		signal(other.signal), result(other.result), currentIndex(other.currentIndex), lastPut(other.lastPut), ownsBuffers(other.ownsBuffers)
+	{
+		other.signal = nullptr;
+		other.result = nullptr;
+	}
+
+	// reset() : clear the history, and set the write position to where it would be after 'position' frames had been put (see FIRFilter::reset())
+	void reset(uint64_t position = 0) {
+		currentIndex = length - 1 - static_cast<int>(position % static_cast<uint64_t>(length));
+		lastPut = 0;
+		memset(signal, 0, 2 * length * stride * sizeof(FloatType));
+	}
+
+	void put(const FloatType* frame) {
+		memcpy(signal + currentIndex * stride, frame, numChannels * sizeof(FloatType));
+		lastPut = currentIndex;
+		advance();
+	}
+
+	void putZero() {
+		memset(signal + currentIndex * stride, 0, numChannels * sizeof(FloatType));
+		advance();
+	}
+
+	// skipZeros() : equivalent to calling putZero() n times, provided that the history holds nothing but zeros (see FIRFilter::skipZeros())
+	void skipZeros(uint64_t n) {
+		if (n > static_cast<uint64_t>(currentIndex)) { // (passes the wrap point: the upper half may still hold the history from before the zeros)
+			memcpy(signal + length * stride, signal, length * stride * sizeof(FloatType)); // copy history to upper half of buffer
+		}
+		currentIndex -= static_cast<int>(n % static_cast<uint64_t>(length));
+		if (currentIndex < 0) {
+			currentIndex += length; // Wrap
+		}
+	}
+
+	void get(FloatType* frame) {
+		calculate(frame, 0, 1);
+	}
+
+	// lazyGet() : skips stuffed-zeros introduced by interpolation, by only using every Lth tap from lastPut (see FIRFilter::lazyGet())
+	void lazyGet(int L, FloatType* frame) {
+		int offset = lastPut - currentIndex;
+		if (offset < 0) { // Wrap condition
+			offset += length;
+		}
+		calculate(frame, offset, L);
+	}
+
+	int getLength() const {
+		return length;
+	}
+
+	// getMemorySize() : size (in bytes) of the signal buffer and taps
+	size_t getMemorySize() const {
+		return (static_cast<size_t>(2 * length) * stride + length) * sizeof(FloatType);
+	}
+
+private:
+	std::vector<FloatType> taps;
+	int length;
+	int numChannels;
+	int stride;			// distance between frames in signal buffer (numChannels, rounded up to a multiple of the vector width)
+	FloatType* signal;	// double-length signal buffer (2 * length frames)
+	FloatType* result;	// one frame of output (stride samples)
+	int currentIndex;
+	int lastPut;
+	bool ownsBuffers;	// (false: buffers are in an arena, which owns them)
+
+	void advance() {
+		if (currentIndex == 0) {
+			currentIndex = length - 1; // Wrap
+			memcpy(signal + length * stride, signal, length * stride * sizeof(FloatType)); // copy history to upper half of buffer
+		}
+		else
+			--currentIndex;
+	}
+
+	// calculate() : sum of taps[i] * history[i] (for i = first, first + step, ...), for all channels
+	void calculate(FloatType* frame, int first, int step) {
+		const int width = SimdLanes<FloatType>::width;
+		const FloatType* history = signal + currentIndex * stride;
+		for (int lane = 0; lane < stride; ) { // (as many vectors as possible in each pass through the history)
+			switch (std::min((stride - lane) / width, MC_VECTORS_PER_PASS)) {
+			case 1:
+				accumulate<1>(history, lane, first, step);
+				lane += width;
+				break;
+			case 2:
+				accumulate<2>(history, lane, first, step);
+				lane += 2 * width;
+				break;
+			case 3:
+				accumulate<3>(history, lane, first, step);
+				lane += 3 * width;
+				break;
+			default:
+				accumulate<MC_VECTORS_PER_PASS>(history, lane, first, step);
+				lane += MC_VECTORS_PER_PASS * width;
+				break;
+			}
+		}
+		memcpy(frame, result, numChannels * sizeof(FloatType));
+	}
+
+	// accumulate() : calculate numVectors vectors of channels (starting at lane) into result
+	template<int numVectors>
+	void accumulate(const FloatType* history, int lane, int first, int step) {
+		typedef SimdLanes<FloatType> V;
+		const int width = V::width;
+		typename V::Vector accumulators[numVectors];
+		for (int v = 0; v < numVectors; v++) {
+			accumulators[v] = V::zero();
+		}
+		const FloatType* s = history + first * stride + lane;
+		for (int i = first; i < length; i += step, s += step * stride) {
+			typename V::Vector k = V::broadcast(taps[i]);
+			for (int v = 0; v < numVectors; v++) {
+				accumulators[v] = V::multiplyAdd(accumulators[v], V::load(s + v * width), k);
+			}
+		}
+		for (int v = 0; v < numVectors; v++) {
+			V::store(result + lane + v * width, accumulators[v]);
+		}
+	}
+};
+
+// class MultichannelResamplingStage : the multichannel equivalent of ResamplingStage. Input and output are interleaved frames.
+
+template<typename FloatType>
+class MultichannelResamplingStage
+{
+public:
+	MultichannelResamplingStage(const ResamplingStage<FloatType>& prototype, int numChannels, Arena* arena = nullptr) :
+		L(prototype.getL()), M(prototype.getM()), m(0), numChannels(numChannels),
+		filter(prototype.getFilterTaps(), numChannels, arena), bypassMode(prototype.isBypassMode()), bSilenceFastPath(prototype.hasSilenceFastPath()), bProfile(false), tapsPerOutput(0.0),
+		zeroRun(0), silentThreshold(static_cast<uint64_t>((filter.getLength() + L - 1) / L))
+	{
+		SetConvertFunction();
+		zeroRun = silentThreshold; // (history starts out clear)
+	}
+
+	void convert(FloatType* outBuffer, size_t& outFrames, const FloatType* inBuffer, const size_t& inFrames) {
+		if (bProfile) {
+			ProfileScope scope(&profileRecord);
+			bool silent = convertBlock(outBuffer, outFrames, inBuffer, inFrames);
+			profileRecord.frames += outFrames;
+			if (silent)
+				profileRecord.silentFrames += outFrames * numChannels;
+			else
+				profileRecord.macs += static_cast<uint64_t>(outFrames * tapsPerOutput * numChannels);
+		}
+		else {
+			convertBlock(outBuffer, outFrames, inBuffer, inFrames);
+		}
+	}
+
+	void setProfiling(bool bProfile) {
+		MultichannelResamplingStage::bProfile = bProfile;
+	}
+
+	const ProfileRecord& getProfile() const {
+		return profileRecord;
+	}
+
+	int getL() const {
+		return L;
+	}
+
+	int getM() const {
+		return M;
+	}
+
+	int getFilterLength() const {
+		return filter.getLength();
+	}
+
+	size_t getFilterMemorySize() const {
+		return filter.getMemorySize();
+	}
+
+	// reset() : clear the filter, and set the phase to what it would be after inputPosition input frames
+	void reset(uint64_t inputPosition = 0) {
+		filter.reset(inputPosition * L);
+		m = static_cast<int>(inputPosition * L % M);
+		zeroRun = silentThreshold;
+	}
+
+private:
+	int L;	// interpoLation factor
+	int M;	// deciMation factor
+	int m;	// decimation index
+	int numChannels;
+	MultichannelFIRFilter<FloatType> filter;
+	bool bypassMode;
+	bool bSilenceFastPath;
+	bool bProfile;
+	double tapsPerOutput; // average number of filter taps evaluated per output frame
+	ProfileRecord profileRecord;
+	uint64_t zeroRun;			// number of consecutive frames of zeros (in all channels) at the end of the input so far
+	uint64_t silentThreshold;	// length of a run of zero input frames which leaves nothing but zeros in the filter's history
+
+	typedef void (MultichannelResamplingStage::*ConvertFunction) (FloatType* outBuffer, size_t& outFrames, const FloatType* inBuffer, const size_t& inFrames);
+	ConvertFunction convertFn;
+
+	// convertBlock() : convert a block of input frames, taking the digital silence fast path where possible (see ResamplingStage::convertBlock())
+	bool convertBlock(FloatType* outBuffer, size_t& outFrames, const FloatType* inBuffer, const size_t& inFrames) {
+		const size_t inSamples = inFrames * numChannels;
+		if (bSilenceFastPath && !bypassMode && zeroRun >= silentThreshold && countTrailingZeros(inBuffer, inSamples) == inSamples) {
+			outFrames = countOutputs(L, M, m, inFrames);
+			memset(outBuffer, 0, outFrames * numChannels * sizeof(FloatType));
+			filter.skipZeros(static_cast<uint64_t>(inFrames) * L);
+			zeroRun += inFrames;
+			return true;
+		}
+		(this->*convertFn)(outBuffer, outFrames, inBuffer, inFrames);
+		size_t zeroFrames = countTrailingZeros(inBuffer, inSamples) / numChannels;
+		zeroRun = (zeroFrames == inFrames) ? zeroRun + zeroFrames : zeroFrames;
+		return false;
+	}
+
+	void passThrough(FloatType* outBuffer, size_t& outFrames, const FloatType* inBuffer, const size_t& inFrames) {
+		memcpy(outBuffer, inBuffer, inFrames * numChannels * sizeof(FloatType));
+		outFrames = inFrames;
+	}
+
+	void filterOnly(FloatType* outBuffer, size_t& outFrames, const FloatType* inBuffer, const size_t& inFrames) {
+		for (size_t i = 0; i < inFrames; ++i) {
+			filter.put(inBuffer + i * numChannels);
+			filter.get(outBuffer + i * numChannels);
+		}
+		outFrames = inFrames;
+	}
+
+	void interpolate(FloatType* outBuffer, size_t& outFrames, const FloatType* inBuffer, const size_t& inFrames) {
+		size_t o = 0;
+		for (size_t i = 0; i < inFrames; ++i) {
+			for (int l = 0; l < L; ++l) {
+				((l == 0) ? filter.put(inBuffer + i * numChannels) : filter.putZero());
+
+#ifdef USE_LAZYGET_ON_INTERPOLATE
+				filter.lazyGet(L, outBuffer + o * numChannels);
+#else
+				filter.get(outBuffer + o * numChannels);
+#endif
+
+				++o;
+			}
+		}
+		outFrames = o;
+	}
+
+	void decimate(FloatType* outBuffer, size_t& outFrames, const FloatType* inBuffer, const size_t& inFrames) {
+		size_t o = 0;
+		int localm = m;
+		for (size_t i = 0; i < inFrames; ++i) {
+			filter.put(inBuffer + i * numChannels);
+			if (localm == 0) {
+				filter.get(outBuffer + o * numChannels);
+				++o;
+			}
+			if (++localm == M) {
+				localm = 0;
+			}
+		}
+		outFrames = o;
+		m = localm;
+	}
+
+	void interpolateAndDecimate(FloatType* outBuffer, size_t& outFrames, const FloatType* inBuffer, const size_t& inFrames) {
+		size_t o = 0;
+		int localm = m;
+		for (size_t i = 0; i < inFrames; ++i) {
+			for (int l = 0; l < L; ++l) {
+				((l == 0) ? filter.put(inBuffer + i * numChannels) : filter.putZero());
+				if (localm == 0) {
+
+#ifdef USE_LAZYGET_ON_INTERPOLATE_DECIMATE
+					filter.lazyGet(L, outBuffer + o * numChannels);
+#else
+					filter.get(outBuffer + o * numChannels);
+#endif
+
+					++o;
+				}
+				if (++localm == M) {
+					localm = 0;
+				}
+			}
+		}
+		outFrames = o;
+		m = localm;
+	}
+
+	void SetConvertFunction() {
+		const double length = filter.getLength();
+		if (bypassMode) {
+			convertFn = &MultichannelResamplingStage::passThrough;
+			tapsPerOutput = 0.0;
+		}
+		else if (L == 1 && M == 1) {
+			convertFn = &MultichannelResamplingStage::filterOnly;
+			tapsPerOutput = length;
+		}
+		else if (L != 1 && M == 1) {
+			convertFn = &MultichannelResamplingStage::interpolate;
+#ifdef USE_LAZYGET_ON_INTERPOLATE
+			tapsPerOutput = length / L;
+#else
+			tapsPerOutput = length;
+#endif
+		}
+		else if (L == 1 && M != 1) {
+			convertFn = &MultichannelResamplingStage::decimate;
+			tapsPerOutput = length;
+		}
+		else {
+			convertFn = &MultichannelResamplingStage::interpolateAndDecimate;
+#ifdef USE_LAZYGET_ON_INTERPOLATE_DECIMATE
+			tapsPerOutput = length / L;
+#else
+			tapsPerOutput = length;
+#endif
+		}
+	}
+};
+
+// class MultichannelConverter : converts interleaved frames of numChannels channels, using the stages (and sub-block size) of a prototype Converter.
+// The prototype also provides the gain, group delay, latency, alignment, pre-roll and maximum output size, which are the same for all channels.
+
+template<typename FloatType>
+class MultichannelConverter
+{
+public:
+	MultichannelConverter(const Converter<FloatType>& prototype, int numChannels) :
+		numChannels(numChannels), subBlockSize(prototype.getSubBlockSize())
+	{
+		convertStages.reserve(prototype.getStages().size());
+		for (const auto& stage : prototype.getStages()) {
+			convertStages.emplace_back(stage, numChannels, &arena);
+		}
+		numStages = static_cast<int>(convertStages.size());
+		indexOfLastStage = numStages - 1;
+		for (size_t size : prototype.getIntermediateBufferSizes(subBlockSize)) {
+			intermediateBufferSizes.push_back(size * numChannels);
+			intermediateOutputBuffers.push_back(arena.allocateArray<FloatType>(size * numChannels, ALIGNMENT_SIZE));
+		}
+	}
+
+	// convert() : convert inFrames interleaved frames. outBuffer must have room for (prototype's) getMaxOutputFrames() frames
+	void convert(FloatType* outBuffer, size_t& outFrames, const FloatType* inBuffer, const size_t& inFrames) {
+		// depth-first, one sub-block at a time (see Converter::convert())
+		size_t outTotal = 0;
+		for (size_t start = 0; start < inFrames; start += subBlockSize) {
+			const FloatType* in = inBuffer + start * numChannels;
+			size_t inSize = std::min(subBlockSize, inFrames - start);
+			size_t outSize = 0;
+			for (int i = 0; i < numStages; i++) {
+				FloatType* out = (i == indexOfLastStage) ? outBuffer + outTotal * numChannels : intermediateOutputBuffers[i];
+				convertStages[i].convert(out, outSize, in, inSize);
+				in = out;
+				inSize = outSize;
+			}
+			outTotal += outSize;
+		}
+		outFrames = outTotal;
+	}
+
+	// reset() : clear all filter history, ready to convert from input frame inputPosition (see Converter::reset())
+	void reset(uint64_t inputPosition = 0) {
+		uint64_t stageInputPosition = inputPosition;
+		for (int i = 0; i < numStages; i++) {
+			convertStages[i].reset(stageInputPosition);
+			stageInputPosition = stageInputPosition * convertStages[i].getL() / convertStages[i].getM();
+			if (i != indexOfLastStage) {
+				std::fill(intermediateOutputBuffers[i], intermediateOutputBuffers[i] + intermediateBufferSizes[i], 0.0);
+			}
+		}
+	}
+
+	int getNumChannels() const {
+		return numChannels;
+	}
+
+	// getMemorySize() : memory (in bytes) used by the filters and intermediate buffers
+	size_t getMemorySize() const {
+		size_t bytes = 0;
+		for (const auto& stage : convertStages) {
+			bytes += stage.getFilterMemorySize();
+		}
+		for (size_t size : intermediateBufferSizes) {
+			bytes += size * sizeof(FloatType);
+		}
+		return bytes;
+	}
+
+	void setProfiling(bool bProfile) {
+		for (auto& stage : convertStages) {
+			stage.setProfiling(bProfile);
+		}
+	}
+
+	// getStageProfiles() : returns the statistics for each stage (for all channels), labelled with the stage's parameters
+	std::vector<std::pair<std::string, ProfileRecord>> getStageProfiles() const {
+		std::vector<std::pair<std::string, ProfileRecord>> profiles;
+		for (int i = 0; i < numStages; i++) {
+			const MultichannelResamplingStage<FloatType>& stage = convertStages[i];
+			std::string name = "stage " + std::to_string(i + 1) + " (" + std::to_string(stage.getL()) + "/" + std::to_string(stage.getM()) +
+				", " + std::to_string(stage.getFilterLength()) + " taps, " + std::to_string(numChannels) + " channels)";
+			profiles.emplace_back(name, stage.getProfile());
+		}
+		return profiles;
+	}
+
+private:
+	Arena arena; // (all filter histories and intermediate buffers)
+	int numChannels;
+	size_t subBlockSize;
+	std::vector<MultichannelResamplingStage<FloatType>> convertStages;
+	int numStages;
+	int indexOfLastStage;
+	std::vector<FloatType*> intermediateOutputBuffers; // interleaved (in arena)
+	std::vector<size_t> intermediateBufferSizes;
+};
+
+#endif // MCCONVERT_H
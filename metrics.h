@@ -0,0 +1,347 @@
+/*
+* Copyright (C) 2016 - 2019 Judd Niemann - All Rights Reserved.
+* You may use, distribute and modify this code under the
+* terms of the GNU Lesser General Public License, version 2.1
+*
+* You should have received a copy of GNU Lesser General Public License v2.1
+* with this file. If not, please refer to: https://github.com/jniemann66/ReSampler
+*/
+
+// metrics.h : machine-readable live progress and throughput metrics (--metrics)
+
+// A MetricsReporter periodically emits a snapshot of the conversion's progress, for the benefit of job schedulers:
+// the current phase (peak scan, convert, clipping retry, temp pass, done), frames processed, speed (x realtime), peak levels,
+// and the utilisation of each worker (the share of wall time spent converting a channel, or all channels).
+// Destinations:
+//  - fd:N : JSON lines, written to file descriptor N (eg one end of a pipe inherited from the scheduler).
+//    If the reader goes away, reporting stops, and the conversion carries on (SIGPIPE is ignored, so that writing to the closed pipe doesn't end the process)
+//  - a filename ending in .prom : a Prometheus textfile (eg for node_exporter's textfile collector), atomically replaced on each update
+//  - any other filename : JSON lines, written to that file
+
+#ifndef METRICS_H
+#define METRICS_H 1
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cerrno>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#if defined(_WIN32) || defined(_WIN64)
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+class MetricsReporter {
+public:
+	enum Phase {
+		idle,
+		peakScan,
+		convert,
+		tempPass,
+		done,
+		failed
+	};
+
+	// class BusyScope : adds the elapsed time between construction and destruction to a worker's busy time (does nothing if given nullptr)
+	class BusyScope {
+	public:
+		explicit BusyScope(std::atomic<uint64_t>* busy) : busy(busy) {
+			if (busy != nullptr)
+				start = std::chrono::steady_clock::now();
+		}
+
+		~BusyScope() {
+			if (busy != nullptr) {
+				auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+				busy->fetch_add(static_cast<uint64_t>(ns), std::memory_order_relaxed);
+			}
+		}
+
+		BusyScope(const BusyScope&) = delete;
+		BusyScope& operator=(const BusyScope&) = delete;
+
+	private:
+		std::atomic<uint64_t>* busy;
+		std::chrono::steady_clock::time_point start;
+	};
+
+	MetricsReporter() = default;
+
+	~MetricsReporter() {
+		if (isOpen() && phase != done) { // (conversion abandoned)
+			phase = failed;
+			emit();
+		}
+	}
+
+	MetricsReporter(const MetricsReporter&) = delete;
+	MetricsReporter& operator=(const MetricsReporter&) = delete;
+
+	// open() : open the destination (see above). interval is the time between updates, in seconds.
+	// Returns false if the destination can't be opened.
+	bool open(const std::string& destination, double interval, int numWorkers) {
+		this->interval = interval;
+		setWorkers(numWorkers);
+		startTime = lastTime = std::chrono::steady_clock::now();
+		if (destination.compare(0, 3, "fd:") == 0) {
+			char* end = nullptr;
+			long n = std::strtol(destination.c_str() + 3, &end, 10);
+			if (end == destination.c_str() + 3 || *end != '\0' || n < 0)
+				return false;
+			fd = static_cast<int>(n); // (belongs to whoever opened it: left open)
+
+#ifdef SIGPIPE
+			std::signal(SIGPIPE, SIG_IGN); // (a write to a pipe with no reader fails with EPIPE instead)
+#endif
+
+			return true;
+		}
+		if (destination.size() > 5 && destination.compare(destination.size() - 5, 5, ".prom") == 0) {
+			promFilename = destination;
+			std::ofstream f(promFilename + ".tmp"); // (check that it can be written)
+			if (!f.is_open())
+				return false;
+			f.close();
+			std::remove((promFilename + ".tmp").c_str());
+			return true;
+		}
+		jsonFile.open(destination, std::ios::out | std::ios::trunc);
+		return jsonFile.is_open();
+	}
+
+	bool isOpen() const {
+		return fd >= 0 || !promFilename.empty() || jsonFile.is_open();
+	}
+
+	// setWorkers() : set the number of workers whose utilisation is reported
+	void setWorkers(int numWorkers) {
+		workers = std::max(1, numWorkers);
+		busy.reset(new std::atomic<uint64_t>[workers]);
+		for (int w = 0; w < workers; w++) {
+			busy[w].store(0, std::memory_order_relaxed);
+		}
+		lastBusy.assign(workers, 0);
+		utilisation.assign(workers, 0.0);
+	}
+
+	// busyCounter() : busy-time counter of a worker, for use with a BusyScope (nullptr if not reporting)
+	std::atomic<uint64_t>* busyCounter(int worker) {
+		return (isOpen() && worker < workers) ? &busy[worker] : nullptr;
+	}
+
+	// setPhase() : enter a phase of the conversion. pass counts the attempts made (> 1 after clipping was detected),
+	// totalFrames is the number of frames the phase is to process, and sampleRate the rate at which they play (for speed).
+	// A change of phase is reported immediately.
+	void setPhase(Phase phase, int pass, int64_t totalFrames, int sampleRate) {
+		if (!isOpen())
+			return;
+		bool changed = (phase != this->phase || pass != this->pass);
+		this->phase = phase;
+		this->pass = pass;
+		this->totalFrames = totalFrames;
+		this->sampleRate = sampleRate;
+		frames = lastFrames = 0;
+		phaseStartTime = std::chrono::steady_clock::now();
+		if (changed && phase != done && phase != failed)
+			emit();
+	}
+
+	// update() : record progress through the current phase (peak is the input peak while scanning, and the output peak otherwise),
+	// and report it if the interval has elapsed
+	void update(int64_t frames, double peak) {
+		if (!isOpen())
+			return;
+		this->frames = frames;
+		if (phase == peakScan)
+			peakInput = peak;
+		else
+			peakOutput = peak;
+		if (std::chrono::duration<double>(std::chrono::steady_clock::now() - lastTime).count() >= interval)
+			emit();
+	}
+
+	// finish() : report the final state
+	void finish(double peakOutput) {
+		if (!isOpen())
+			return;
+		this->peakOutput = peakOutput;
+		phase = done;
+		emit();
+	}
+
+private:
+	int fd = -1;
+	std::ofstream jsonFile;
+	std::string promFilename;
+	double interval = 1.0;
+
+	Phase phase = idle;
+	int pass = 1;
+	int64_t frames = 0;
+	int64_t totalFrames = 0;
+	int sampleRate = 0;
+	double peakInput = 0.0;
+	double peakOutput = 0.0;
+
+	int workers = 1;
+	std::unique_ptr<std::atomic<uint64_t>[]> busy;
+	std::vector<uint64_t> lastBusy;
+	std::vector<double> utilisation;
+
+	std::chrono::steady_clock::time_point startTime;
+	std::chrono::steady_clock::time_point phaseStartTime;
+	std::chrono::steady_clock::time_point lastTime;
+	int64_t lastFrames = 0;
+	double speed = 0.0;
+
+	// getPhaseName() : name of the current phase (a conversion redone after clipping was detected is a clipping retry)
+	const char* getPhaseName() const {
+		switch (phase) {
+		case peakScan:
+			return "peak scan";
+		case convert:
+			return pass > 1 ? "clipping retry" : "convert";
+		case tempPass:
+			return "temp pass";
+		case done:
+			return "done";
+		case failed:
+			return "failed";
+		default:
+			return "idle";
+		}
+	}
+
+	// emit() : take a snapshot (speed and utilisation since the previous one) and write it out
+	void emit() {
+		auto now = std::chrono::steady_clock::now();
+		double elapsed = std::chrono::duration<double>(now - lastTime).count();
+		if (elapsed > 0.0) {
+			speed = (sampleRate > 0) ? (frames - lastFrames) / (elapsed * sampleRate) : 0.0;
+			for (int w = 0; w < workers; w++) {
+				uint64_t b = busy[w].load(std::memory_order_relaxed);
+				utilisation[w] = std::min(1.0, (b - lastBusy[w]) * 1.0e-9 / elapsed);
+				lastBusy[w] = b;
+			}
+		}
+		lastTime = now;
+		lastFrames = frames;
+
+		if (promFilename.empty())
+			writeLine(toJson(now));
+		else
+			writeTextfile(toPrometheus(now));
+	}
+
+	std::string toJson(std::chrono::steady_clock::time_point now) const {
+		double phaseTime = std::chrono::duration<double>(now - phaseStartTime).count();
+		std::ostringstream os;
+		os << std::fixed << std::setprecision(3)
+			<< "{\"time\": " << std::chrono::duration<double>(now - startTime).count()
+			<< ", \"phase\": \"" << getPhaseName() << "\""
+			<< ", \"pass\": " << pass
+			<< ", \"frames\": " << frames
+			<< ", \"totalFrames\": " << totalFrames
+			<< ", \"progress\": " << ((totalFrames > 0) ? std::min(1.0, static_cast<double>(frames) / totalFrames) : 0.0)
+			<< ", \"speed\": " << speed
+			<< ", \"averageSpeed\": " << ((sampleRate > 0 && phaseTime > 0.0) ? frames / (phaseTime * sampleRate) : 0.0)
+			<< std::setprecision(6)
+			<< ", \"peakInput\": " << peakInput
+			<< ", \"peakOutput\": " << peakOutput
+			<< std::setprecision(3)
+			<< ", \"utilisation\": [";
+		for (int w = 0; w < workers; w++) {
+			os << (w == 0 ? "" : ", ") << utilisation[w];
+		}
+		os << "]}\n";
+		return os.str();
+	}
+
+	std::string toPrometheus(std::chrono::steady_clock::time_point now) const {
+		static const char* phaseNames[] = { "idle", "peak scan", "convert", "clipping retry", "temp pass", "done", "failed" };
+		std::string current(getPhaseName());
+		std::ostringstream os;
+		os << std::fixed << std::setprecision(6);
+		os << "# HELP resampler_phase Current phase of the conversion (1 = current)\n# TYPE resampler_phase gauge\n";
+		for (const char* name : phaseNames) {
+			os << "resampler_phase{phase=\"" << name << "\"} " << (current == name ? 1 : 0) << "\n";
+		}
+		os << "# HELP resampler_pass Conversion attempt (greater than 1 after clipping was detected)\n# TYPE resampler_pass gauge\n"
+			<< "resampler_pass " << pass << "\n"
+			<< "# HELP resampler_frames Frames processed in the current phase\n# TYPE resampler_frames gauge\n"
+			<< "resampler_frames " << frames << "\n"
+			<< "# HELP resampler_total_frames Frames to be processed in the current phase\n# TYPE resampler_total_frames gauge\n"
+			<< "resampler_total_frames " << totalFrames << "\n"
+			<< "# HELP resampler_speed Processing speed (x realtime)\n# TYPE resampler_speed gauge\n"
+			<< "resampler_speed " << speed << "\n"
+			<< "# HELP resampler_peak_input Peak input sample\n# TYPE resampler_peak_input gauge\n"
+			<< "resampler_peak_input " << peakInput << "\n"
+			<< "# HELP resampler_peak_output Peak output sample\n# TYPE resampler_peak_output gauge\n"
+			<< "resampler_peak_output " << peakOutput << "\n"
+			<< "# HELP resampler_elapsed_seconds Time since the conversion started\n# TYPE resampler_elapsed_seconds gauge\n"
+			<< "resampler_elapsed_seconds " << std::chrono::duration<double>(now - startTime).count() << "\n"
+			<< "# HELP resampler_worker_utilisation Share of wall time each worker spent converting\n# TYPE resampler_worker_utilisation gauge\n";
+		for (int w = 0; w < workers; w++) {
+			os << "resampler_worker_utilisation{worker=\"" << w << "\"} " << utilisation[w] << "\n";
+		}
+		return os.str();
+	}
+
+	void writeLine(const std::string& line) {
+		if (fd < 0) {
+			jsonFile << line << std::flush;
+			return;
+		}
+		const char* p = line.data();
+		size_t remaining = line.size();
+		while (remaining > 0) { // (a pipe may take it in pieces)
+
+#if defined(_WIN32) || defined(_WIN64)
+			auto n = _write(fd, p, static_cast<unsigned int>(remaining));
+#else
+			auto n = ::write(fd, p, remaining);
+#endif
+
+			if (n < 0 && errno == EINTR)
+				continue;
+			if (n <= 0) { // (reader has gone away (EPIPE), or other error: stop reporting, and carry on converting regardless)
+				fd = -1;
+				return;
+			}
+			p += n;
+			remaining -= static_cast<size_t>(n);
+		}
+	}
+
+	// writeTextfile() : replace the textfile, so that a collector never sees it half-written
+	void writeTextfile(const std::string& text) {
+		std::string tmpFilename = promFilename + ".tmp";
+		{
+			std::ofstream f(tmpFilename, std::ios::out | std::ios::trunc);
+			if (!f.is_open())
+				return;
+			f << text;
+			if (!f.good())
+				return;
+		}
+
+#if defined(_WIN32) || defined(_WIN64)
+		std::remove(promFilename.c_str()); // (rename() won't replace an existing file on Windows)
+#endif
+
+		std::rename(tmpFilename.c_str(), promFilename.c_str());
+	}
+};
+
+#endif // METRICS_H
@@ -0,0 +1,590 @@
+/*
+* Copyright (C) 2016 - 2019 Judd Niemann - All Rights Reserved.
+* You may use, distribute and modify this code under the
+* terms of the GNU Lesser General Public License, version 2.1
+*
+* You should have received a copy of GNU Lesser General Public License v2.1
+* with this file. If not, please refer to: https://github.com/jniemann66/ReSampler
+*/
+
+// mmapfile.h : memory-mapped input files (--mmap)
+
+// MappedFile : read-only mapping of a whole file, with the OS advised that it will be read sequentially
+// (so that it reads ahead aggressively), and, where supported, that the mapping may use huge pages.
+// HeaderFile : a file opened just to read small parts of it (eg its headers) at given positions, without mapping it.
+// MappedPcmFile : reader for uncompressed PCM / floating-point wav, rf64 and w64 files,
+// which converts samples straight from the mapped file into the caller's buffer
+// (rather than having libsndfile read the file into its own buffer, and then convert from there).
+// It satisfies the FileReader interface used by convert(). Files it can't read (eg compressed or big-endian formats)
+// are left to libsndfile (see MappedPcmFile::canRead()).
+// (The dsf and dff readers also read their sound data straight from a MappedFile, when IOOptions::mmap is set)
+
+#ifndef MMAPFILE_H
+#define MMAPFILE_H 1
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#if defined(_WIN32) || defined(_WIN64)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if defined(_M_X64) || defined(__x86_64__) || defined(USE_SSE2)
+#define MMAPFILE_USE_SSE2
+#include <emmintrin.h>
+#endif
+
+#include "sndfile.h"
+#include "asyncio.h"
+
+#define MMAPFILE_WILLNEED_SIZE (4 << 20) // amount of file to start reading in advance, after a seek (bytes)
+
+class MappedFile
+{
+public:
+	MappedFile() = default; // (not mapped)
+
+	explicit MappedFile(const std::string& path) {
+
+#if defined(_WIN32) || defined(_WIN64)
+		HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+		if (file == INVALID_HANDLE_VALUE)
+			return;
+		LARGE_INTEGER fileSize;
+		if (GetFileSizeEx(file, &fileSize) && fileSize.QuadPart > 0 && static_cast<uint64_t>(fileSize.QuadPart) <= SIZE_MAX) {
+			HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+			if (mapping != nullptr) {
+				p = static_cast<const uint8_t*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+				if (p != nullptr)
+					length = static_cast<size_t>(fileSize.QuadPart);
+				CloseHandle(mapping); // (view keeps mapping alive)
+			}
+		}
+		CloseHandle(file);
+#else
+		int fd = open(path.c_str(), O_RDONLY);
+		if (fd == -1)
+			return;
+		struct stat st;
+		if (fstat(fd, &st) == 0 && st.st_size > 0 && static_cast<uint64_t>(st.st_size) <= SIZE_MAX) {
+			void* m = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+			if (m != MAP_FAILED) {
+				p = static_cast<const uint8_t*>(m);
+				length = static_cast<size_t>(st.st_size);
+				posix_madvise(m, length, POSIX_MADV_SEQUENTIAL);
+
+#ifdef MADV_HUGEPAGE
+				madvise(m, length, MADV_HUGEPAGE); // (only effective on file systems which support huge pages for file data; otherwise ignored)
+#endif
+
+			}
+		}
+		::close(fd); // (mapping stays valid)
+#endif
+
+	}
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	~MappedFile() {
+		if (p == nullptr)
+			return;
+
+#if defined(_WIN32) || defined(_WIN64)
+		UnmapViewOfFile(p);
+#else
+		munmap(const_cast<uint8_t*>(p), length);
+#endif
+
+	}
+
+	bool isOpen() const {
+		return p != nullptr;
+	}
+
+	const uint8_t* data() const {
+		return p;
+	}
+
+	size_t size() const {
+		return length;
+	}
+
+	// willNeed() : start reading the given range of the file in advance (eg after seeking)
+	void willNeed(size_t offset, size_t count) const {
+		if (p == nullptr || offset >= length)
+			return;
+
+#if !defined(_WIN32) && !defined(_WIN64)
+		size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+		size_t start = offset - offset % pageSize;
+		posix_madvise(const_cast<uint8_t*>(p) + start, std::min(count + (offset - start), length - start), POSIX_MADV_WILLNEED);
+#endif
+
+	}
+
+private:
+	const uint8_t* p = nullptr;
+	size_t length = 0;
+};
+
+class HeaderFile
+{
+public:
+	explicit HeaderFile(const std::string& path) {
+
+#if defined(_WIN32) || defined(_WIN64)
+		HANDLE h = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		LARGE_INTEGER fileSize;
+		if (h != INVALID_HANDLE_VALUE && GetFileSizeEx(h, &fileSize)) {
+			file = h;
+			length = static_cast<uint64_t>(fileSize.QuadPart);
+		}
+		else if (h != INVALID_HANDLE_VALUE) {
+			CloseHandle(h);
+		}
+#else
+		int f = open(path.c_str(), O_RDONLY);
+		struct stat st;
+		if (f != -1 && fstat(f, &st) == 0) {
+			fd = f;
+			length = static_cast<uint64_t>(st.st_size);
+		}
+		else if (f != -1) {
+			::close(f);
+		}
+#endif
+
+	}
+
+	HeaderFile(const HeaderFile&) = delete;
+	HeaderFile& operator=(const HeaderFile&) = delete;
+
+	~HeaderFile() {
+
+#if defined(_WIN32) || defined(_WIN64)
+		if (file != INVALID_HANDLE_VALUE)
+			CloseHandle(file);
+#else
+		if (fd != -1)
+			::close(fd);
+#endif
+
+	}
+
+	bool isOpen() const {
+
+#if defined(_WIN32) || defined(_WIN64)
+		return file != INVALID_HANDLE_VALUE;
+#else
+		return fd != -1;
+#endif
+
+	}
+
+	uint64_t size() const {
+		return length;
+	}
+
+	// read() : read count bytes at offset into buffer. Returns false if they couldn't all be read
+	bool read(uint64_t offset, void* buffer, size_t count) const {
+		auto p = static_cast<char*>(buffer);
+		while (count > 0) {
+
+#if defined(_WIN32) || defined(_WIN64)
+			OVERLAPPED overlapped = {};
+			overlapped.Offset = static_cast<DWORD>(offset);
+			overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+			DWORD n = 0;
+			if (!ReadFile(file, p, static_cast<DWORD>(std::min<size_t>(count, 1 << 20)), &n, &overlapped) || n == 0)
+				return false;
+#else
+			ssize_t n = pread(fd, p, count, static_cast<off_t>(offset));
+			if (n < 0 && errno == EINTR)
+				continue;
+			if (n <= 0)
+				return false;
+#endif
+
+			p += n;
+			offset += static_cast<uint64_t>(n);
+			count -= static_cast<size_t>(n);
+		}
+		return true;
+	}
+
+private:
+
+#if defined(_WIN32) || defined(_WIN64)
+	HANDLE file = INVALID_HANDLE_VALUE;
+#else
+	int fd = -1;
+#endif
+
+	uint64_t length = 0;
+};
+
+// conversion of little-endian samples in a file to FloatType (scaled the same way as libsndfile does: integer formats to the range [-1.0, 1.0)):
+
+namespace MappedPcm {
+
+inline int16_t loadInt16(const uint8_t* p) {
+	int16_t v;
+	memcpy(&v, p, sizeof(v)); // (little-endian host)
+	return v;
+}
+
+inline int32_t loadInt32(const uint8_t* p) {
+	int32_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+#ifdef MMAPFILE_USE_SSE2
+
+// storeScaled() : convert 4 int32s to FloatType, scale and store
+inline void storeScaled(float* out, __m128i v, float scale) {
+	_mm_storeu_ps(out, _mm_mul_ps(_mm_cvtepi32_ps(v), _mm_set1_ps(scale)));
+}
+
+inline void storeScaled(double* out, __m128i v, double scale) {
+	const __m128d s = _mm_set1_pd(scale);
+	_mm_storeu_pd(out, _mm_mul_pd(_mm_cvtepi32_pd(v), s));
+	_mm_storeu_pd(out + 2, _mm_mul_pd(_mm_cvtepi32_pd(_mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2))), s));
+}
+
+#endif
+
+template<typename FloatType>
+void convertInt16(FloatType* out, const uint8_t* in, size_t count) {
+	const FloatType scale = static_cast<FloatType>(1.0 / 0x8000);
+	size_t i = 0;
+
+#ifdef MMAPFILE_USE_SSE2
+	for (; i + 8 <= count; i += 8) {
+		__m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + 2 * i));
+		storeScaled(out + i, _mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16), scale); // (sign-extend to 32 bits)
+		storeScaled(out + i + 4, _mm_srai_epi32(_mm_unpackhi_epi16(x, x), 16), scale);
+	}
+#endif
+
+	for (; i < count; i++) {
+		out[i] = static_cast<FloatType>(loadInt16(in + 2 * i)) * scale;
+	}
+}
+
+template<typename FloatType>
+void convertInt24(FloatType* out, const uint8_t* in, size_t count) {
+	const FloatType scale = static_cast<FloatType>(1.0 / 0x800000);
+	for (size_t i = 0; i < count; i++, in += 3) {
+		int32_t v = in[0] | (in[1] << 8) | (static_cast<int8_t>(in[2]) * 65536);
+		out[i] = static_cast<FloatType>(v) * scale;
+	}
+}
+
+template<typename FloatType>
+void convertInt32(FloatType* out, const uint8_t* in, size_t count) {
+	const FloatType scale = static_cast<FloatType>(1.0 / 0x80000000);
+	size_t i = 0;
+
+#ifdef MMAPFILE_USE_SSE2
+	for (; i + 4 <= count; i += 4) {
+		storeScaled(out + i, _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + 4 * i)), scale);
+	}
+#endif
+
+	for (; i < count; i++) {
+		out[i] = static_cast<FloatType>(loadInt32(in + 4 * i)) * scale;
+	}
+}
+
+template<typename FloatType>
+void convertUInt8(FloatType* out, const uint8_t* in, size_t count) {
+	const FloatType scale = static_cast<FloatType>(1.0 / 0x80);
+	for (size_t i = 0; i < count; i++) {
+		out[i] = static_cast<FloatType>(static_cast<int>(in[i]) - 128) * scale;
+	}
+}
+
+template<typename FloatType, typename SampleType>
+void convertFloat(FloatType* out, const uint8_t* in, size_t count) {
+	for (size_t i = 0; i < count; i++) {
+		SampleType v;
+		memcpy(&v, in + i * sizeof(SampleType), sizeof(SampleType));
+		out[i] = static_cast<FloatType>(v);
+	}
+}
+
+} // namespace MappedPcm
+
+class MappedPcmFile
+{
+public:
+	// (the IOOptions parameter is only there to match the other readers' constructors: a mapped file has no use for
+	// asynchronous or direct I/O, so they are ignored)
+	MappedPcmFile(const std::string& path, const IOOptions& /* io */ = IOOptions()) : path(path), map(path) {
+		if (!map.isOpen()) {
+			err = SF_ERR_SYSTEM;
+			return;
+		}
+		fileSize = map.size();
+		if (!isLittleEndianHost() || !readHeaders()) {
+			err = SF_ERR_UNRECOGNISED_FORMAT;
+			return;
+		}
+		err = SF_ERR_NO_ERROR;
+	}
+
+	// canRead() : true if file can be read by a MappedPcmFile (otherwise, use libsndfile).
+	// Only the headers are read (the file isn't mapped)
+	static bool canRead(const std::string& path) {
+		HeaderFile headerFile(path);
+		if (!headerFile.isOpen() || headerFile.size() == 0 || headerFile.size() > SIZE_MAX) // (as for MappedFile)
+			return false;
+		return MappedPcmFile(path, &headerFile).error() == SF_ERR_NO_ERROR;
+	}
+
+	int error() const {
+		return err;
+	}
+
+	unsigned int channels() const {
+		return numChannels;
+	}
+
+	unsigned int samplerate() const {
+		return sampleRate;
+	}
+
+	uint64_t frames() const {
+		return numFrames;
+	}
+
+	// format() : libsndfile format (major format and subformat) of file
+	int format() const {
+		return majorFormat | subFormat;
+	}
+
+	const std::string& getPath() const {
+		return path;
+	}
+
+	// read() : reads count interleaved FloatType samples into buffer. Returns number of samples read
+	template<typename FloatType>
+	uint64_t read(FloatType* buffer, uint64_t count) {
+		uint64_t available = numFrames * numChannels - position;
+		auto n = static_cast<size_t>(std::min(count, available));
+		const uint8_t* in = map.data() + dataOffset + position * bytesPerSample;
+		switch (subFormat) {
+		case SF_FORMAT_PCM_U8:
+			MappedPcm::convertUInt8(buffer, in, n);
+			break;
+		case SF_FORMAT_PCM_16:
+			MappedPcm::convertInt16(buffer, in, n);
+			break;
+		case SF_FORMAT_PCM_24:
+			MappedPcm::convertInt24(buffer, in, n);
+			break;
+		case SF_FORMAT_PCM_32:
+			MappedPcm::convertInt32(buffer, in, n);
+			break;
+		case SF_FORMAT_FLOAT:
+			MappedPcm::convertFloat<FloatType, float>(buffer, in, n);
+			break;
+		case SF_FORMAT_DOUBLE:
+			MappedPcm::convertFloat<FloatType, double>(buffer, in, n);
+			break;
+		}
+		position += n;
+		return n;
+	}
+
+	// seek() : set read position to frame number pos (whence: SEEK_SET, SEEK_CUR or SEEK_END). Returns new position
+	uint64_t seek(int64_t pos, int whence) {
+		int64_t frame = static_cast<int64_t>(position / numChannels);
+		frame = (whence == SEEK_CUR) ? frame + pos : (whence == SEEK_END) ? static_cast<int64_t>(numFrames) + pos : pos;
+		frame = std::max<int64_t>(0, std::min<int64_t>(frame, numFrames));
+		position = static_cast<uint64_t>(frame) * numChannels;
+		map.willNeed(static_cast<size_t>(dataOffset + position * bytesPerSample), MMAPFILE_WILLNEED_SIZE);
+		return static_cast<uint64_t>(frame);
+	}
+
+private:
+	std::string path;
+	MappedFile map;
+	const HeaderFile* headerFile = nullptr; // (only when probing: see canRead())
+	uint64_t fileSize = 0;
+	int err = SF_ERR_UNRECOGNISED_FORMAT;
+	int majorFormat = 0;
+	int subFormat = 0;
+	unsigned int numChannels = 0;
+	unsigned int sampleRate = 0;
+	uint64_t numFrames = 0;
+	size_t bytesPerSample = 0;
+	uint64_t dataOffset = 0;
+	uint64_t position = 0; // (samples)
+
+	// (for canRead() : read the headers from headerFile, without mapping the file)
+	MappedPcmFile(const std::string& path, const HeaderFile* headerFile) : path(path), headerFile(headerFile), fileSize(headerFile->size()) {
+		err = (isLittleEndianHost() && readHeaders()) ? SF_ERR_NO_ERROR : SF_ERR_UNRECOGNISED_FORMAT;
+	}
+
+	static bool isLittleEndianHost() {
+		const uint16_t v = 1;
+		uint8_t b;
+		memcpy(&b, &v, 1);
+		return b == 1;
+	}
+
+	// readAt() : read count bytes of the file, at offset (from the mapping, or from headerFile). Returns false if they are beyond the end of the file
+	bool readAt(uint64_t offset, void* buffer, size_t count) const {
+		if (offset > fileSize || count > fileSize - offset)
+			return false;
+		if (headerFile != nullptr)
+			return headerFile->read(offset, buffer, count);
+		memcpy(buffer, map.data() + offset, count);
+		return true;
+	}
+
+	uint16_t getU16(uint64_t offset) const {
+		uint8_t p[2] = { 0, 0 };
+		readAt(offset, p, 2);
+		return static_cast<uint16_t>(p[0] | (p[1] << 8));
+	}
+
+	uint32_t getU32(uint64_t offset) const {
+		return getU16(offset) | (static_cast<uint32_t>(getU16(offset + 2)) << 16);
+	}
+
+	uint64_t getU64(uint64_t offset) const {
+		return getU32(offset) | (static_cast<uint64_t>(getU32(offset + 4)) << 32);
+	}
+
+	bool hasId(uint64_t offset, const char* id) const {
+		uint8_t b[4];
+		return readAt(offset, b, 4) && memcmp(b, id, 4) == 0;
+	}
+
+	// hasW64Guid() : w64 chunks are identified by GUIDs, which (for the chunks used here) are a 4-character id, followed by a common suffix
+	bool hasW64Guid(uint64_t offset, const char* id) const {
+		static const uint8_t riffSuffix[12] = { 0x2e, 0x91, 0xcf, 0x11, 0xa5, 0xd6, 0x28, 0xdb, 0x04, 0xc1, 0x00, 0x00 };
+		static const uint8_t suffix[12] = { 0xf3, 0xac, 0xd3, 0x11, 0x8c, 0xd1, 0x00, 0xc0, 0x4f, 0x8e, 0xdb, 0x8a };
+		uint8_t b[16];
+		return readAt(offset, b, 16) && memcmp(b, id, 4) == 0 &&
+			memcmp(b + 4, (strcmp(id, "riff") == 0) ? riffSuffix : suffix, 12) == 0;
+	}
+
+	bool readHeaders() {
+		uint64_t dataSize = 0;
+		bool hasFmt = false;
+		bool hasData = false;
+
+		if ((hasId(0, "RIFF") || hasId(0, "RF64") || hasId(0, "BW64")) && hasId(8, "WAVE")) {
+			bool rf64 = !hasId(0, "RIFF");
+			majorFormat = rf64 ? SF_FORMAT_RF64 : SF_FORMAT_WAV;
+			uint64_t ds64DataSize = 0;
+			for (uint64_t pos = 12; pos + 8 <= fileSize; ) {
+				uint64_t chunkSize = getU32(pos + 4);
+				if (hasId(pos, "ds64") && chunkSize >= 16 && pos + 24 <= fileSize) {
+					ds64DataSize = getU64(pos + 16);
+				}
+				else if (hasId(pos, "fmt ")) {
+					hasFmt = readFmt(pos + 8, chunkSize);
+				}
+				else if (hasId(pos, "data")) {
+					hasData = true;
+					dataOffset = pos + 8;
+					dataSize = (rf64 && chunkSize == 0xffffffff) ? ds64DataSize : chunkSize;
+					chunkSize = dataSize;
+				}
+				pos += 8 + chunkSize + (chunkSize & 1); // (chunks are padded to an even length)
+			}
+		}
+
+		else if (hasW64Guid(0, "riff") && hasW64Guid(24, "wave")) {
+			majorFormat = SF_FORMAT_W64;
+			for (uint64_t pos = 40; pos + 24 <= fileSize; ) {
+				uint64_t chunkSize = getU64(pos + 16); // (includes 24-byte chunk header)
+				if (chunkSize < 24)
+					break;
+				if (hasW64Guid(pos, "fmt ")) {
+					hasFmt = readFmt(pos + 24, chunkSize - 24);
+				}
+				else if (hasW64Guid(pos, "data")) {
+					hasData = true;
+					dataOffset = pos + 24;
+					dataSize = chunkSize - 24;
+				}
+				pos += (chunkSize + 7) & ~static_cast<uint64_t>(7); // (chunks are aligned to 8 bytes)
+			}
+		}
+
+		if (!hasFmt || !hasData || dataOffset > fileSize)
+			return false;
+		dataSize = std::min(dataSize, fileSize - dataOffset); // (in case file is truncated)
+		numFrames = dataSize / (bytesPerSample * numChannels);
+		return true;
+	}
+
+	// readFmt() : read fmt chunk. Returns false if the format isn't one which can be read
+	bool readFmt(uint64_t offset, uint64_t chunkSize) {
+		if (chunkSize < 16 || offset + chunkSize > fileSize)
+			return false;
+		uint16_t formatTag = getU16(offset);
+		numChannels = getU16(offset + 2);
+		sampleRate = getU32(offset + 4);
+		uint16_t blockAlign = getU16(offset + 12);
+		uint16_t bitsPerSample = getU16(offset + 14);
+		if (formatTag == 0xfffe && chunkSize >= 40) { // WAVE_FORMAT_EXTENSIBLE: format is in first 2 bytes of SubFormat GUID
+			formatTag = getU16(offset + 24);
+			if (majorFormat == SF_FORMAT_WAV)
+				majorFormat = SF_FORMAT_WAVEX;
+		}
+
+		bytesPerSample = bitsPerSample / 8;
+		if (numChannels == 0 || sampleRate == 0 || bitsPerSample % 8 != 0 || blockAlign != numChannels * bytesPerSample)
+			return false;
+
+		if (formatTag == 1) { // PCM
+			switch (bitsPerSample) {
+			case 8:
+				subFormat = SF_FORMAT_PCM_U8;
+				return true;
+			case 16:
+				subFormat = SF_FORMAT_PCM_16;
+				return true;
+			case 24:
+				subFormat = SF_FORMAT_PCM_24;
+				return true;
+			case 32:
+				subFormat = SF_FORMAT_PCM_32;
+				return true;
+			}
+		}
+		else if (formatTag == 3) { // IEEE floating-point
+			switch (bitsPerSample) {
+			case 32:
+				subFormat = SF_FORMAT_FLOAT;
+				return true;
+			case 64:
+				subFormat = SF_FORMAT_DOUBLE;
+				return true;
+			}
+		}
+		return false;
+	}
+};
+
+#endif // MMAPFILE_H
@@ -26,4 +26,34 @@ typedef uint64_t __int64;
 #define stricmp strcasecmp
 #endif // ends Non-Windows
 
+// getPeakRSS() : returns the peak resident set size of the process, in kilobytes (0 if unavailable)
+
+#if defined(_WIN32)
+#include <windows.h>
+#define PSAPI_VERSION 2 // K32GetProcessMemoryInfo() lives in kernel32 (no need to link psapi)
+#include <psapi.h>
+
+inline long getPeakRSS() {
+	PROCESS_MEMORY_COUNTERS pmc;
+	if (K32GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc)))
+		return static_cast<long>(pmc.PeakWorkingSetSize / 1024);
+	return 0;
+}
+
+#else
+#include <sys/resource.h>
+
+inline long getPeakRSS() {
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) != 0)
+		return 0;
+#if defined(__APPLE__)
+	return static_cast<long>(usage.ru_maxrss / 1024); // bytes on macOS
+#else
+	return static_cast<long>(usage.ru_maxrss); // kilobytes on Linux
+#endif
+}
+
+#endif
+
 #endif // OSSPECIFIC_H
\ No newline at end of file
@@ -0,0 +1,502 @@
+/*
+* Copyright (C) 2016 - 2019 Judd Niemann - All Rights Reserved.
+* You may use, distribute and modify this code under the
+* terms of the GNU Lesser General Public License, version 2.1
+*
+* You should have received a copy of GNU Lesser General Public License v2.1
+* with this file. If not, please refer to: https://github.com/jniemann66/ReSampler
+*/
+
+// pcmwriter.h : native writer for uncompressed output files (--nativeWriter)
+
+// PcmFileWriter : writer for integer PCM / floating-point wav, rf64, w64 and aiff files, used in place of libsndfile:
+//  - the file is preallocated (from the expected size of the output), so that it doesn't have to grow one block at a time
+//  - samples are converted to the output format (with SSE2, where available) straight into the large aligned blocks of an AsyncFile,
+//    which are written behind by its I/O threads, while the conversion carries on
+//  - the header is written up front with placeholder sizes, and patched when the file is closed
+//  - wav files which are expected to be too large for the 32-bit sizes of their header are written as rf64 instead (see getFormat()).
+//    If a wav or aiff file turns out to be too large anyway, close() fails, rather than writing a header with clipped sizes
+// Conversion of floating-point samples to integers is the same as libsndfile's (scaled by 2^(bits - 1) - 1, and rounded to nearest),
+// except that out-of-range values are clipped, rather than wrapped around.
+// No PEAK chunk or metadata is written. Other formats (eg compressed, WAVEX, or big-endian wav) are left to libsndfile
+// (see PcmFileWriter::canWrite()).
+
+#ifndef PCMWRITER_H
+#define PCMWRITER_H 1
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#if defined(_M_X64) || defined(__x86_64__) || defined(USE_SSE2)
+#define PCMWRITER_USE_SSE2
+#include <emmintrin.h>
+#endif
+
+#include "sndfile.h"
+#include "asyncio.h"
+
+// namespace PcmPack : conversion of floating-point samples to the sample format of the output file
+
+namespace PcmPack {
+
+// getMaxInt() : largest FloatType which doesn't exceed the largest signed integer of the given number of bits
+// (for 32 bits, a float can't represent 2^31 - 1 exactly; the largest float below it is 2^31 - 128)
+template<int bits, typename FloatType>
+inline FloatType getMaxInt() {
+	const int64_t maxInt = (INT64_C(1) << (bits - 1)) - 1;
+	FloatType m = static_cast<FloatType>(maxInt);
+	return (static_cast<double>(m) > static_cast<double>(maxInt)) ? std::nextafter(m, FloatType(0)) : m;
+}
+
+// toInt() : scale x (as libsndfile does) to a signed integer of the given number of bits, clipping out-of-range values
+template<int bits, typename FloatType>
+inline int32_t toInt(FloatType x) {
+	const FloatType scale = static_cast<FloatType>((INT64_C(1) << (bits - 1)) - 1);
+	const FloatType limit = static_cast<FloatType>(INT64_C(1) << (bits - 1));
+	FloatType v = x * scale;
+	if (v >= limit)
+		return static_cast<int32_t>((INT64_C(1) << (bits - 1)) - 1);
+	return static_cast<int32_t>(std::lrint(std::max(-limit, std::min(getMaxInt<bits, FloatType>(), v))));
+}
+
+// storeInt() : store the low bytes of v, in the given byte order
+template<int bytes, bool bigEndian>
+inline void storeInt(char* out, int32_t v) {
+	for (int b = 0; b < bytes; b++) {
+		out[bigEndian ? bytes - 1 - b : b] = static_cast<char>(static_cast<uint32_t>(v) >> (8 * b));
+	}
+}
+
+#ifdef PCMWRITER_USE_SSE2
+
+// toInt32x4() : scale, clip and round 4 samples (rounding with the current rounding mode, as lrint() does).
+// Samples which are too large are set to INT32_MAX, which saturates to the right value for 16 bits too
+inline __m128i toInt32x4(const float* in, float scale, float minValue, float maxValue) {
+	__m128 x = _mm_mul_ps(_mm_loadu_ps(in), _mm_set1_ps(scale));
+	__m128i v = _mm_cvtps_epi32(_mm_max_ps(_mm_min_ps(x, _mm_set1_ps(maxValue)), _mm_set1_ps(minValue)));
+	__m128i over = _mm_castps_si128(_mm_cmpge_ps(x, _mm_set1_ps(-minValue))); // (see getMaxInt())
+	return _mm_or_si128(_mm_andnot_si128(over, v), _mm_and_si128(over, _mm_set1_epi32(INT32_MAX)));
+}
+
+inline __m128i toInt32x4(const double* in, double scale, double minValue, double maxValue) {
+	__m128d lo = _mm_mul_pd(_mm_loadu_pd(in), _mm_set1_pd(scale));
+	__m128d hi = _mm_mul_pd(_mm_loadu_pd(in + 2), _mm_set1_pd(scale));
+	lo = _mm_max_pd(_mm_min_pd(lo, _mm_set1_pd(maxValue)), _mm_set1_pd(minValue));
+	hi = _mm_max_pd(_mm_min_pd(hi, _mm_set1_pd(maxValue)), _mm_set1_pd(minValue));
+	return _mm_unpacklo_epi64(_mm_cvtpd_epi32(lo), _mm_cvtpd_epi32(hi));
+}
+
+// packIntSSE2() : convert samples to little-endian 16 or 32-bit integers, 8 at a time. Returns number of samples converted
+template<int bits, typename FloatType>
+inline size_t packIntSSE2(const FloatType* in, char* out, size_t count) {
+	const FloatType scale = static_cast<FloatType>((INT64_C(1) << (bits - 1)) - 1);
+	const FloatType minValue = -static_cast<FloatType>(INT64_C(1) << (bits - 1));
+	const FloatType maxValue = getMaxInt<bits, FloatType>();
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8) {
+		__m128i a = toInt32x4(in + i, scale, minValue, maxValue);
+		__m128i b = toInt32x4(in + i + 4, scale, minValue, maxValue);
+		if (bits == 16) {
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(out + 2 * i), _mm_packs_epi32(a, b));
+		}
+		else {
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(out + 4 * i), a);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(out + 4 * i + 16), b);
+		}
+	}
+	return i;
+}
+
+#endif
+
+template<int bits, bool bigEndian, typename FloatType>
+inline void packInt(const FloatType* in, char* out, size_t count) {
+	size_t i = 0;
+
+#ifdef PCMWRITER_USE_SSE2
+	if (!bigEndian && (bits == 16 || bits == 32))
+		i = packIntSSE2<bits>(in, out, count);
+#endif
+
+	for (; i < count; i++) {
+		storeInt<bits / 8, bigEndian>(out + i * (bits / 8), toInt<bits>(in[i]));
+	}
+}
+
+template<typename FloatType>
+inline void packUInt8(const FloatType* in, char* out, size_t count) {
+	for (size_t i = 0; i < count; i++) {
+		out[i] = static_cast<char>(toInt<8>(in[i]) + 128);
+	}
+}
+
+// packFloat() : store samples as (little-endian) float or double
+template<typename OutType, typename FloatType>
+inline void packFloat(const FloatType* in, char* out, size_t count) {
+	for (size_t i = 0; i < count; i++) {
+		OutType v = static_cast<OutType>(in[i]);
+		memcpy(out + i * sizeof(OutType), &v, sizeof(OutType));
+	}
+}
+
+} // namespace PcmPack
+
+class PcmFileWriter
+{
+public:
+	// expectedFrames : expected length of output (used for preallocating file, and for choosing between wav and rf64)
+	PcmFileWriter(const std::string& path, int format, int channels, int sampleRate, const IOOptions& io, int64_t expectedFrames = 0) :
+		format(promoteToRf64(format, expectedFrames * channels * getBytesPerSample(format))), channels(channels), sampleRate(sampleRate),
+		bytesPerSample(getBytesPerSample(format)), dataOffset(getHeaderSize(PcmFileWriter::format))
+	{
+		IOOptions options(io);
+		options.async = true;
+		file.reset(new AsyncFile(path, AsyncFile::asyncio_write, options));
+		if (!file->isOpen()) {
+			file.reset();
+			return;
+		}
+		if (expectedFrames > 0) {
+			file->preallocate(dataOffset + expectedFrames * channels * bytesPerSample + 1); // (may not be supported; not a problem if it isn't)
+		}
+		std::vector<char> header = makeHeader(0);
+		if (file->write(header.data(), static_cast<int64_t>(header.size())) != static_cast<int64_t>(header.size()))
+			file.reset();
+	}
+
+	PcmFileWriter(const PcmFileWriter&) = delete;
+	PcmFileWriter& operator=(const PcmFileWriter&) = delete;
+
+	~PcmFileWriter() {
+		close();
+	}
+
+	// canWrite() : true if files of the given (libsndfile) format can be written by a PcmFileWriter
+	static bool canWrite(int format) {
+		if ((format & SF_FORMAT_ENDMASK) != SF_ENDIAN_FILE)
+			return false;
+		switch (format & SF_FORMAT_TYPEMASK) {
+		case SF_FORMAT_WAV:
+		case SF_FORMAT_RF64:
+		case SF_FORMAT_W64:
+			switch (format & SF_FORMAT_SUBMASK) {
+			case SF_FORMAT_PCM_U8:
+			case SF_FORMAT_PCM_16:
+			case SF_FORMAT_PCM_24:
+			case SF_FORMAT_PCM_32:
+			case SF_FORMAT_FLOAT:
+			case SF_FORMAT_DOUBLE:
+				return true;
+			default:
+				return false;
+			}
+		case SF_FORMAT_AIFF:
+			switch (format & SF_FORMAT_SUBMASK) {
+			case SF_FORMAT_PCM_S8:
+			case SF_FORMAT_PCM_16:
+			case SF_FORMAT_PCM_24:
+			case SF_FORMAT_PCM_32:
+				return true;
+			default:
+				return false;
+			}
+		default:
+			return false;
+		}
+	}
+
+	bool isOpen() const {
+		return file != nullptr;
+	}
+
+	// getFormat() : format of the file (rf64 instead of wav, if the file is expected to be too large for wav)
+	int getFormat() const {
+		return format;
+	}
+
+	// write() : write count samples (count must be a multiple of the number of channels). Returns number of samples written
+	template<typename FloatType>
+	sf_count_t write(const FloatType* buffer, sf_count_t count) {
+		if (!file)
+			return 0;
+		sf_count_t done = 0;
+		while (done < count) {
+			size_t available = 0;
+			char* p = file->getWriteBuffer(static_cast<int64_t>(count - done) * bytesPerSample, available);
+			if (p == nullptr)
+				break;
+			auto n = static_cast<sf_count_t>(available / bytesPerSample);
+			if (n == 0) { // (less than one sample's worth of space left in block)
+				char sample[8];
+				file->commitWrite(0);
+				pack(buffer + done, sample, 1);
+				if (file->write(sample, bytesPerSample) != bytesPerSample)
+					break;
+				n = 1;
+			}
+			else {
+				pack(buffer + done, p, static_cast<size_t>(n));
+				file->commitWrite(static_cast<size_t>(n) * bytesPerSample);
+			}
+			done += n;
+		}
+		framesWritten = std::max(framesWritten, (file->tell() - dataOffset) / (channels * bytesPerSample));
+		return done;
+	}
+
+	// seek() : set position (in frames) of next write
+	sf_count_t seek(sf_count_t frames, int whence) {
+		if (!file)
+			return -1;
+		int64_t frameBytes = channels * bytesPerSample;
+		int64_t position = (whence == SEEK_SET) ? static_cast<int64_t>(frames) :
+			(whence == SEEK_CUR) ? (file->tell() - dataOffset) / frameBytes + static_cast<int64_t>(frames) :
+			framesWritten + static_cast<int64_t>(frames);
+		position = std::max<int64_t>(0, position);
+		file->seek(dataOffset + position * frameBytes, SEEK_SET);
+		return position;
+	}
+
+	// close() : patch header, write out everything, and close the file.
+	// Returns false if any I/O has failed, or if the file is too large for its format (in which case the header is left with placeholder sizes)
+	bool close() {
+		if (!file)
+			return false;
+		int64_t dataSize = framesWritten * channels * bytesPerSample;
+		bool ok = (dataSize <= getMaxDataSize(format));
+		file->seek(dataOffset + dataSize, SEEK_SET);
+		if ((dataSize & 1) && (format & SF_FORMAT_TYPEMASK) != SF_FORMAT_W64) { // (riff and iff chunks have an even number of bytes)
+			char pad = 0;
+			ok = (file->write(&pad, 1) == 1);
+		}
+		if (ok) {
+			std::vector<char> header = makeHeader(dataSize);
+			file->seek(0, SEEK_SET);
+			ok = (file->write(header.data(), static_cast<int64_t>(header.size())) == static_cast<int64_t>(header.size()));
+		}
+		ok = file->close() && ok;
+		file.reset();
+		return ok;
+	}
+
+private:
+	std::unique_ptr<AsyncFile> file;
+	int format;
+	int channels;
+	int sampleRate;
+	int bytesPerSample;
+	int64_t dataOffset;
+	int64_t framesWritten = 0;
+
+	static int getBytesPerSample(int format) {
+		switch (format & SF_FORMAT_SUBMASK) {
+		case SF_FORMAT_PCM_S8:
+		case SF_FORMAT_PCM_U8:
+			return 1;
+		case SF_FORMAT_PCM_16:
+			return 2;
+		case SF_FORMAT_PCM_24:
+			return 3;
+		case SF_FORMAT_DOUBLE:
+			return 8;
+		default:
+			return 4;
+		}
+	}
+
+	static bool isFloat(int format) {
+		return (format & SF_FORMAT_SUBMASK) == SF_FORMAT_FLOAT || (format & SF_FORMAT_SUBMASK) == SF_FORMAT_DOUBLE;
+	}
+
+	// getMaxDataSize() : largest amount of sound data (in bytes) which the sizes in the header can describe
+	static int64_t getMaxDataSize(int format) {
+		const int64_t max32 = INT64_C(0xffffffff);
+		switch (format & SF_FORMAT_TYPEMASK) {
+		case SF_FORMAT_WAV:
+		case SF_FORMAT_AIFF:
+			return max32 - (getHeaderSize(format) - 8) - 1;		// (RIFF / FORM chunk size, allowing for a pad byte)
+		default:
+			return INT64_MAX;
+		}
+	}
+
+	// promoteToRf64() : if dataSize bytes of sound data won't fit in a wav file of the given format, return the equivalent rf64 format
+	static int promoteToRf64(int format, int64_t dataSize) {
+		if ((format & SF_FORMAT_TYPEMASK) == SF_FORMAT_WAV && dataSize > getMaxDataSize(format))
+			return (format & ~SF_FORMAT_TYPEMASK) | SF_FORMAT_RF64;
+		return format;
+	}
+
+	// getHeaderSize() : size of everything before the sound data (which is the same, whatever the length of the file)
+	static int64_t getHeaderSize(int format) {
+		switch (format & SF_FORMAT_TYPEMASK) {
+		case SF_FORMAT_WAV:
+			return 12 + (isFloat(format) ? 26 + 12 : 24) + 8;				// RIFF, fmt (, fact), data
+		case SF_FORMAT_RF64:
+			return 12 + 36 + (isFloat(format) ? 26 + 12 : 24) + 8;			// RF64, ds64, fmt (, fact), data
+		case SF_FORMAT_W64:
+			return 40 + (isFloat(format) ? 48 + 32 : 40) + 24;				// riff, fmt (, fact), data (each chunk padded to 8 bytes)
+		case SF_FORMAT_AIFF:
+			return 12 + 26 + 16;											// FORM, COMM, SSND
+		default:
+			return 0;
+		}
+	}
+
+	template<typename FloatType>
+	void pack(const FloatType* in, char* out, size_t count) const {
+		bool bigEndian = (format & SF_FORMAT_TYPEMASK) == SF_FORMAT_AIFF;
+		switch (format & SF_FORMAT_SUBMASK) {
+		case SF_FORMAT_PCM_U8:
+			PcmPack::packUInt8(in, out, count);
+			break;
+		case SF_FORMAT_PCM_S8:
+			PcmPack::packInt<8, true>(in, out, count);
+			break;
+		case SF_FORMAT_PCM_16:
+			bigEndian ? PcmPack::packInt<16, true>(in, out, count) : PcmPack::packInt<16, false>(in, out, count);
+			break;
+		case SF_FORMAT_PCM_24:
+			bigEndian ? PcmPack::packInt<24, true>(in, out, count) : PcmPack::packInt<24, false>(in, out, count);
+			break;
+		case SF_FORMAT_PCM_32:
+			bigEndian ? PcmPack::packInt<32, true>(in, out, count) : PcmPack::packInt<32, false>(in, out, count);
+			break;
+		case SF_FORMAT_FLOAT:
+			PcmPack::packFloat<float>(in, out, count);
+			break;
+		case SF_FORMAT_DOUBLE:
+			PcmPack::packFloat<double>(in, out, count);
+			break;
+		}
+	}
+
+	// header construction:
+
+	static void put(std::vector<char>& h, const char* id) {
+		h.insert(h.end(), id, id + 4);
+	}
+
+	template<int bytes>
+	static void putLE(std::vector<char>& h, uint64_t v) {
+		for (int b = 0; b < bytes; b++) {
+			h.push_back(static_cast<char>(v >> (8 * b)));
+		}
+	}
+
+	template<int bytes>
+	static void putBE(std::vector<char>& h, uint64_t v) {
+		for (int b = bytes - 1; b >= 0; b--) {
+			h.push_back(static_cast<char>(v >> (8 * b)));
+		}
+	}
+
+	// putW64Guid() : w64 chunk ids are GUIDs; those used here are a 4-character id, followed by a common suffix
+	static void putW64Guid(std::vector<char>& h, const char* id) {
+		static const uint8_t riffSuffix[12] = { 0x2e, 0x91, 0xcf, 0x11, 0xa5, 0xd6, 0x28, 0xdb, 0x04, 0xc1, 0x00, 0x00 };
+		static const uint8_t suffix[12] = { 0xf3, 0xac, 0xd3, 0x11, 0x8c, 0xd1, 0x00, 0xc0, 0x4f, 0x8e, 0xdb, 0x8a };
+		const uint8_t* s = (strcmp(id, "riff") == 0) ? riffSuffix : suffix;
+		put(h, id);
+		h.insert(h.end(), s, s + 12);
+	}
+
+	// putFmt() : body of fmt chunk (WAVE_FORMAT_PCM or WAVE_FORMAT_IEEE_FLOAT)
+	void putFmt(std::vector<char>& h) const {
+		putLE<2>(h, isFloat(format) ? 3 : 1);
+		putLE<2>(h, channels);
+		putLE<4>(h, sampleRate);
+		putLE<4>(h, static_cast<uint64_t>(sampleRate) * channels * bytesPerSample);
+		putLE<2>(h, channels * bytesPerSample);
+		putLE<2>(h, 8 * bytesPerSample);
+		if (isFloat(format))
+			putLE<2>(h, 0); // cbSize
+	}
+
+	// putExtended() : 80-bit IEEE 754 extended-precision representation of a (positive integer) sample rate, for aiff COMM chunk
+	static void putExtended(std::vector<char>& h, uint32_t rate) {
+		int exponent = 31;
+		while (exponent > 0 && !(rate & (UINT32_C(1) << exponent))) {
+			exponent--;
+		}
+		putBE<2>(h, (rate == 0) ? 0 : 16383 + exponent);
+		putBE<8>(h, static_cast<uint64_t>(rate) << (63 - exponent));
+	}
+
+	std::vector<char> makeHeader(int64_t dataSize) const {
+		std::vector<char> h;
+		int64_t frames = dataSize / (channels * bytesPerSample);
+		int64_t paddedDataSize = dataSize + (dataSize & 1);
+		const uint64_t max32 = 0xffffffff;
+		switch (format & SF_FORMAT_TYPEMASK) {
+		case SF_FORMAT_WAV:
+		case SF_FORMAT_RF64:
+		{
+			bool rf64 = (format & SF_FORMAT_TYPEMASK) == SF_FORMAT_RF64;
+			uint64_t riffSize = static_cast<uint64_t>(dataOffset - 8 + paddedDataSize);
+			put(h, rf64 ? "RF64" : "RIFF");
+			putLE<4>(h, rf64 ? max32 : std::min(riffSize, max32));
+			put(h, "WAVE");
+			if (rf64) {
+				put(h, "ds64");
+				putLE<4>(h, 28);
+				putLE<8>(h, riffSize);
+				putLE<8>(h, dataSize);
+				putLE<8>(h, frames);
+				putLE<4>(h, 0); // (no table)
+			}
+			put(h, "fmt ");
+			putLE<4>(h, isFloat(format) ? 18 : 16);
+			putFmt(h);
+			if (isFloat(format)) {
+				put(h, "fact");
+				putLE<4>(h, 4);
+				putLE<4>(h, std::min(static_cast<uint64_t>(frames), max32));
+			}
+			put(h, "data");
+			putLE<4>(h, rf64 ? max32 : std::min(static_cast<uint64_t>(dataSize), max32));
+			break;
+		}
+		case SF_FORMAT_W64:
+			putW64Guid(h, "riff");
+			putLE<8>(h, dataOffset + dataSize);
+			putW64Guid(h, "wave");
+			putW64Guid(h, "fmt ");
+			putLE<8>(h, 24 + (isFloat(format) ? 18 : 16));
+			putFmt(h);
+			h.resize((h.size() + 7) & ~static_cast<size_t>(7), 0);
+			if (isFloat(format)) {
+				putW64Guid(h, "fact");
+				putLE<8>(h, 32);
+				putLE<8>(h, frames);
+			}
+			putW64Guid(h, "data");
+			putLE<8>(h, 24 + dataSize);
+			break;
+		case SF_FORMAT_AIFF:
+			// (as libsndfile does, the pad byte is counted in the size of the SSND chunk, and so in the number of frames, if frames are 1 byte)
+			frames = paddedDataSize / (channels * bytesPerSample);
+			put(h, "FORM");
+			putBE<4>(h, std::min(static_cast<uint64_t>(dataOffset - 8 + paddedDataSize), max32));
+			put(h, "AIFF");
+			put(h, "COMM");
+			putBE<4>(h, 18);
+			putBE<2>(h, channels);
+			putBE<4>(h, std::min(static_cast<uint64_t>(frames), max32));
+			putBE<2>(h, 8 * bytesPerSample);
+			putExtended(h, static_cast<uint32_t>(sampleRate));
+			put(h, "SSND");
+			putBE<4>(h, std::min(static_cast<uint64_t>(8 + paddedDataSize), max32));
+			putBE<4>(h, 0); // offset
+			putBE<4>(h, 0); // block size
+			break;
+		}
+		return h;
+	}
+};
+
+#endif // PCMWRITER_H
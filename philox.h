@@ -0,0 +1,199 @@
+/*
+* Copyright (C) 2016 - 2019 Judd Niemann - All Rights Reserved.
+* You may use, distribute and modify this code under the
+* terms of the GNU Lesser General Public License, version 2.1
+*
+* You should have received a copy of GNU Lesser General Public License v2.1
+* with this file. If not, please refer to: https://github.com/jniemann66/ReSampler
+*/
+
+// philox.h : Philox4x32-10 counter-based pseudo-random number generator
+// Reference: Salmon, Moraes, Dror & Shaw, "Parallel Random Numbers: As Easy as 1, 2, 3" (SC11)
+
+// Output word number n of a stream is a pure function of (key, stream, n), so any position in a stream
+// can be reached in O(1) (see seek()), and blocks of words can be generated independently of each other.
+// Words are generated 16 at a time (4 Philox blocks in parallel) using SSE2 where available.
+
+#ifndef PHILOX_H
+#define PHILOX_H 1
+
+#include <cstdint>
+#include <cstddef>
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(__x86_64__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define PHILOX_USE_SSE2
+#include <emmintrin.h>
+#endif
+
+class Philox4x32 {
+public:
+	static const int wordsPerBlock = 4;
+	static const int bufferSize = 64; // words generated per refill (must be a multiple of 16)
+
+	// key: seed of the generator (64-bit)
+	// stream: stream identifier (64-bit); streams with the same key and different identifiers are independent
+	explicit Philox4x32(uint64_t key = 0, uint64_t stream = 0) :
+		key{ static_cast<uint32_t>(key), static_cast<uint32_t>(key >> 32) },
+		stream{ static_cast<uint32_t>(stream), static_cast<uint32_t>(stream >> 32) }
+	{
+		seek(0);
+	}
+
+	// operator() : return next 32-bit word
+	uint32_t operator()() {
+		if (bufferIndex == bufferSize) {
+			refill();
+		}
+		return buffer[bufferIndex++];
+	}
+
+	// seek() : jump to word number 'position' of the stream in O(1)
+	void seek(uint64_t position) {
+		uint64_t blockNumber = position / bufferSize * (bufferSize / wordsPerBlock);
+		nextBlock = blockNumber;
+		refill();
+		bufferIndex = static_cast<int>(position % bufferSize);
+	}
+
+	// tell() : return position (word number) of next word to be returned
+	uint64_t tell() const {
+		return (nextBlock - bufferSize / wordsPerBlock) * wordsPerBlock + bufferIndex;
+	}
+
+	// generateBlock() : reference (scalar) implementation of Philox4x32-10 bijection
+	static void generateBlock(const uint32_t counter[4], const uint32_t key[2], uint32_t out[4]) {
+		uint32_t x0 = counter[0], x1 = counter[1], x2 = counter[2], x3 = counter[3];
+		uint32_t k0 = key[0], k1 = key[1];
+		for (int r = 0; r < 10; r++) {
+			uint64_t p0 = static_cast<uint64_t>(M0) * x0;
+			uint64_t p1 = static_cast<uint64_t>(M1) * x2;
+			uint32_t y0 = static_cast<uint32_t>(p1 >> 32) ^ x1 ^ k0;
+			uint32_t y1 = static_cast<uint32_t>(p1);
+			uint32_t y2 = static_cast<uint32_t>(p0 >> 32) ^ x3 ^ k1;
+			uint32_t y3 = static_cast<uint32_t>(p0);
+			x0 = y0; x1 = y1; x2 = y2; x3 = y3;
+			k0 += W0;
+			k1 += W1;
+		}
+		out[0] = x0; out[1] = x1; out[2] = x2; out[3] = x3;
+	}
+
+	// test() : check against known-answer vectors from the Random123 distribution (used by --selfTest)
+	static bool test() {
+		struct KnownAnswer {
+			uint32_t counter[4];
+			uint32_t key[2];
+			uint32_t expected[4];
+		};
+
+		const KnownAnswer knownAnswers[] = {
+			{ { 0x00000000, 0x00000000, 0x00000000, 0x00000000 },{ 0x00000000, 0x00000000 },{ 0x6627e8d5, 0xe169c58d, 0xbc57ac4c, 0x9b00dbd8 } },
+			{ { 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff },{ 0xffffffff, 0xffffffff },{ 0x408f276d, 0x41c83b0e, 0xa20bc7c6, 0x6d5451fd } },
+			{ { 0x243f6a88, 0x85a308d3, 0x13198a2e, 0x03707344 },{ 0xa4093822, 0x299f31d0 },{ 0xd16cfe09, 0x94fdcceb, 0x5001e420, 0x24126ea1 } }
+		};
+
+		bool ok = true;
+		for (auto& ka : knownAnswers) {
+			uint32_t out[4];
+			generateBlock(ka.counter, ka.key, out);
+			for (int i = 0; i < 4; i++) {
+				ok &= (out[i] == ka.expected[i]);
+			}
+		}
+
+		// check that the vectorised generator and seek() agree with the reference implementation:
+		const uint64_t testKey = 0x0123456789abcdefULL;
+		const uint64_t testStream = 7;
+		Philox4x32 generator(testKey, testStream);
+		generator.seek(1000003);
+		for (uint64_t position = 1000003; position < 1000003 + 3 * bufferSize; position++) {
+			uint32_t counter[4] = {
+				static_cast<uint32_t>(position / 4), static_cast<uint32_t>((position / 4) >> 32),
+				static_cast<uint32_t>(testStream), static_cast<uint32_t>(testStream >> 32)
+			};
+			uint32_t key[2] = { static_cast<uint32_t>(testKey), static_cast<uint32_t>(testKey >> 32) };
+			uint32_t out[4];
+			generateBlock(counter, key, out);
+			ok &= (generator.tell() == position);
+			ok &= (generator() == out[position % 4]);
+		}
+
+		return ok;
+	}
+
+private:
+	static const uint32_t M0 = 0xD2511F53;
+	static const uint32_t M1 = 0xCD9E8D57;
+	static const uint32_t W0 = 0x9E3779B9; // golden ratio
+	static const uint32_t W1 = 0xBB67AE85; // sqrt(3) - 1
+
+	uint32_t key[2];
+	uint32_t stream[2];
+	uint64_t nextBlock;	// counter value of next block to be generated
+	int bufferIndex;
+	alignas(16) uint32_t buffer[bufferSize];
+
+	// refill() : generate bufferSize words, starting at block number nextBlock
+	void refill() {
+
+#ifdef PHILOX_USE_SSE2
+		const __m128i m0 = _mm_set1_epi32(static_cast<int>(M0));
+		const __m128i m1 = _mm_set1_epi32(static_cast<int>(M1));
+		const __m128i lowMask = _mm_set1_epi64x(0x00000000ffffffffLL);
+
+		for (int b = 0; b < bufferSize; b += 16) { // 4 blocks at a time; lane j holds block (nextBlock + j)
+			uint64_t c = nextBlock;
+			__m128i x0 = _mm_set_epi32(static_cast<int>(c + 3), static_cast<int>(c + 2), static_cast<int>(c + 1), static_cast<int>(c));
+			__m128i x1 = _mm_set_epi32(static_cast<int>((c + 3) >> 32), static_cast<int>((c + 2) >> 32), static_cast<int>((c + 1) >> 32), static_cast<int>(c >> 32));
+			__m128i x2 = _mm_set1_epi32(static_cast<int>(stream[0]));
+			__m128i x3 = _mm_set1_epi32(static_cast<int>(stream[1]));
+			uint32_t k0 = key[0];
+			uint32_t k1 = key[1];
+
+			for (int r = 0; r < 10; r++) {
+				// 32 x 32 -> 64 bit products, even lanes and odd lanes:
+				__m128i e0 = _mm_mul_epu32(x0, m0);
+				__m128i o0 = _mm_mul_epu32(_mm_srli_epi64(x0, 32), m0);
+				__m128i e1 = _mm_mul_epu32(x2, m1);
+				__m128i o1 = _mm_mul_epu32(_mm_srli_epi64(x2, 32), m1);
+
+				__m128i lo0 = _mm_or_si128(_mm_and_si128(e0, lowMask), _mm_slli_epi64(o0, 32));
+				__m128i hi0 = _mm_or_si128(_mm_srli_epi64(e0, 32), _mm_andnot_si128(lowMask, o0));
+				__m128i lo1 = _mm_or_si128(_mm_and_si128(e1, lowMask), _mm_slli_epi64(o1, 32));
+				__m128i hi1 = _mm_or_si128(_mm_srli_epi64(e1, 32), _mm_andnot_si128(lowMask, o1));
+
+				x0 = _mm_xor_si128(_mm_xor_si128(hi1, x1), _mm_set1_epi32(static_cast<int>(k0)));
+				x1 = lo1;
+				x2 = _mm_xor_si128(_mm_xor_si128(hi0, x3), _mm_set1_epi32(static_cast<int>(k1)));
+				x3 = lo0;
+				k0 += W0;
+				k1 += W1;
+			}
+
+			// transpose, so that each block's 4 words are contiguous:
+			__m128i t0 = _mm_unpacklo_epi32(x0, x1); // b0w0 b0w1 b1w0 b1w1
+			__m128i t1 = _mm_unpacklo_epi32(x2, x3); // b0w2 b0w3 b1w2 b1w3
+			__m128i t2 = _mm_unpackhi_epi32(x0, x1); // b2w0 b2w1 b3w0 b3w1
+			__m128i t3 = _mm_unpackhi_epi32(x2, x3); // b2w2 b2w3 b3w2 b3w3
+			_mm_store_si128(reinterpret_cast<__m128i*>(buffer + b), _mm_unpacklo_epi64(t0, t1));
+			_mm_store_si128(reinterpret_cast<__m128i*>(buffer + b + 4), _mm_unpackhi_epi64(t0, t1));
+			_mm_store_si128(reinterpret_cast<__m128i*>(buffer + b + 8), _mm_unpacklo_epi64(t2, t3));
+			_mm_store_si128(reinterpret_cast<__m128i*>(buffer + b + 12), _mm_unpackhi_epi64(t2, t3));
+			nextBlock += 4;
+		}
+#else
+		for (int b = 0; b < bufferSize; b += wordsPerBlock) {
+			uint32_t counter[4] = {
+				static_cast<uint32_t>(nextBlock), static_cast<uint32_t>(nextBlock >> 32),
+				stream[0], stream[1]
+			};
+			generateBlock(counter, key, buffer + b);
+			++nextBlock;
+		}
+#endif
+
+		bufferIndex = 0;
+	}
+};
+
+#endif // PHILOX_H
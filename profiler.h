@@ -0,0 +1,355 @@
+/*
+* Copyright (C) 2016 - 2019 Judd Niemann - All Rights Reserved.
+* You may use, distribute and modify this code under the
+* terms of the GNU Lesser General Public License, version 2.1
+*
+* You should have received a copy of GNU Lesser General Public License v2.1
+* with this file. If not, please refer to: https://github.com/jniemann66/ReSampler
+*/
+
+// profiler.h : defines classes for collecting and reporting profiling information (--profile)
+
+#ifndef PROFILER_H
+#define PROFILER_H 1
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <utility>
+
+#if defined(__linux__) && !defined(__ANDROID__)
+#define PROFILER_HAS_PERF_EVENTS
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// struct ProfileRecord : accumulated statistics for one phase (or one conversion stage)
+
+struct ProfileRecord {
+	double ms = 0.0;			// accumulated elapsed time
+	uint64_t calls = 0;			// number of times the phase was entered
+	uint64_t frames = 0;		// number of samples produced by the phase
+	uint64_t macs = 0;			// number of filter taps evaluated (multiply-accumulates)
+	uint64_t silentFrames = 0;	// number of samples produced without filtering (digital silence)
+	uint64_t cycles = 0;		// hardware counters (only if available):
+	uint64_t instructions = 0;
+	uint64_t cacheMisses = 0;
+	bool hasCounters = false;
+
+	void add(const ProfileRecord& other) {
+		ms += other.ms;
+		calls += other.calls;
+		frames += other.frames;
+		macs += other.macs;
+		silentFrames += other.silentFrames;
+		cycles += other.cycles;
+		instructions += other.instructions;
+		cacheMisses += other.cacheMisses;
+		hasCounters |= other.hasCounters;
+	}
+};
+
+// class PerfCounters : per-thread group of hardware performance counters (cycles, instructions, cache misses),
+// using the Linux perf_event_open() interface. Counting is silently unavailable if the kernel doesn't allow it
+// (eg /proc/sys/kernel/perf_event_paranoid is too restrictive), or on other operating systems.
+
+class PerfCounters {
+public:
+	static const int numCounters = 3;
+
+	// enable() : switch on hardware counters for all threads (call before any threads start counting)
+	static void enable(bool bEnable) {
+		enabled() = bEnable;
+	}
+
+	// forThisThread() : get the counter group belonging to the calling thread
+	static PerfCounters& forThisThread() {
+		static thread_local PerfCounters counters;
+		return counters;
+	}
+
+	bool isAvailable() const {
+		return available;
+	}
+
+	// read() : read current counter values. Returns false if counters not available.
+	bool read(uint64_t* values) {
+
+#ifdef PROFILER_HAS_PERF_EVENTS
+		if (!available)
+			return false;
+
+		struct {
+			uint64_t nr;
+			uint64_t values[numCounters];
+		} data;
+
+		if (::read(fds[0], &data, sizeof(data)) != static_cast<ssize_t>(sizeof(data)) || data.nr != numCounters)
+			return false;
+
+		for (int i = 0; i < numCounters; i++) {
+			values[i] = data.values[i];
+		}
+		return true;
+#else
+		(void)values;
+		return false;
+#endif
+
+	}
+
+	~PerfCounters() {
+
+#ifdef PROFILER_HAS_PERF_EVENTS
+		for (int fd : fds) {
+			if (fd >= 0)
+				close(fd);
+		}
+#endif
+
+	}
+
+private:
+	bool available;
+	int fds[numCounters];
+
+	PerfCounters() : available(false) {
+		std::fill(fds, fds + numCounters, -1);
+
+#ifdef PROFILER_HAS_PERF_EVENTS
+		if (!enabled())
+			return;
+
+		const uint64_t configs[numCounters] = {
+			PERF_COUNT_HW_CPU_CYCLES,
+			PERF_COUNT_HW_INSTRUCTIONS,
+			PERF_COUNT_HW_CACHE_MISSES
+		};
+
+		for (int i = 0; i < numCounters; i++) {
+			struct perf_event_attr attr;
+			memset(&attr, 0, sizeof(attr));
+			attr.type = PERF_TYPE_HARDWARE;
+			attr.size = sizeof(attr);
+			attr.config = configs[i];
+			attr.read_format = PERF_FORMAT_GROUP;
+			attr.disabled = (i == 0) ? 1 : 0; // group leader starts disabled
+			attr.exclude_kernel = 1;
+			attr.exclude_hv = 1;
+
+			// this thread only, any cpu:
+			fds[i] = static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, (i == 0) ? -1 : fds[0], 0));
+			if (fds[i] < 0) {
+				return;
+			}
+		}
+
+		ioctl(fds[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+		ioctl(fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+		available = true;
+#endif
+
+	}
+
+	static std::atomic<bool>& enabled() {
+		static std::atomic<bool> bEnabled(false);
+		return bEnabled;
+	}
+};
+
+// class ProfileScope : adds the elapsed time (and hardware counter deltas) between construction and destruction to a ProfileRecord.
+// Does nothing if record is nullptr.
+
+class ProfileScope {
+public:
+	explicit ProfileScope(ProfileRecord* record) : record(record), hasCounters(false), startCounts() {
+		if (record != nullptr) {
+			hasCounters = PerfCounters::forThisThread().read(startCounts);
+			beginTimer = std::chrono::high_resolution_clock::now();
+		}
+	}
+
+	~ProfileScope() {
+		if (record != nullptr) {
+			auto endTimer = std::chrono::high_resolution_clock::now();
+			record->ms += std::chrono::duration<double, std::milli>(endTimer - beginTimer).count();
+			record->calls++;
+			uint64_t endCounts[PerfCounters::numCounters];
+			if (hasCounters && PerfCounters::forThisThread().read(endCounts)) {
+				record->cycles += endCounts[0] - startCounts[0];
+				record->instructions += endCounts[1] - startCounts[1];
+				record->cacheMisses += endCounts[2] - startCounts[2];
+				record->hasCounters = true;
+			}
+		}
+	}
+
+	ProfileScope(const ProfileScope&) = delete;
+	ProfileScope& operator=(const ProfileScope&) = delete;
+
+private:
+	ProfileRecord* record;
+	bool hasCounters;
+	uint64_t startCounts[PerfCounters::numCounters];
+	std::chrono::time_point<std::chrono::high_resolution_clock> beginTimer;
+};
+
+// class Profiler : collection of named ProfileRecords, with table and JSON reporting.
+
+class Profiler {
+public:
+	explicit Profiler(bool bEnabled = false) : bEnabled(bEnabled) {
+		PerfCounters::enable(bEnabled);
+	}
+
+	bool isEnabled() const {
+		return bEnabled;
+	}
+
+	// record() : returns a pointer to the named record (created if it doesn't exist yet), or nullptr if profiling is disabled.
+	// Note: not thread-safe; obtain records before starting worker threads.
+	ProfileRecord* record(const std::string& name) {
+		if (!bEnabled)
+			return nullptr;
+
+		for (auto& r : records) {
+			if (r.first == name)
+				return &r.second;
+		}
+		records.emplace_back(name, ProfileRecord());
+		return &records.back().second;
+	}
+
+	// add() : accumulate stats into a named record
+	void add(const std::string& name, const ProfileRecord& stats) {
+		if (ProfileRecord* r = record(name)) {
+			r->add(stats);
+		}
+	}
+
+	void setWallTime(double ms) {
+		wallTime = ms;
+	}
+
+	// setFlushDenormals() : record whether denormals are flushed to zero (FTZ/DAZ) in the conversion threads
+	void setFlushDenormals(bool bFlushDenormals) {
+		Profiler::bFlushDenormals = bFlushDenormals;
+	}
+
+	void printTable(std::ostream& os) const {
+		auto flags = os.flags();
+		auto prec = os.precision();
+		bool anyCounters = false;
+		for (auto& r : records) {
+			anyCounters |= r.second.hasCounters;
+		}
+
+		os << "\nProfile:\n"
+			<< std::left << std::setw(32) << "phase"
+			<< std::right << std::setw(12) << "time (ms)"
+			<< std::setw(8) << "%"
+			<< std::setw(10) << "calls"
+			<< std::setw(14) << "samples"
+			<< std::setw(14) << "silent"
+			<< std::setw(16) << "taps";
+		if (anyCounters) {
+			os << std::setw(16) << "cycles"
+				<< std::setw(8) << "IPC"
+				<< std::setw(14) << "cache misses";
+		}
+		os << "\n";
+
+		os << std::fixed;
+		for (auto& r : records) {
+			const ProfileRecord& p = r.second;
+			os << std::left << std::setw(32) << r.first
+				<< std::right << std::setprecision(1) << std::setw(12) << p.ms
+				<< std::setw(8) << (wallTime > 0.0 ? 100.0 * p.ms / wallTime : 0.0)
+				<< std::setw(10) << p.calls
+				<< std::setw(14) << p.frames
+				<< std::setw(14) << p.silentFrames
+				<< std::setw(16) << p.macs;
+			if (anyCounters) {
+				if (p.hasCounters) {
+					os << std::setw(16) << p.cycles
+						<< std::setprecision(2) << std::setw(8) << (p.cycles ? static_cast<double>(p.instructions) / p.cycles : 0.0)
+						<< std::setw(14) << p.cacheMisses;
+				}
+				else {
+					os << std::setw(16) << "-" << std::setw(8) << "-" << std::setw(14) << "-";
+				}
+			}
+			os << "\n";
+		}
+
+		os << std::setprecision(1) << "wall time: " << wallTime << " ms";
+		if (!anyCounters) {
+			os << " (hardware counters not available)";
+		}
+		os << "\ndenormals: " << (bFlushDenormals ? "flushed to zero (FTZ/DAZ)" : "not flushed (FTZ/DAZ not supported)")
+			<< "\n(silent: samples produced from digital silence, without filtering)";
+		os << "\n(note: with --mt, per-channel phases run concurrently, so their times may add up to more than the wall time)\n" << std::endl;
+		os.flags(flags);
+		os.precision(prec);
+	}
+
+	std::string toJson() const {
+		std::ostringstream os;
+		os << std::setprecision(6) << std::fixed;
+		os << "{\n  \"wallTimeMs\": " << wallTime << ",\n  \"flushDenormals\": " << (bFlushDenormals ? "true" : "false") << ",\n  \"phases\": [";
+		for (size_t i = 0; i < records.size(); i++) {
+			const ProfileRecord& p = records[i].second;
+			os << (i == 0 ? "\n" : ",\n")
+				<< "    {\"name\": \"" << jsonEscape(records[i].first) << "\""
+				<< ", \"ms\": " << p.ms
+				<< ", \"calls\": " << p.calls
+				<< ", \"samples\": " << p.frames
+				<< ", \"silentSamples\": " << p.silentFrames
+				<< ", \"taps\": " << p.macs;
+			if (p.hasCounters) {
+				os << ", \"cycles\": " << p.cycles
+					<< ", \"instructions\": " << p.instructions
+					<< ", \"cacheMisses\": " << p.cacheMisses;
+			}
+			os << "}";
+		}
+		os << "\n  ]\n}\n";
+		return os.str();
+	}
+
+	bool writeJson(const std::string& filename) const {
+		std::ofstream f(filename);
+		if (!f.is_open())
+			return false;
+		f << toJson();
+		return f.good();
+	}
+
+private:
+	bool bEnabled;
+	double wallTime = 0.0;
+	bool bFlushDenormals = false;
+	std::deque<std::pair<std::string, ProfileRecord>> records; // (deque: pointers to records remain valid as records are added)
+
+	static std::string jsonEscape(const std::string& s) {
+		std::string result;
+		for (char c : s) {
+			if (c == '"' || c == '\\')
+				result.push_back('\\');
+			result.push_back(c);
+		}
+		return result;
+	}
+};
+
+#endif // PROFILER_H
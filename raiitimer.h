@@ -43,4 +43,40 @@ private:
     double msComparison;
 };
 
+// class PhaseTimer : accumulates elapsed time over any number of start() / stop() intervals.
+// Used for reporting the time spent in each phase of a conversion.
+
+class PhaseTimer {
+public:
+
+    PhaseTimer() : elapsed(0), running(false) {}
+
+    void start() {
+        beginTimer = std::chrono::high_resolution_clock::now();
+        running = true;
+    }
+
+    void stop() {
+        if(running) {
+            elapsed += std::chrono::high_resolution_clock::now() - beginTimer;
+            running = false;
+        }
+    }
+
+    void reset() {
+        elapsed = std::chrono::high_resolution_clock::duration(0);
+        running = false;
+    }
+
+    // getElapsed() : returns accumulated time in ms
+    double getElapsed() const {
+        return std::chrono::duration<double, std::milli>(elapsed).count();
+    }
+
+private:
+    std::chrono::time_point<std::chrono::high_resolution_clock> beginTimer;
+    std::chrono::high_resolution_clock::duration elapsed;
+    bool running;
+};
+
 #endif // _RAIITIMER_H
@@ -0,0 +1,193 @@
+/*
+* Copyright (C) 2016 - 2019 Judd Niemann - All Rights Reserved.
+* You may use, distribute and modify this code under the
+* terms of the GNU Lesser General Public License, version 2.1
+*
+* You should have received a copy of GNU Lesser General Public License v2.1
+* with this file. If not, please refer to: https://github.com/jniemann66/ReSampler
+*/
+
+// realtime.h : defines the RealtimeResampler class, for low-latency streaming conversion of interleaved audio in small blocks
+// (eg for live monitoring), and a test (--realtimeTest) which measures the worst-case time taken to process a block.
+
+// All memory is allocated when the RealtimeResampler is constructed; process() does not allocate memory, take locks or do any I/O.
+// There is no group delay compensation (the output simply lags the input by getLatency() output frames),
+// so for the lowest latency, use a minimum-phase filter (ci.bMinPhase), or ci.bLowLatency (minimum-phase with a shorter filter).
+
+#ifndef REALTIME_H
+#define REALTIME_H 1
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+#include "ReSampler.h"
+#include "conversioninfo.h"
+#include "fraction.h"
+#include "srconvert.h"
+
+template<typename FloatType>
+class RealtimeResampler
+{
+public:
+	// ci: conversion parameters. Uses ci.inputSampleRate, ci.outputSampleRate, ci.gain, the filter options,
+	// and ci.blockSize (the largest number of frames which will be passed to process())
+	RealtimeResampler(const ConversionInfo& ci, int numChannels) : numChannels(numChannels), blockSize(static_cast<size_t>(ci.blockSize))
+	{
+		ConversionInfo converterCi = ci;
+		converterCi.bShowStages = false;
+		converterCi.bProfile = false;
+		for (int ch = 0; ch < numChannels; ch++) {
+			converters.emplace_back(converterCi);
+		}
+
+		Fraction f = getFractionFromSamplerates(ci.inputSampleRate, ci.outputSampleRate);
+		gain = static_cast<FloatType>(ci.gain * converters[0].getGain() * f.numerator);
+		latencySeconds = converters[0].getLatency() / ci.outputSampleRate;
+		maxOutputFrames = converters[0].getMaxOutputFrames();
+		inputChannelBuffer.resize(blockSize, 0.0);
+		outputChannelBuffer.resize(maxOutputFrames + 1, 0.0);
+	}
+
+	// process() : convert 'frames' (at most getBlockSize()) interleaved input frames.
+	// 'out' must have room for getMaxOutputFrames() interleaved output frames.
+	// Returns the number of output frames written (which varies from call to call, unless the conversion ratio is an integer)
+	size_t process(const FloatType* in, size_t frames, FloatType* out) {
+		assert(frames <= blockSize);
+		size_t outFrames = 0;
+		for (int ch = 0; ch < numChannels; ch++) {
+			FloatType* iBuf = inputChannelBuffer.data();
+			FloatType* oBuf = outputChannelBuffer.data();
+			for (size_t i = 0, s = ch; i < frames; i++, s += numChannels) {
+				iBuf[i] = in[s]; // de-interleave
+			}
+			converters[ch].convert(oBuf, outFrames, iBuf, frames);
+			for (size_t o = 0, s = ch; o < outFrames; o++, s += numChannels) {
+				out[s] = gain * oBuf[o]; // gain, interleave
+			}
+		}
+		return outFrames;
+	}
+
+	// reset() : clear all filter history (eg after a discontinuity in the input stream)
+	void reset() {
+		for (auto& converter : converters) {
+			converter.reset();
+		}
+	}
+
+	int getNumChannels() const {
+		return numChannels;
+	}
+
+	size_t getBlockSize() const {
+		return blockSize;
+	}
+
+	size_t getMaxOutputFrames() const {
+		return maxOutputFrames;
+	}
+
+	// getLatency() : algorithmic latency (filter delay), in output frames
+	double getLatency() const {
+		return converters[0].getLatency();
+	}
+
+	// getLatencySeconds() : algorithmic latency (filter delay), in seconds
+	double getLatencySeconds() const {
+		return latencySeconds;
+	}
+
+private:
+	int numChannels;
+	size_t blockSize;
+	size_t maxOutputFrames;
+	FloatType gain;
+	double latencySeconds;
+	std::vector<Converter<FloatType>> converters;	// one converter per channel
+	std::vector<FloatType> inputChannelBuffer;		// de-interleaved input (one channel at a time)
+	std::vector<FloatType> outputChannelBuffer;		// converted output (one channel at a time)
+};
+
+// testRealtimeResampler() : streams 'duration' seconds of audio through a RealtimeResampler, one block at a time,
+// and reports the time taken to process each block (mean, 99.9th percentile and worst case), compared to the time available
+// (the duration of one block). Also checks that the reported latency matches the measured delay of an impulse.
+// Returns true if the worst-case block time is within the time available, and the latency is correct.
+
+template<typename FloatType>
+bool testRealtimeResampler(const ConversionInfo& ci, int numChannels, double duration) {
+	flushDenormals(); // (as an audio callback thread would)
+	RealtimeResampler<FloatType> resampler(ci, numChannels);
+	const size_t blockSize = resampler.getBlockSize();
+	const auto numBlocks = static_cast<size_t>(std::max(1.0, std::ceil(duration * ci.inputSampleRate / blockSize)));
+	std::vector<FloatType> inBlock(blockSize * numChannels, 0.0);
+	std::vector<FloatType> outBlock(resampler.getMaxOutputFrames() * numChannels, 0.0);
+
+	std::cout << "Real-time test: " << ci.inputSampleRate << " -> " << ci.outputSampleRate << " Hz, "
+		<< numChannels << " channel(s), block size " << blockSize << " frames, "
+		<< (ci.bMinPhase ? "minimum" : "linear") << "-phase, "
+		<< (ci.bUseDoublePrecision ? "double" : "single") << " precision" << std::endl;
+
+	// measure delay of an impulse (centroid of impulse response of channel 0):
+	double sum = 0.0;
+	double weightedSum = 0.0;
+	size_t outputPosition = 0;
+	const auto impulseBlocks = std::max(numBlocks, static_cast<size_t>(std::ceil((0.1 + 4 * resampler.getLatencySeconds()) * ci.inputSampleRate / blockSize)));
+	inBlock[0] = 1.0;
+	for (size_t b = 0; b < impulseBlocks; b++) {
+		size_t outFrames = resampler.process(inBlock.data(), blockSize, outBlock.data());
+		for (size_t o = 0; o < outFrames; o++, outputPosition++) {
+			sum += outBlock[o * numChannels];
+			weightedSum += static_cast<double>(outputPosition) * outBlock[o * numChannels];
+		}
+		inBlock[0] = 0.0;
+	}
+	double measuredLatency = (sum != 0.0) ? weightedSum / sum : 0.0;
+	bool latencyOk = std::abs(measuredLatency - resampler.getLatency()) < 0.1;
+
+	// measure processing time of each block, using a stream of -6dBFS sine tones (a different frequency in each channel):
+	resampler.reset();
+	std::vector<double> blockTimes(numBlocks);
+	const double pi = 3.14159265358979323846;
+	size_t inputPosition = 0;
+	for (size_t b = 0; b < numBlocks; b++) {
+		for (size_t i = 0; i < blockSize; i++, inputPosition++) {
+			for (int ch = 0; ch < numChannels; ch++) {
+				inBlock[i * numChannels + ch] = static_cast<FloatType>(0.5 * std::sin(2 * pi * (1000.0 + 100.0 * ch) * inputPosition / ci.inputSampleRate));
+			}
+		}
+		auto start = std::chrono::steady_clock::now();
+		resampler.process(inBlock.data(), blockSize, outBlock.data());
+		auto end = std::chrono::steady_clock::now();
+		blockTimes[b] = std::chrono::duration<double, std::micro>(end - start).count();
+	}
+
+	double meanTime = 0.0;
+	for (double t : blockTimes) {
+		meanTime += t;
+	}
+	meanTime /= numBlocks;
+	std::sort(blockTimes.begin(), blockTimes.end());
+	double percentileTime = blockTimes[std::min(numBlocks - 1, static_cast<size_t>(0.999 * numBlocks))];
+	double worstTime = blockTimes.back();
+	double budget = 1000000.0 * blockSize / ci.inputSampleRate; // duration of one block (microseconds)
+	bool timingOk = worstTime < budget;
+
+	auto prec = std::cout.precision();
+	std::cout << std::fixed << std::setprecision(2)
+		<< "latency: " << resampler.getLatency() << " output frames (" << 1000.0 * resampler.getLatencySeconds() << " ms)"
+		<< ", measured: " << measuredLatency << " output frames " << (latencyOk ? "(ok)" : "(MISMATCH)") << "\n"
+		<< "block time (us): mean " << meanTime << ", 99.9% " << percentileTime << ", worst " << worstTime
+		<< ", available " << budget << " (worst-case load " << 100.0 * worstTime / budget << "%)\n"
+		<< "Real-time test: " << (latencyOk && timingOk ? "pass" : "FAIL") << std::endl;
+	std::cout.unsetf(std::ios::fixed);
+	std::cout.precision(prec);
+
+	return latencyOk && timingOk;
+}
+
+#endif // REALTIME_H
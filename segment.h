@@ -0,0 +1,241 @@
+/*
+* Copyright (C) 2016 - 2019 Judd Niemann - All Rights Reserved.
+* You may use, distribute and modify this code under the
+* terms of the GNU Lesser General Public License, version 2.1
+*
+* You should have received a copy of GNU Lesser General Public License v2.1
+* with this file. If not, please refer to: https://github.com/jniemann66/ReSampler
+*/
+
+// segment.h : segmented conversion (--segment / --segments) and stitching (--stitch)
+
+// A conversion can be split into segments, which are converted independently (eg by different processes or machines),
+// and then stitched together into the final output file:
+//  --segment k --segments N : convert the k-th of N equal parts of the input (with filter pre-roll and post-roll; see convert()),
+//                             writing what would have gone into the temp file (raw floating-point, before clipping protection and dither)
+//                             to <output>.seg<k>, along with a manifest (<output>.seg<k>.manifest)
+//  --stitch --segments N    : read the segments in order, as if they were the temp file of a single conversion,
+//                             and do the final pass (clipping protection, dither, output format) into <output>
+// Segment boundaries are determined from the number of input frames alone, so the segments fit together exactly,
+// and (since the final pass is the same as that of a single conversion) the result is sample-identical to a single conversion
+// (also when dithering, provided the same --seed is used).
+
+#ifndef SEGMENT_H
+#define SEGMENT_H 1
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <limits>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "sndfile.hh"
+
+// struct SegmentManifest : description of a converted segment
+
+struct SegmentManifest {
+	std::string inputFilename;
+	int64_t inputFrames = 0;		// length of whole input file
+	int segment = 0;				// 1 .. numSegments
+	int numSegments = 0;
+	int64_t startFrame = 0;			// range of input frames converted [startFrame, endFrame)
+	int64_t endFrame = 0;
+	int channels = 0;
+	int sampleRate = 0;				// output sample rate
+	int bytesPerSample = 0;			// 4 (float) or 8 (double)
+	int64_t firstOutputFrame = 0;	// position of segment's first frame in the output of the whole conversion
+	int64_t outputFrames = 0;		// number of frames in segment file
+	double peak = 0.0;				// peak sample value in segment file
+
+	bool write(const std::string& filename) const {
+		std::ofstream f(filename);
+		if (!f.is_open())
+			return false;
+		f << "inputFilename=" << inputFilename << "\n"
+			<< "inputFrames=" << inputFrames << "\n"
+			<< "segment=" << segment << "\n"
+			<< "numSegments=" << numSegments << "\n"
+			<< "startFrame=" << startFrame << "\n"
+			<< "endFrame=" << endFrame << "\n"
+			<< "channels=" << channels << "\n"
+			<< "sampleRate=" << sampleRate << "\n"
+			<< "bytesPerSample=" << bytesPerSample << "\n"
+			<< "firstOutputFrame=" << firstOutputFrame << "\n"
+			<< "outputFrames=" << outputFrames << "\n"
+			<< "peak=" << std::setprecision(std::numeric_limits<double>::max_digits10) << peak << "\n"; // (exact)
+		return f.good();
+	}
+
+	// read() : read manifest from file. Returns false if the file can't be read, or any value is missing or malformed.
+	bool read(const std::string& filename) {
+		std::ifstream f(filename);
+		if (!f.is_open())
+			return false;
+		int found = 0;
+		std::string line;
+		while (std::getline(f, line)) {
+			auto eq = line.find('=');
+			if (eq == std::string::npos)
+				continue;
+			std::string key = line.substr(0, eq);
+			std::string value = line.substr(eq + 1);
+			try {
+				if (key == "inputFilename")
+					inputFilename = value;
+				else if (key == "inputFrames")
+					inputFrames = std::stoll(value);
+				else if (key == "segment")
+					segment = std::stoi(value);
+				else if (key == "numSegments")
+					numSegments = std::stoi(value);
+				else if (key == "startFrame")
+					startFrame = std::stoll(value);
+				else if (key == "endFrame")
+					endFrame = std::stoll(value);
+				else if (key == "channels")
+					channels = std::stoi(value);
+				else if (key == "sampleRate")
+					sampleRate = std::stoi(value);
+				else if (key == "bytesPerSample")
+					bytesPerSample = std::stoi(value);
+				else if (key == "firstOutputFrame")
+					firstOutputFrame = std::stoll(value);
+				else if (key == "outputFrames")
+					outputFrames = std::stoll(value);
+				else if (key == "peak")
+					peak = std::stod(value);
+				else
+					continue;
+				found++;
+			}
+			catch (std::exception&) {
+				return false;
+			}
+		}
+		return found == 12;
+	}
+};
+
+// getSegmentFilename() : name of file holding converted segment (1 .. numSegments) of outputFilename
+inline std::string getSegmentFilename(const std::string& outputFilename, int segment) {
+	return outputFilename + ".seg" + std::to_string(segment);
+}
+
+inline std::string getSegmentManifestFilename(const std::string& outputFilename, int segment) {
+	return getSegmentFilename(outputFilename, segment) + ".manifest";
+}
+
+// getSegmentFileFormat() : libsndfile format of segment files (headerless, little-endian, same precision as the temp file)
+inline int getSegmentFileFormat(int bytesPerSample) {
+	return SF_FORMAT_RAW | SF_ENDIAN_LITTLE | ((bytesPerSample == 8) ? SF_FORMAT_DOUBLE : SF_FORMAT_FLOAT);
+}
+
+// getSegmentBounds() : range of input frames [startFrame, endFrame) of segment (1 .. numSegments)
+inline void getSegmentBounds(sf_count_t inputFrames, int segment, int numSegments, sf_count_t& startFrame, sf_count_t& endFrame) {
+	startFrame = inputFrames * (segment - 1) / numSegments;
+	endFrame = inputFrames * segment / numSegments;
+}
+
+// loadSegmentManifests() : read and check the manifests of all segments of outputFilename.
+// Returns false (with a description of the problem in errorMessage) if any segment is missing, incomplete, or doesn't fit with the others.
+inline bool loadSegmentManifests(const std::string& outputFilename, int numSegments, int64_t inputFrames, int channels, int sampleRate, int bytesPerSample,
+	std::vector<SegmentManifest>& manifests, std::string& errorMessage)
+{
+	manifests.clear();
+	int64_t nextOutputFrame = 0;
+	for (int segment = 1; segment <= numSegments; segment++) {
+		std::string manifestFilename = getSegmentManifestFilename(outputFilename, segment);
+		SegmentManifest m;
+		if (!m.read(manifestFilename)) {
+			errorMessage = "couldn't read segment manifest " + manifestFilename;
+			return false;
+		}
+		if (m.segment != segment || m.numSegments != numSegments || m.inputFrames != inputFrames) {
+			errorMessage = manifestFilename + " is not segment " + std::to_string(segment) + " of " + std::to_string(numSegments) + " of this input file";
+			return false;
+		}
+		if (m.channels != channels || m.sampleRate != sampleRate || m.bytesPerSample != bytesPerSample) {
+			errorMessage = manifestFilename + ": number of channels, sample rate or precision differs from this conversion";
+			return false;
+		}
+		if (m.outputFrames > 0 && m.firstOutputFrame != nextOutputFrame) { // (segments shorter than the filter delay, at the end of the file, may be empty)
+			errorMessage = manifestFilename + ": segment doesn't follow on from previous segment";
+			return false;
+		}
+		std::ifstream segmentFile(getSegmentFilename(outputFilename, segment), std::ios::binary | std::ios::ate);
+		if (!segmentFile.is_open() || static_cast<int64_t>(segmentFile.tellg()) != m.outputFrames * channels * bytesPerSample) {
+			errorMessage = "segment file " + getSegmentFilename(outputFilename, segment) + " is missing, or not the size stated in its manifest";
+			return false;
+		}
+		nextOutputFrame = std::max(nextOutputFrame, m.firstOutputFrame + m.outputFrames);
+		manifests.push_back(m);
+	}
+	return true;
+}
+
+// class SegmentReader : reads the segment files of outputFilename in order, as one continuous stream of interleaved samples
+// (used in place of the temp file, when stitching)
+
+class SegmentReader {
+public:
+	SegmentReader(const std::string& outputFilename, const std::vector<SegmentManifest>& manifests) : outputFilename(outputFilename), manifests(manifests), current(0) {
+		open(0);
+	}
+
+	// read() : read up to count samples (count must be a multiple of the number of channels). Returns number of samples read (0 at end)
+	template<typename FloatType>
+	sf_count_t read(FloatType* buffer, sf_count_t count) {
+		sf_count_t samplesRead = 0;
+		while (samplesRead < count && file) {
+			sf_count_t n = file->read(buffer + samplesRead, count - samplesRead);
+			samplesRead += n;
+			if (n == 0) {
+				open(current + 1); // next segment
+			}
+		}
+		return samplesRead;
+	}
+
+	// seek() : rewind to start of first segment. Only seek(0, SEEK_SET) is supported:
+	// anything else is a programming error (and returns -1, as sf_seek() does on failure)
+	sf_count_t seek(sf_count_t pos, int whence) {
+		assert(pos == 0 && whence == SEEK_SET);
+		if (pos != 0 || whence != SEEK_SET) {
+			return -1;
+		}
+		open(0);
+		return 0;
+	}
+
+	double getPeak() const {
+		double peak = 0.0;
+		for (const auto& m : manifests) {
+			peak = std::max(peak, m.peak);
+		}
+		return peak;
+	}
+
+private:
+	std::string outputFilename;
+	std::vector<SegmentManifest> manifests;
+	size_t current;
+	std::unique_ptr<SndfileHandle> file;
+
+	void open(size_t index) {
+		current = index;
+		file.reset();
+		if (current < manifests.size()) {
+			const SegmentManifest& m = manifests[current];
+			file.reset(new SndfileHandle(getSegmentFilename(outputFilename, m.segment), SFM_READ, getSegmentFileFormat(m.bytesPerSample), m.channels, m.sampleRate));
+			file->command((m.bytesPerSample == 8) ? SFC_SET_NORM_DOUBLE : SFC_SET_NORM_FLOAT, NULL, SF_FALSE);
+		}
+	}
+};
+
+#endif // SEGMENT_H
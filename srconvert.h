@@ -14,15 +14,35 @@
 
 //#define USE_LAZYGET_ON_INTERPOLATE
 #define USE_LAZYGET_ON_INTERPOLATE_DECIMATE
+#define USE_SPECIALISED_STAGE_KERNELS
+
+// Stage ratios (L/M) which have bulk-skip conversion kernels with L and M fixed at compile time (see ResamplingStage::convertT()):
+// the stages of the single-stage and multi-stage plans for 44.1k <-> 48k, 44.1k <-> 96k and 2:1 / 1:2 conversions
+// (minimum-phase stages, which are oversampled, use the generic kernels)
+#define SPECIALISED_STAGE_RATIOS(X) \
+	X(147, 160) X(160, 147) X(147, 320) X(320, 147) X(1, 2) X(2, 1) \
+	X(3, 2) X(7, 8) X(7, 10) X(10, 7) X(16, 21) X(3, 5) X(5, 3) X(8, 7)
+
+#define MIN_SUBBLOCKSIZE 64 // range of sub-block sizes for depth-first multi-stage conversion (input samples)
+#define MAX_SUBBLOCKSIZE 1024
 
 #include "FIRFilter.h"
+#include "cacheinfo.h"
 #include "conversioninfo.h"
 #include "fraction.h"
+#include "profiler.h"
 #include "ReSampler.h"
 
 static_assert(std::is_copy_constructible<ConversionInfo>::value, "ConversionInfo needs to be copy Constructible");
 static_assert(std::is_copy_assignable<ConversionInfo>::value, "ConversionInfo needs to be copy Assignable");
 
+// getDefaultStopbandAttenuation() : stopband attenuation (dB) of the filters for a conversion ratio, unless a quality preset sets it
+inline int getDefaultStopbandAttenuation(Fraction fraction) {
+	return ((fraction.numerator == 1) || (fraction.denominator == 1)) ?
+		195 :
+		160;
+}
+
 template<typename FloatType>
 std::vector<FloatType> makeFilterCoefficients(const ConversionInfo& ci, Fraction fraction) {
 
@@ -31,17 +51,24 @@ std::vector<FloatType> makeFilterCoefficients(const ConversionInfo& ci, Fraction
 	double ft = (ci.lpfCutoff / 100.0) * targetNyquist;
 	double steepness = 0.090909091 / (ci.lpfTransitionWidth / 100.0);
 
+	// determine sidelobe attenuation
+	int sidelobeAtten = getDefaultStopbandAttenuation(fraction);
+
+	// apply attenuation chosen by quality preset (if any), and scale the filter length to suit,
+	// so that the transition width stays the same (the length of a Kaiser-windowed filter is proportional to attenuation - 7.95 dB)
+	double lengthFactor = 1.0;
+	if (ci.stopbandAttenuation > 0.0) {
+		int presetAtten = static_cast<int>(ci.stopbandAttenuation);
+		lengthFactor = (presetAtten - 7.95) / (sidelobeAtten - 7.95);
+		sidelobeAtten = presetAtten;
+	}
+
 	// determine filtersize
 	int filterSize = static_cast<int>(
-		std::min<int>(FILTERSIZE_BASE * ci.overSamplingFactor * std::max(fraction.denominator, fraction.numerator) * steepness, FILTERSIZE_LIMIT)
+		std::min<int>(FILTERSIZE_BASE * ci.overSamplingFactor * std::max(fraction.denominator, fraction.numerator) * steepness * lengthFactor, FILTERSIZE_LIMIT)
 		| 1 // ensure that filter length is always odd
 	);
 
-	// determine sidelobe attenuation
-	int sidelobeAtten = ((fraction.numerator == 1) || (fraction.denominator == 1)) ?
-		195 :
-		160;
-
 	// Make some filter coefficients:
 	int sampFreq = ci.overSamplingFactor * ci.inputSampleRate * fraction.numerator;
 	std::vector<FloatType> filterTaps(filterSize, 0);
@@ -58,18 +85,105 @@ std::vector<FloatType> makeFilterCoefficients(const ConversionInfo& ci, Fraction
 	return filterTaps;
 }
 
+// getFilterDelay() : returns the delay (in samples) of a filter at DC, ie the centroid of its impulse response, as applied by FIRFilter.
+// Note: FIRFilter applies tap n to the input sample from n - 1 samples ago (and tap 0 to the oldest sample in its history),
+// so the delay of a linear-phase filter is (length - 3) / 2 (plus a negligible contribution from tap 0).
+// The delay of a minimum-phase filter is much smaller.
+template<typename FloatType>
+double getFilterDelay(const std::vector<FloatType>& filterTaps) {
+	double sum = 0.0;
+	double weightedSum = 0.0;
+	const size_t length = filterTaps.size();
+	for (size_t n = 0; n < length; n++) {
+		size_t age = (n == 0) ? length - 1 : n - 1;
+		sum += filterTaps[n];
+		weightedSum += age * static_cast<double>(filterTaps[n]);
+	}
+	return (sum != 0.0) ? weightedSum / sum : 0.0;
+}
+
+// countTrailingZeros() : number of zero samples at the end of a buffer
+template<typename FloatType>
+size_t countTrailingZeros(const FloatType* buffer, size_t size) {
+	size_t n = 0;
+	while (n < size && buffer[size - 1 - n] == 0.0) {
+		++n;
+	}
+	return n;
+}
+
+// countOutputs() : number of output samples a stage (interpolation factor L, decimation factor M) produces from inputSize input samples,
+// starting at decimation index m (an output is produced at each sub-step at which the index is 0). m is advanced past the input.
+inline size_t countOutputs(int L, int M, int& m, size_t inputSize) {
+	uint64_t substeps = static_cast<uint64_t>(inputSize) * L;
+	uint64_t first = static_cast<uint64_t>((M - m) % M); // (sub-step of first output)
+	size_t outputs = (first < substeps) ? static_cast<size_t>(1 + (substeps - 1 - first) / M) : 0;
+	m = static_cast<int>((m + substeps) % M);
+	return outputs;
+}
+
 template<typename FloatType>
 class ResamplingStage
 {
 public:
-	ResamplingStage(int L, int M, FIRFilter<FloatType>& filter, bool bypassMode = false)
-		: L(L), M(M),  m(0), filter(filter), bypassMode(bypassMode)
+	ResamplingStage(int L, int M, FIRFilter<FloatType>&& filter, bool bypassMode = false)
+		: L(L), M(M),  m(0), filter(std::move(filter)), bypassMode(bypassMode), bSpecialisedKernels(true), bSilenceFastPath(true), bProfile(false), tapsPerOutput(0.0), zeroRun(0), silentThreshold(0)
 	{
 		SetConvertFunction();
+		zeroRun = silentThreshold; // (history starts out clear)
 	}
 
 	void convert(FloatType* outBuffer, size_t& outBufferSize, const FloatType* inBuffer, const size_t& inBufferSize) {
-		(this->*convertFn)(outBuffer, outBufferSize, inBuffer, inBufferSize);
+		if (bProfile) {
+			ProfileScope scope(&profileRecord);
+			bool silent = convertBlock(outBuffer, outBufferSize, inBuffer, inBufferSize);
+			profileRecord.frames += outBufferSize;
+			if (silent)
+				profileRecord.silentFrames += outBufferSize;
+			else
+				profileRecord.macs += static_cast<uint64_t>(outBufferSize * tapsPerOutput);
+		}
+		else {
+			convertBlock(outBuffer, outBufferSize, inBuffer, inBufferSize);
+		}
+	}
+
+	// setProfiling() : enable collection of timing / tap-count statistics for this stage
+	void setProfiling(bool bProfile) {
+		ResamplingStage::bProfile = bProfile;
+	}
+
+	const ProfileRecord& getProfile() const {
+		return profileRecord;
+	}
+
+	int getL() const {
+		return L;
+	}
+
+	int getM() const {
+		return M;
+	}
+
+	int getFilterLength() const {
+		return filter.getLength();
+	}
+
+	std::vector<FloatType> getFilterTaps() const {
+		return filter.getTaps();
+	}
+
+	bool isBypassMode() const {
+		return bypassMode;
+	}
+
+	size_t getFilterMemorySize() const {
+		return filter.getMemorySize();
+	}
+
+	// getMaxOutputSize() : the most output samples this stage can produce from inputSize input samples
+	size_t getMaxOutputSize(size_t inputSize) const {
+		return (inputSize * L + M - 1) / M;
 	}
 
 	void setBypassMode(bool bypassMode) {
@@ -77,9 +191,26 @@ public:
 		SetConvertFunction();
 	}
 
-	void reset() {
-		filter.reset();
-		m = 0;
+	// setSilenceFastPath() : choose whether blocks of digital silence may be converted without filtering (see convertBlock())
+	void setSilenceFastPath(bool bSilenceFastPath) {
+		ResamplingStage::bSilenceFastPath = bSilenceFastPath;
+	}
+
+	bool hasSilenceFastPath() const {
+		return bSilenceFastPath;
+	}
+
+	// setSpecialisedKernels() : choose whether a kernel specialised for this stage's ratio may be used (false: always use the generic kernels)
+	void setSpecialisedKernels(bool bSpecialisedKernels) {
+		ResamplingStage::bSpecialisedKernels = bSpecialisedKernels;
+		SetConvertFunction();
+	}
+
+	// reset() : clear the filter, and set the phase to what it would be after inputPosition input samples
+	void reset(uint64_t inputPosition = 0) {
+		filter.reset(inputPosition * L); // (L samples are put into the filter for each input sample)
+		m = static_cast<int>(inputPosition * L % M);
+		zeroRun = silentThreshold;
 	}
 
 private:
@@ -88,12 +219,36 @@ private:
 	int m;	// decimation index
 	FIRFilter<FloatType> filter;
 	bool bypassMode;
+	bool bSpecialisedKernels;
+	bool bSilenceFastPath;
+	bool bProfile;
+	double tapsPerOutput; // average number of filter taps evaluated per output sample
+	ProfileRecord profileRecord;
+	uint64_t zeroRun;			// number of consecutive zero samples at the end of the input so far
+	uint64_t silentThreshold;	// length of a run of zero input samples which leaves nothing but zeros in the filter's history
 	
 	// The following typedef defines the type 'ConvertFunction' which is a pointer to any of the member functions which 
 	// take the arguments (FloatType* outBuffer, size_t& outBufferSize, const FloatType* inBuffer, const size_t& inBufferSize) ...
 	typedef void (ResamplingStage::*ConvertFunction) (FloatType* outBuffer, size_t& outBufferSize, const FloatType* inBuffer, const size_t& inBufferSize); // see https://isocpp.org/wiki/faq/pointers-to-members
 	ConvertFunction convertFn;
 
+	// convertBlock() : convert a block of input. While the filter's history holds nothing but zeros, a block of zero input is converted
+	// without filtering (digital silence fast path): the output is all zeros, exactly as filtering would produce, and only the filter's
+	// write position and the decimation index need to move on. Returns true if the block was converted that way.
+	bool convertBlock(FloatType* outBuffer, size_t& outBufferSize, const FloatType* inBuffer, const size_t& inBufferSize) {
+		if (bSilenceFastPath && !bypassMode && zeroRun >= silentThreshold && countTrailingZeros(inBuffer, inBufferSize) == inBufferSize) {
+			outBufferSize = countOutputs(L, M, m, inBufferSize);
+			memset(outBuffer, 0, outBufferSize * sizeof(FloatType));
+			filter.skipZeros(static_cast<uint64_t>(inBufferSize) * L);
+			zeroRun += inBufferSize;
+			return true;
+		}
+		(this->*convertFn)(outBuffer, outBufferSize, inBuffer, inBufferSize);
+		size_t zeros = countTrailingZeros(inBuffer, inBufferSize);
+		zeroRun = (zeros == inBufferSize) ? zeroRun + zeros : zeros;
+		return false;
+	}
+
 	// passThrough() - just copies input straight to output (used in bypassMode mode)
 	void passThrough(FloatType* outBuffer, size_t& outBufferSize, const FloatType* inBuffer, const size_t& inBufferSize) {
 		memcpy(outBuffer, inBuffer, inBufferSize * sizeof(FloatType));
@@ -172,22 +327,103 @@ private:
 		m = localm;
 	}
 
+#ifdef USE_SPECIALISED_STAGE_KERNELS
+
+	// getT() : filter output, calculated in the same way as in the generic functions
+	template<int L, int M>
+	FloatType getT() {
+
+#ifdef USE_LAZYGET_ON_INTERPOLATE
+		const bool lazyInterpolate = true;
+#else
+		const bool lazyInterpolate = false;
+#endif
+
+#ifdef USE_LAZYGET_ON_INTERPOLATE_DECIMATE
+		const bool lazyInterpolateDecimate = true;
+#else
+		const bool lazyInterpolateDecimate = false;
+#endif
+
+		return (L != 1 && (M == 1 ? lazyInterpolate : lazyInterpolateDecimate)) ? filter.lazyGet(L) : filter.get();
+	}
+
+	// convertT() : bulk-skip conversion kernel, with L and M fixed at compile time (any combination).
+	// Rather than visiting each of the L sub-steps of every input sample (and testing the decimation index at each one),
+	// it steps straight from one output to the next, putting the stuffed zeros in between into the filter in bulk (FIRFilter::putZeros()).
+	// The decimation index is still a run-time value, stepped once per input sample; having L and M as constants
+	// turns the divisions and the sub-step loop bounds into constants (the phase cycle itself is not unrolled).
+	// The output is identical to that of the generic functions.
+	template<int L, int M>
+	void convertT(FloatType* outBuffer, size_t& outBufferSize, const FloatType* inBuffer, const size_t& inBufferSize) {
+		size_t o = 0;
+		int phase = m; // (decimation index at the start of the input sample)
+		for (size_t i = 0; i < inBufferSize; ++i) {
+			filter.put(inBuffer[i]);
+			int substepsDone = 1;
+			for (int l = (phase == 0) ? 0 : M - phase; l < L; l += M) { // (sub-steps at which an output occurs)
+				filter.putZeros(l + 1 - substepsDone);
+				substepsDone = l + 1;
+				outBuffer[o++] = getT<L, M>();
+			}
+			filter.putZeros(L - substepsDone);
+			phase = (phase + L) % M;
+		}
+		outBufferSize = o;
+		m = phase;
+	}
+
+	// getSpecialisedConvertFunction() : returns the kernel specialised for L and M (see SPECIALISED_STAGE_RATIOS), or nullptr if there isn't one
+	static ConvertFunction getSpecialisedConvertFunction(int L, int M) {
+
+#define RETURN_IF_SPECIALISED(l, m) if (L == l && M == m) return &ResamplingStage::convertT<l, m>;
+		SPECIALISED_STAGE_RATIOS(RETURN_IF_SPECIALISED)
+#undef RETURN_IF_SPECIALISED
+
+		return nullptr;
+	}
+
+#endif
+
 	void SetConvertFunction() {
+		const double length = filter.getLength();
+		silentThreshold = static_cast<uint64_t>((filter.getLength() + L - 1) / L); // (L samples are put into the filter for each input sample)
 		if (bypassMode) {
 			convertFn = &ResamplingStage::passThrough;
+			tapsPerOutput = 0.0;
 		}
 		else if (L == 1 && M == 1) {
 			convertFn = &ResamplingStage::filterOnly;
+			tapsPerOutput = length;
 		}
 		else if (L != 1 && M == 1) {
 			convertFn = &ResamplingStage::interpolate;
+#ifdef USE_LAZYGET_ON_INTERPOLATE
+			tapsPerOutput = length / L;
+#else
+			tapsPerOutput = length;
+#endif
 		}
 		else if (L == 1 && M != 1) {
 			convertFn = &ResamplingStage::decimate;
+			tapsPerOutput = length;
 		}
 		else {
 			convertFn = &ResamplingStage::interpolateAndDecimate;
+#ifdef USE_LAZYGET_ON_INTERPOLATE_DECIMATE
+			tapsPerOutput = length / L;
+#else
+			tapsPerOutput = length;
+#endif
+		}
+
+#ifdef USE_SPECIALISED_STAGE_KERNELS
+		if (bSpecialisedKernels && !bypassMode && (L != 1 || M != 1)) { // use a specialised kernel for this ratio, if there is one
+			if (ConvertFunction specialised = getSpecialisedConvertFunction(L, M))
+				convertFn = specialised;
 		}
+#endif
+
 	}
 };
 
@@ -195,7 +431,9 @@ template <typename FloatType>
 class Converter
 {
 public:
-	explicit Converter(const ConversionInfo& ci) : ci(ci), groupDelay(0.0), isBypassMode(false), gain(1.0) {
+	// bPrototype: only design the stages (to build a MultichannelConverter from - see mcconvert.h); the converter itself can't convert:
+	// its filters keep only their taps (no signal buffers), and it has no intermediate buffers
+	explicit Converter(const ConversionInfo& ci, bool bPrototype = false) : ci(ci), groupDelay(0.0), latency(0.0), maxOutputFrames(0), subBlockSize(MAX_SUBBLOCKSIZE), isBypassMode(false), isPrototype(bPrototype), gain(1.0) {
 		if (ci.outputSampleRate == ci.inputSampleRate) {
 			isBypassMode = true;
 			Converter::ci.bSingleStage = true;
@@ -208,39 +446,196 @@ public:
 			isMultistage = true;
 			initMultistage();
 		}
+
+		for (auto& stage : convertStages) { // (diagnostic options)
+			if (!ci.bSpecialisedKernels) {
+				stage.setSpecialisedKernels(false);
+			}
+			stage.setSilenceFastPath(ci.bSilenceFastPath);
+		}
 	}
 
 	void convert(FloatType* outBuffer, size_t& outBufferSize, const FloatType* inBuffer, const size_t& inBufferSize) {
 		if (isMultistage) {
-			const FloatType* in = inBuffer; // first stage reads directly from inBuffer. Subsequent stages read from output of previous stage
-			size_t inSize = inBufferSize;
-			size_t outSize = 0;
-			for (int i = 0; i < numStages; i++) {
-				FloatType* out = (i == indexOfLastStage) ? outBuffer : intermediateOutputBuffers[i].data(); // last stage writes straight to outBuffer;
-				convertStages[i].convert(out, outSize, in, inSize);
-				in = out; // input of next stage is the output of this stage
-				inSize = outSize;
+			// depth-first: push one sub-block at a time through the whole chain of stages,
+			// so that the intermediate data stays in the (small) intermediate buffers, in L1 / L2 cache
+			size_t outTotal = 0;
+			for (size_t start = 0; start < inBufferSize; start += subBlockSize) {
+				const FloatType* in = inBuffer + start; // first stage reads directly from inBuffer. Subsequent stages read from output of previous stage
+				size_t inSize = std::min(subBlockSize, inBufferSize - start);
+				size_t outSize = 0;
+				for (int i = 0; i < numStages; i++) {
+					FloatType* out = (i == indexOfLastStage) ? outBuffer + outTotal : intermediateOutputBuffers[i]; // last stage writes straight to outBuffer;
+					convertStages[i].convert(out, outSize, in, inSize);
+					in = out; // input of next stage is the output of this stage
+					inSize = outSize;
+				}
+				outTotal += outSize;
 			}
-			outBufferSize = outSize;
+			outBufferSize = outTotal;
 		}
 		else {
 			convertStages[0].convert(outBuffer, outBufferSize, inBuffer, inBufferSize);
 		}
 	}
 
+	// getGroupDelay() : number of output samples to be trimmed from the start of the output (0 for minimum-phase, or if delay trim is off)
 	double getGroupDelay() {
 		return groupDelay;
 	}
 
+	// getLatency() : algorithmic latency (delay at DC) of the whole conversion, in output samples (regardless of delay trim)
+	double getLatency() const {
+		return latency;
+	}
+
+	// getMaxOutputFrames() : the most output samples a single call to convert() can produce from ci.blockSize input samples
+	size_t getMaxOutputFrames() const {
+		return maxOutputFrames;
+	}
+
+	size_t getBlockSize() const {
+		return static_cast<size_t>(ci.blockSize);
+	}
+
+	size_t getSubBlockSize() const {
+		return subBlockSize;
+	}
+
+	// setBlockSize() : set the largest number of input samples to be passed to convert() (and choose the sub-block size).
+	// The intermediate buffers only need to hold the output of one sub-block (see convert()), so their size doesn't depend on the block size
+	// (they are allocated once, for the largest sub-block size; see allocateIntermediateBuffers())
+	void setBlockSize(size_t blockSize) {
+		ci.blockSize = static_cast<int>(blockSize);
+		subBlockSize = std::min(blockSize, chooseSubBlockSize(CacheInfo::get()));
+		maxOutputFrames = getMaxOutputSize(blockSize);
+	}
+
+	// getIntermediateBufferSizes() : size (in samples) of the output buffer of each stage except the last, for a given sub-block size
+	std::vector<size_t> getIntermediateBufferSizes(size_t subBlockSize) const {
+		std::vector<size_t> sizes;
+		size_t stageInputSize = subBlockSize;
+		for (int i = 0; i < indexOfLastStage; i++) {
+			stageInputSize = convertStages[i].getMaxOutputSize(stageInputSize);
+			sizes.push_back(stageInputSize);
+		}
+		return sizes;
+	}
+
+	// getWorkingSetSize() : the amount of memory (in bytes) used while converting a block of blockSize samples:
+	// the input and output buffers, the intermediate buffers, and the filters of all the stages
+	size_t getWorkingSetSize(size_t blockSize) const {
+		size_t bytes = (blockSize + getMaxOutputSize(blockSize)) * sizeof(FloatType);
+		for (size_t size : getIntermediateBufferSizes(std::min(blockSize, subBlockSize))) {
+			bytes += size * sizeof(FloatType);
+		}
+		for (const auto& stage : convertStages) {
+			bytes += stage.getFilterMemorySize();
+		}
+		return bytes;
+	}
+
+	// chooseBlockSize() : choose the largest block size (a power of two, from MIN_AUTO_BLOCKSIZE to BUFFERSIZE) for which
+	// the working set fits in half of this thread's share of the L2 cache (or failing that, the L3 cache),
+	// so that the output is still cache-resident when it is dithered and interleaved.
+	// concurrentThreads: number of converters running at the same time (which share any cache shared between CPUs)
+	// Returns BUFFERSIZE if the cache sizes are unknown, or the filters alone are too big for the caches.
+	size_t chooseBlockSize(const CacheInfo& cacheInfo, int concurrentThreads) const {
+		for (const CacheLevel* level : { &cacheInfo.l2, &cacheInfo.l3 }) {
+			if (level->size == 0)
+				continue;
+			size_t budget = level->size / 2 / std::max(1, std::min(level->sharedBy, concurrentThreads));
+			for (size_t blockSize = BUFFERSIZE; blockSize >= MIN_AUTO_BLOCKSIZE; blockSize /= 2) {
+				if (getWorkingSetSize(blockSize) <= budget)
+					return blockSize;
+			}
+		}
+		return BUFFERSIZE;
+	}
+
+	// chooseSubBlockSize() : choose the largest sub-block size (a power of two, from MIN_SUBBLOCKSIZE to MAX_SUBBLOCKSIZE)
+	// for which the intermediate buffers fit in half of the L1 data cache (MAX_SUBBLOCKSIZE if L1 cache size unknown)
+	size_t chooseSubBlockSize(const CacheInfo& cacheInfo) const {
+		if (cacheInfo.l1d.size == 0)
+			return MAX_SUBBLOCKSIZE;
+		size_t subBlockSize = MAX_SUBBLOCKSIZE;
+		for (; subBlockSize > MIN_SUBBLOCKSIZE; subBlockSize /= 2) {
+			size_t bytes = 0;
+			for (size_t size : getIntermediateBufferSizes(subBlockSize)) {
+				bytes += size * sizeof(FloatType);
+			}
+			if (bytes <= cacheInfo.l1d.size / 2)
+				break;
+		}
+		return subBlockSize;
+	}
+
 	double getGain() {
 		return gain;
 	}
 
-	void reset() {
+	// getArena() : the memory of this converter's filters and buffers
+	const Arena& getArena() const {
+		return arena;
+	}
+
+	// getStages() : the conversion stages (used as a prototype for MultichannelConverter)
+	const std::vector<ResamplingStage<FloatType>>& getStages() const {
+		return convertStages;
+	}
+
+	// setProfiling() : enable collection of per-stage statistics
+	void setProfiling(bool bProfile) {
+		for (auto& stage : convertStages) {
+			stage.setProfiling(bProfile);
+		}
+	}
+
+	// getStageProfiles() : returns the statistics for each stage, labelled with the stage's parameters
+	std::vector<std::pair<std::string, ProfileRecord>> getStageProfiles() const {
+		std::vector<std::pair<std::string, ProfileRecord>> profiles;
+		for (int i = 0; i < numStages; i++) {
+			const ResamplingStage<FloatType>& stage = convertStages[i];
+			std::string name = "stage " + std::to_string(i + 1) + " (" + std::to_string(stage.getL()) + "/" + std::to_string(stage.getM()) +
+				", " + std::to_string(stage.getFilterLength()) + " taps)";
+			profiles.emplace_back(name, stage.getProfile());
+		}
+		return profiles;
+	}
+
+	// getAlignment() : conversion can be started part-way through the input (see reset()) at any multiple of this number of input samples.
+	// At these positions, the input position of every stage is a whole number of samples, and a multiple of the stage's decimation factor.
+	uint64_t getAlignment() const {
+		uint64_t alignment = 1;
+		for (const auto& stage : convertStages) {
+			alignment *= stage.getM();
+		}
+		return alignment;
+	}
+
+	// getPrerollSize() : the number of input samples needed to fill the history of every stage's filter.
+	// After this many input samples, the output of a conversion started part-way through the input is identical to that
+	// of a conversion started at the beginning
+	size_t getPrerollSize() const {
+		double preroll = 0.0;
+		double stageInputPeriod = 1.0; // duration of one input sample of the stage, in input samples of the converter
+		for (const auto& stage : convertStages) {
+			preroll += std::ceil(static_cast<double>(stage.getFilterLength()) / stage.getL()) * stageInputPeriod;
+			stageInputPeriod *= static_cast<double>(stage.getM()) / stage.getL();
+		}
+		return static_cast<size_t>(std::ceil(preroll));
+	}
+
+	// reset() : clear all filter history, ready to convert from input sample number inputPosition
+	// (which must be a multiple of getAlignment(), so that the output samples fall on the same instants as in a conversion from the start)
+	void reset(uint64_t inputPosition = 0) {
+		assert(inputPosition % getAlignment() == 0);
+		uint64_t stageInputPosition = inputPosition;
 		for (int i = 0; i < numStages; i++) {
-			convertStages[i].reset();
+			convertStages[i].reset(stageInputPosition);
+			stageInputPosition = stageInputPosition * convertStages[i].getL() / convertStages[i].getM();
 			if (i != indexOfLastStage) {
-				std::fill(intermediateOutputBuffers[i].begin(), intermediateOutputBuffers[i].end(), 0.0);
+				std::fill(intermediateOutputBuffers[i], intermediateOutputBuffers[i] + intermediateBufferSizes[i], 0.0);
 			}
 		}
 	}
@@ -258,11 +653,16 @@ private:
 		f.numerator *= ci.overSamplingFactor;
 		f.denominator *= ci.overSamplingFactor;
 
-		FIRFilter<FloatType> firFilter(filterTaps.data(), filterTaps.size());
-		convertStages.emplace_back(f.numerator, f.denominator, firFilter, isBypassMode);
+		FIRFilter<FloatType> firFilter(filterTaps.data(), filterTaps.size(), &arena, isPrototype);
+		firFilter.setExtendedPrecision(ci.bExtendedPrecision);
+		convertStages.emplace_back(f.numerator, f.denominator, std::move(firFilter), isBypassMode);
 		groupDelay = (ci.bMinPhase || !ci.bDelayTrim) ? 0 : (filterTaps.size() - 1) / 2 / f.denominator;
-		if (isBypassMode)
+		latency = getFilterDelay(filterTaps) / f.denominator;
+		if (isBypassMode) {
 			groupDelay = 0;
+			latency = 0.0;
+		}
+		setBlockSize(ci.blockSize);
 	}
 
 	void initMultistage() {
@@ -270,6 +670,7 @@ private:
 		auto fractions = getConversionStages(masterConversionRatio, ci.maxStages);
 		numStages = static_cast<int>(fractions.size());
 		indexOfLastStage = numStages - 1;
+		convertStages.reserve(numStages);
 		unsigned int inputRate = ci.inputSampleRate;
 		double stretch = (ci.lpfCutoff + ci.lpfTransitionWidth) / 100.0;
 		double lastStopFreq = stretch * inputRate / 2.0;
@@ -317,7 +718,8 @@ private:
 			std::vector<FloatType> filterTaps = makeFilterCoefficients<FloatType>(stageCi, fractions[i]);
 
 			// make the filter
-			FIRFilter<FloatType> firFilter(filterTaps.data(), filterTaps.size());
+			FIRFilter<FloatType> firFilter(filterTaps.data(), filterTaps.size(), &arena, isPrototype);
+			firFilter.setExtendedPrecision(ci.bExtendedPrecision);
 
 			if (ci.bShowStages) { // dump stage parameters:
 				std::cout << "Stage: " << 1 + i << "\n";
@@ -326,6 +728,7 @@ private:
 				std::cout << "ft: " << ft << "\n";
 				std::cout << "stopFreq: " << stopFreq << "\n";
 				std::cout << "transition width: " << stageCi.lpfTransitionWidth << " %\n";
+				std::cout << "stopband attenuation: " << (stageCi.stopbandAttenuation > 0.0 ? static_cast<int>(stageCi.stopbandAttenuation) : getDefaultStopbandAttenuation(fractions[i])) << " dB\n";
 				std::cout << "guarantee: " << lastStopFreq << "\n";
 				std::cout << "Generated Filter Size: " << filterTaps.size() << "\n";
 
@@ -353,36 +756,28 @@ private:
 			Fraction f = fractions[i];
 			f.numerator *= stageCi.overSamplingFactor;
 			f.denominator *= stageCi.overSamplingFactor;
-			convertStages.emplace_back(f.numerator, f.denominator, firFilter, false);
+			convertStages.emplace_back(f.numerator, f.denominator, std::move(firFilter), false);
 
 			// add Group Delay:
 			groupDelay *= (static_cast<double>(f.numerator) / f.denominator); // scale previous delay according to conversion ratio
 			groupDelay += (ci.bMinPhase || !ci.bDelayTrim) ? 0 : (filterTaps.size() - 1) / 2 / f.denominator; // add delay introduced by this stage
+			latency *= (static_cast<double>(f.numerator) / f.denominator);
+			latency += getFilterDelay(filterTaps) / f.denominator;
 
-			// calculate size of output buffer for this stage:
-			double cumulativeNumerator = 1.0;
-			double cumulativeDenominator = 1.0;
-			for (int j = 0; j <= i; j++) {
-				cumulativeNumerator *= fractions[j].numerator;
-				cumulativeDenominator *= fractions[j].denominator;
-			}
-			size_t outBufferSize = static_cast<size_t>(std::ceil(BUFFERSIZE * cumulativeNumerator / cumulativeDenominator));
-
-			// conditionally show outpout buffer size
 			if (ci.bShowStages) {
-				//std::cout << cumulativeNumerator << " / " << cumulativeDenominator << "\n";
-				std::cout << "Output Buffer Size: " << outBufferSize << "\n\n" << std::endl;
-			}
-
-			// make output buffer for this stage (last stage doesn't need one)
-			if (i != indexOfLastStage) {
-				intermediateOutputBuffers.emplace_back(std::vector<FloatType>(outBufferSize, 0.0));
+				std::cout << std::endl;
 			}
 
 			// set input rate of next stage
 			inputRate = stageCi.outputSampleRate;
 		} // ends loop over i
 
+		// make output buffer for each stage (last stage doesn't need one):
+		if (!isPrototype) {
+			allocateIntermediateBuffers();
+		}
+		setBlockSize(ci.blockSize);
+
 		if (ci.bShowStages) {
 			std::cout << "Command lines to do this conversion in discreet steps:\n";
 			for (auto& cmdline : stageCommandLines) {
@@ -392,16 +787,40 @@ private:
 		}
 	} // initMultistage()
 
+	// allocateIntermediateBuffers() : allocate (from the arena) an output buffer for each stage except the last,
+	// large enough for the largest sub-block size
+	void allocateIntermediateBuffers() {
+		intermediateBufferSizes = getIntermediateBufferSizes(MAX_SUBBLOCKSIZE);
+		for (size_t size : intermediateBufferSizes) {
+			intermediateOutputBuffers.push_back(arena.allocateArray<FloatType>(size, ALIGNMENT_SIZE));
+		}
+	}
+
+	// getMaxOutputSize() : the most output samples the chain of stages can produce from inputSize input samples
+	size_t getMaxOutputSize(size_t inputSize) const {
+		size_t size = inputSize;
+		for (const auto& stage : convertStages) {
+			size = stage.getMaxOutputSize(size);
+		}
+		return size;
+	}
+
 private:
+	Arena arena; // (all filter kernels, histories and intermediate buffers of this converter)
 	ConversionInfo ci;
 	double groupDelay;
+	double latency;
+	size_t maxOutputFrames;
+	size_t subBlockSize;	// number of input samples pushed through the whole chain of stages at a time (multi-stage)
 	std::vector<ResamplingStage<FloatType>> convertStages;
 	int numStages;
 	int indexOfLastStage;
-	std::vector<std::vector<FloatType>> intermediateOutputBuffers;	// intermediate output buffer for each ConvertStage;
+	std::vector<FloatType*> intermediateOutputBuffers;	// intermediate output buffer for each ConvertStage (in arena);
+	std::vector<size_t> intermediateBufferSizes;
 	std::vector<std::string> stageCommandLines;
 	bool isMultistage;
 	bool isBypassMode;
+	bool isPrototype;	// (see constructor)
 	double gain;
 };
 
@@ -0,0 +1,58 @@
+#!/usr/bin/env bash
+
+# asyncio.sh : checks that converting with asynchronous I/O (--asyncIO, --ioDepth, --directIO)
+# gives exactly the same output file as converting with ordinary (synchronous) I/O.
+#
+# Exits with a non-zero status if any comparison fails.
+#
+# usage: ./asyncio.sh
+#
+# the input file and conversions can be changed using environment variables, eg:
+#   INPUT=./inputs/big.rf64 RATES="44100" FORMATS="wav rf64" ./asyncio.sh
+
+function tolower(){
+    echo $1 | sed "y/ABCDEFGHIJKLMNOPQRSTUVWXYZ/abcdefghijklmnopqrstuvwxyz/"
+}
+
+os=`tolower $OSTYPE`
+
+# set converter path according to OS:
+if [ $os == 'cygwin' ] || [ $os == 'msys' ]
+then
+    #Windows ...
+    resampler_path=../x64/Release/ReSampler.exe
+else
+    resampler_path=../ReSampler
+fi
+
+input=${INPUT:-"./inputs/96khz_sweep-3dBFS_32f.wav"}
+output_path=./outputs
+rates=${RATES:-"44100 192000"}
+formats=${FORMATS:-"wav w64 flac"}
+
+failures=0
+for rate in $rates
+do
+    for format in $formats
+    do
+        sync=$output_path/asyncio-sync.$format
+        async=$output_path/asyncio-async.$format
+        options="-r $rate -b 24 --dither --seed 1234"
+        $resampler_path -i $input -o $sync $options > /dev/null
+        for io in "--asyncIO" "--asyncIO --ioDepth 1" "--asyncIO --ioDepth 16" "--directIO"
+        do
+            $resampler_path -i $input -o $async $options $io > /dev/null
+            if cmp -s $sync $async
+            then
+                echo "$rate $format $io: pass"
+            else
+                echo "$rate $format $io: FAIL"
+                failures=$((failures + 1))
+            fi
+            rm -f $async
+        done
+        rm -f $sync
+    done
+done
+
+exit $failures
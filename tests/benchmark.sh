@@ -0,0 +1,126 @@
+#!/usr/bin/env bash
+
+# benchmark.sh : end-to-end throughput benchmark
+#
+# Generates synthetic (exponential sweep) input files on tmpfs and runs full conversions over a matrix of:
+#   input rate x output rate x channels x precision x stages x threading x output format
+# Results are written to a csv file (one row per conversion), suitable for diffing between releases.
+#
+# usage: ./benchmark.sh [--full] [<results.csv>]
+#
+#   --full : use every rate in the 'rates' list of testConverterStageSelection() (fraction.h)
+#            (default: a smaller set of common rates)
+#
+# the matrix can be narrowed using environment variables, eg:
+#   RATES="44100 96000" CHANNELS="2" FORMATS="pcm16 flac" DURATION=30 ./benchmark.sh
+
+function tolower(){
+    echo $1 | sed "y/ABCDEFGHIJKLMNOPQRSTUVWXYZ/abcdefghijklmnopqrstuvwxyz/"
+}
+
+os=`tolower $OSTYPE`
+
+# set converter path according to OS:
+if [ $os == 'cygwin' ] || [ $os == 'msys' ]
+then
+    #Windows ...
+    resampler_path=../x64/Release/ReSampler.exe
+else
+    resampler_path=../ReSampler
+fi
+
+# (the full list of rates is read from testConverterStageSelection() in fraction.h, so that there is only one copy of it)
+full_rates=`sed -n 's/^[[:space:]]*std::vector<int> rates{\(.*\)};.*$/\1/p' ../fraction.h | tr -d ','`
+if [ -z "$full_rates" ]
+then
+    echo "couldn't read the list of rates from ../fraction.h"
+    exit 1
+fi
+common_rates="44100 48000 88200 96000 176400 192000"
+
+results=./benchmark.csv
+rates=${RATES:-$common_rates}
+for arg in "$@"
+do
+    if [ "$arg" == '--full' ]
+    then
+        rates=${RATES:-$full_rates}
+    else
+        results=$arg
+    fi
+done
+
+channels=${CHANNELS:-"1 2 6 8"}
+precisions=${PRECISIONS:-"float double"}
+stages=${STAGES:-"multi single"}
+threading=${THREADING:-"st mt"}
+formats=${FORMATS:-"pcm16 pcm24 float flac"}
+duration=${DURATION:-10}
+
+# use tmpfs for inputs and outputs (if available), so that disk speed doesn't dominate the results:
+if [ -d /dev/shm ]
+then
+    work_path=`mktemp -d /dev/shm/resampler-benchmark.XXXXXX`
+else
+    work_path=`mktemp -d`
+fi
+trap "rm -rf $work_path" EXIT
+
+version=`$resampler_path --version`
+
+echo "version,in_rate,out_rate,channels,precision,stages,threading,format,input_seconds,total_ms,x_realtime,peak_rss_kb,peak_scan_ms,convert_ms,tempfile_ms" > $results
+
+for in_rate in $rates
+do
+    for ch in $channels
+    do
+        input=$work_path/sweep-${in_rate}-${ch}ch.wav
+        $resampler_path --generate $input -r $in_rate --channels $ch --duration $duration > /dev/null
+
+        for out_rate in $rates
+        do
+            [ $in_rate == $out_rate ] && continue
+            for precision in $precisions
+            do
+                for stage in $stages
+                do
+                    for thread in $threading
+                    do
+                        for format in $formats
+                        do
+                            options="-r $out_rate --noPeakChunk --showTimings"
+                            [ $precision == 'double' ] && options="$options --doubleprecision"
+                            [ $stage == 'single' ] && options="$options --singleStage" || options="$options --multiStage"
+                            [ $thread == 'mt' ] && options="$options --mt"
+
+                            case $format in
+                                pcm16) ext=wav; options="$options -b 16" ;;
+                                pcm24) ext=wav; options="$options -b 24" ;;
+                                float) ext=wav; options="$options -b 32f" ;;
+                                flac) ext=flac; options="$options -b 24" ;;
+                            esac
+
+                            output=$work_path/output.$ext
+                            log=`$resampler_path -i $input -o $output $options`
+                            rm -f $output
+
+                            total_ms=`echo "$log" | sed -n 's/.*Time=\([0-9]*\) ms.*/\1/p'`
+                            peak_scan_ms=`echo "$log" | sed -n 's/.*peak scan=\([0-9.]*\) ms.*/\1/p'`
+                            convert_ms=`echo "$log" | sed -n 's/.*convert=\([0-9.]*\) ms.*/\1/p'`
+                            tempfile_ms=`echo "$log" | sed -n 's/.*temp file pass=\([0-9.]*\) ms.*/\1/p'`
+                            peak_rss_kb=`echo "$log" | sed -n 's/.*peak RSS=\([0-9]*\) kB.*/\1/p'`
+                            # (the generated sweep length is rounded to a multiple of its period; see generateExpSweep())
+                            input_seconds=`awk "BEGIN { M = 8192 * 12 * log(2); printf \"%.3f\", int(int($duration * $in_rate / M + 0.5) * M) / $in_rate }"`
+                            x_realtime=`awk "BEGIN { if ($total_ms + 0 > 0) printf \"%.1f\", 1000 * $input_seconds / $total_ms; else print \"\" }"`
+
+                            row="$version,$in_rate,$out_rate,$ch,$precision,$stage,$thread,$format,$input_seconds,$total_ms,$x_realtime,$peak_rss_kb,$peak_scan_ms,$convert_ms,$tempfile_ms"
+                            echo $row
+                            echo $row >> $results
+                        done
+                    done
+                done
+            done
+        done
+        rm -f $input
+    done
+done
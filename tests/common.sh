@@ -0,0 +1,35 @@
+#!/usr/bin/env bash
+
+# common.sh : definitions shared by the test scripts (source it from the tests directory):
+# resampler_path (the converter, according to OS), and check(), which reports the result of a check, and counts failures.
+#
+# usage: source ./common.sh
+
+function tolower(){
+    echo $1 | sed "y/ABCDEFGHIJKLMNOPQRSTUVWXYZ/abcdefghijklmnopqrstuvwxyz/"
+}
+
+os=`tolower $OSTYPE`
+
+# set converter path according to OS:
+if [ $os == 'cygwin' ] || [ $os == 'msys' ]
+then
+    #Windows ...
+    resampler_path=../x64/Release/ReSampler.exe
+else
+    resampler_path=../ReSampler
+fi
+
+failures=0
+
+# check <name> <condition> : report result of a check
+# (note: <condition> is usually $?, so <name> must not contain a command substitution, which would change $? before it is read)
+function check(){
+    if [ $2 -eq 0 ]
+    then
+        echo "$1: pass"
+    else
+        echo "$1: FAIL"
+        failures=$((failures + 1))
+    fi
+}
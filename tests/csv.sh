@@ -0,0 +1,35 @@
+#!/usr/bin/env bash
+
+# csv.sh : checks csv output formatted concurrently (with --mt) against csv output formatted serially (without --mt):
+# the two files must be byte-for-byte identical, for each numeric format (signed / unsigned integer, floating-point, octal, hexadecimal).
+# Large blocks (--blockSize) are used, so that each block written is split into several chunks, which are formatted concurrently with --mt.
+# Exits with a non-zero status if any check fails.
+#
+# usage: ./csv.sh
+#
+# the conversions can be changed using environment variables, eg:
+#   RATES="44100" BITFORMATS="16 32f" ./csv.sh
+
+source ./common.sh
+
+input=${INPUT:-"./inputs/96khz_sweep-3dBFS_32f.wav"}
+output_path=./outputs
+rates=${RATES:-"44100 96000"}
+bitformats=${BITFORMATS:-"16 24 u8 32f 64f 16o 24x"}
+
+for rate in $rates
+do
+    for bitformat in $bitformats
+    do
+        options="-r $rate -b $bitformat --dither --seed 1234 --blockSize 32768"
+        serial=$output_path/csv-serial.csv
+        concurrent=$output_path/csv-concurrent.csv
+        $resampler_path -i $input -o $serial $options > /dev/null
+        $resampler_path -i $input -o $concurrent $options --mt > /dev/null
+        [ -s $serial ] && cmp -s $serial $concurrent
+        check "$rate $bitformat: same with --mt" $?
+        rm -f $serial $concurrent
+    done
+done
+
+exit $failures
@@ -0,0 +1,61 @@
+#!/usr/bin/env bash
+
+# formatonly.sh : checks format-only conversions (output sampling rate the same as the input's):
+# the output must be exactly the same as that of the regular conversion path (which a same-rate conversion of a single segment,
+# followed by stitching, takes), whether channels are processed one at a time or concurrently (--mt), and with or without a temp file;
+# and when the gain would make the output clip, the gain must be adjusted up-front (without converting again),
+# so that the output doesn't exceed full scale.
+# Exits with a non-zero status if any check fails.
+#
+# usage: ./formatonly.sh
+#
+# the conversions can be changed using environment variables, eg:
+#   BITFORMATS="16 24" OPTIONS="--doubleprecision" ./formatonly.sh
+
+source ./common.sh
+
+input=${INPUT:-"./inputs/96khz_sweep-3dBFS_32f.wav"}
+output_path=./outputs
+rate=${RATE:-"96000"} # (the sampling rate of the input file)
+bitformats=${BITFORMATS:-"8 16 24 32f"}
+extra_options=${OPTIONS:-""}
+
+for bitformat in $bitformats
+do
+    options="-r $rate -b $bitformat --dither --seed 1234 --noMetadata --noPeakChunk $extra_options"
+    reference=$output_path/formatonly-reference.wav
+    output=$output_path/formatonly-output.wav
+    log=$output_path/formatonly.log
+    $resampler_path -i $input -o $reference $options > $log
+    grep -q 'Converting (format only' $log
+    check "$bitformat: format-only path" $?
+
+    # regular path:
+    regular=$output_path/formatonly-regular.wav
+    $resampler_path -i $input -o $regular $options --segment 1 --segments 1 > /dev/null
+    $resampler_path -i $input -o $regular $options --stitch --segments 1 > /dev/null
+    cmp -s $reference $regular
+    check "$bitformat: same as regular path" $?
+    rm -f $regular $regular.seg1 $regular.seg1.manifest
+
+    for mode in "--mt" "--noTempFile"
+    do
+        $resampler_path -i $input -o $output $options $mode > /dev/null
+        cmp -s $reference $output
+        check "$bitformat $mode: output unchanged" $?
+    done
+
+    # +6 dB on a -3 dBFS input: gain must be adjusted up-front (and not again after dither), and the output must not clip
+    # (checked without dither, since clipping protection applies to the signal before dither):
+    $resampler_path -i $input -o $output $options --gain 2 > $log
+    grep -q 'Clipping expected' $log && ! grep -q 'Re-doing' $log && ! grep -q 'Writing to output file' $log
+    check "$bitformat --gain 2: gain adjusted up-front" $?
+    $resampler_path -i $input -o $output ${options/--dither /} --gain 2 > /dev/null
+    peak=`$resampler_path -i $output -o $reference -r $rate -b 64f --noMetadata | grep 'Peak input sample' | sed 's/Peak input sample: \([0-9.]*\).*/\1/'`
+    awk "BEGIN { exit !($peak <= 1.0) }"
+    check "$bitformat --gain 2: peak $peak" $?
+
+    rm -f $reference $output $log
+done
+
+exit $failures
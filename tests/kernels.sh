@@ -0,0 +1,64 @@
+#!/usr/bin/env bash
+
+# kernels.sh : checks that the conversion kernels specialised for common stage ratios (see SPECIALISED_STAGE_RATIOS in srconvert.h)
+# give exactly the same output as the generic kernels (--noSpecialisedKernels),
+# for single-stage and multi-stage conversions, in single, double and extended precision.
+# Exits with a non-zero status if any comparison fails.
+#
+# usage: ./kernels.sh
+#
+# the conversions can be changed using environment variables, eg:
+#   MODES="--singleStage" ./kernels.sh
+
+function tolower(){
+    echo $1 | sed "y/ABCDEFGHIJKLMNOPQRSTUVWXYZ/abcdefghijklmnopqrstuvwxyz/"
+}
+
+os=`tolower $OSTYPE`
+
+# set converter path according to OS:
+if [ $os == 'cygwin' ] || [ $os == 'msys' ]
+then
+    #Windows ...
+    resampler_path=../x64/Release/ReSampler.exe
+else
+    resampler_path=../ReSampler
+fi
+
+input44k=./inputs/44khz_sweep-3dBFS_32f.wav
+input96k=./inputs/96khz_sweep-3dBFS_32f.wav
+output_path=./outputs
+input48k=$output_path/kernels-input-48k.wav
+input88k=$output_path/kernels-input-88k.wav
+modes=${MODES:-"--multiStage --singleStage --doubleprecision --extendedPrecision"}
+
+# 48k and 88.2k inputs, to cover the ratios from those rates:
+$resampler_path -i $input96k -o $input48k -r 48000 -b 32f --noMetadata > /dev/null
+$resampler_path -i $input44k -o $input88k -r 88200 -b 32f --noMetadata > /dev/null
+
+failures=0
+for conversion in "$input44k 48000" "$input44k 88200" "$input44k 96000" "$input48k 44100" "$input88k 44100" "$input96k 44100" "$input96k 48000"
+do
+    set -- $conversion
+    input=$1
+    rate=$2
+    for mode in $modes
+    do
+        options="-r $rate -b 64f --noMetadata --noPeakChunk $mode"
+        specialised=$output_path/kernels-specialised.wav
+        generic=$output_path/kernels-generic.wav
+        $resampler_path -i $input -o $specialised $options > /dev/null
+        $resampler_path -i $input -o $generic $options --noSpecialisedKernels > /dev/null
+        if cmp -s $specialised $generic
+        then
+            echo "`basename $input` -> $rate $mode: pass"
+        else
+            echo "`basename $input` -> $rate $mode: FAIL"
+            failures=$((failures + 1))
+        fi
+        rm -f $specialised $generic
+    done
+done
+
+rm -f $input48k $input88k
+exit $failures
@@ -0,0 +1,63 @@
+#!/usr/bin/env bash
+
+# metrics.sh : checks the live metrics reported with --metrics, to a file of JSON lines, to a file descriptor and to a Prometheus textfile:
+# each must pass through the expected phases and finish with a 'done' snapshot,
+# and the output file must be exactly the same as without --metrics (also when the reader of a pipe goes away early).
+# Exits with a non-zero status if any check fails.
+#
+# usage: ./metrics.sh
+#
+# the conversions can be changed using environment variables, eg:
+#   RATES="44100" OPTIONS="--mt" ./metrics.sh
+
+source ./common.sh
+
+input=${INPUT:-"./inputs/96khz_sweep-3dBFS_32f.wav"}
+output_path=./outputs
+rates=${RATES:-"44100 192000"}
+extra_options=${OPTIONS:-""}
+
+for rate in $rates
+do
+    for mode in "" "--noTempFile" "--mt"
+    do
+        options="-r $rate -b 24 --dither --seed 1234 --noMetadata $mode $extra_options"
+        name="$rate ${mode:-tempfile}"
+        reference=$output_path/metrics-reference.wav
+        output=$output_path/metrics-output.wav
+        jsonl=$output_path/metrics.jsonl
+        prom=$output_path/metrics.prom
+        $resampler_path -i $input -o $reference $options > /dev/null
+
+        # JSON lines to a file:
+        $resampler_path -i $input -o $output $options --metrics $jsonl --metricsInterval 0.05 > /dev/null
+        cmp -s $reference $output
+        check "$name json: output unchanged" $?
+        grep -q '"phase": "peak scan"' $jsonl && grep -q '"phase": "convert"' $jsonl && tail -n 1 $jsonl | grep -q '"phase": "done"'
+        check "$name json: phases" $?
+        if [ -z "$mode" ]
+        then
+            grep -q '"phase": "temp pass"' $jsonl
+            check "$name json: temp pass" $?
+        fi
+
+        # JSON lines to a file descriptor:
+        $resampler_path -i $input -o $output $options --metrics fd:3 3> $jsonl > /dev/null
+        tail -n 1 $jsonl | grep -q '"phase": "done"'
+        check "$name fd: done" $?
+
+        # JSON lines to a pipe whose reader goes away early: the conversion must carry on regardless:
+        $resampler_path -i $input -o $output $options --metrics fd:3 --metricsInterval 0.05 3>&1 > /dev/null | head -c 1 > /dev/null
+        cmp -s $reference $output
+        check "$name fd: reader gone, output unchanged" $?
+
+        # Prometheus textfile:
+        $resampler_path -i $input -o $output $options --metrics $prom > /dev/null
+        grep -q 'resampler_phase{phase="done"} 1' $prom && grep -q '^resampler_worker_utilisation{worker="0"}' $prom && [ ! -e $prom.tmp ]
+        check "$name prom: done" $?
+
+        rm -f $reference $output $jsonl $prom
+    done
+done
+
+exit $failures
@@ -0,0 +1,69 @@
+#!/usr/bin/env bash
+
+# mmap.sh : checks that reading the input file by memory-mapping it (--mmap)
+# gives exactly the same output file as reading it through libsndfile.
+#
+# Input files in each of the supported sample formats and file types are made from the sweep first.
+# Exits with a non-zero status if any comparison fails.
+#
+# usage: ./mmap.sh
+#
+# the conversions can be changed using environment variables, eg:
+#   RATES="44100" BITFORMATS="16 24" TYPES="wav w64" ./mmap.sh
+
+function tolower(){
+    echo $1 | sed "y/ABCDEFGHIJKLMNOPQRSTUVWXYZ/abcdefghijklmnopqrstuvwxyz/"
+}
+
+os=`tolower $OSTYPE`
+
+# set converter path according to OS:
+if [ $os == 'cygwin' ] || [ $os == 'msys' ]
+then
+    #Windows ...
+    resampler_path=../x64/Release/ReSampler.exe
+else
+    resampler_path=../ReSampler
+fi
+
+sweep=${INPUT:-"./inputs/96khz_sweep-3dBFS_32f.wav"}
+output_path=./outputs
+rates=${RATES:-"44100 192000"}
+bitformats=${BITFORMATS:-"8 16 24 32 32f 64f"}
+types=${TYPES:-"wav rf64 w64"}
+
+failures=0
+for type in $types
+do
+    for bitformat in $bitformats
+    do
+        input=$output_path/mmap-input.$type
+        if [ $type == 'rf64' ]
+        then
+            $resampler_path -i $sweep -o $output_path/mmap-input.wav -r 96000 -b $bitformat --rf64 > /dev/null
+            mv $output_path/mmap-input.wav $input
+        else
+            $resampler_path -i $sweep -o $input -r 96000 -b $bitformat > /dev/null
+        fi
+
+        for rate in $rates
+        do
+            normal=$output_path/mmap-normal.wav
+            mapped=$output_path/mmap-mapped.wav
+            options="-r $rate -b 24 --dither --seed 1234"
+            $resampler_path -i $input -o $normal $options > /dev/null
+            $resampler_path -i $input -o $mapped $options --mmap > /dev/null
+            if cmp -s $normal $mapped
+            then
+                echo "$type $bitformat $rate: pass"
+            else
+                echo "$type $bitformat $rate: FAIL"
+                failures=$((failures + 1))
+            fi
+            rm -f $normal $mapped
+        done
+        rm -f $input
+    done
+done
+
+exit $failures
@@ -0,0 +1,76 @@
+#!/usr/bin/env bash
+
+# nativewriter.sh : checks that writing the output file with the native writer (--nativeWriter)
+# gives exactly the same samples as writing it through libsndfile.
+#
+# The files themselves differ (eg libsndfile adds a PEAK chunk to floating-point files),
+# so both outputs are read back (by converting them to 64-bit floating-point wav files), and those are compared.
+# Exits with a non-zero status if any comparison fails.
+#
+# usage: ./nativewriter.sh
+#
+# the conversions can be changed using environment variables, eg:
+#   RATES="44100" BITFORMATS="16 24" TYPES="wav aiff" ./nativewriter.sh
+
+function tolower(){
+    echo $1 | sed "y/ABCDEFGHIJKLMNOPQRSTUVWXYZ/abcdefghijklmnopqrstuvwxyz/"
+}
+
+os=`tolower $OSTYPE`
+
+# set converter path according to OS:
+if [ $os == 'cygwin' ] || [ $os == 'msys' ]
+then
+    #Windows ...
+    resampler_path=../x64/Release/ReSampler.exe
+else
+    resampler_path=../ReSampler
+fi
+
+input=${INPUT:-"./inputs/96khz_sweep-3dBFS_32f.wav"}
+output_path=./outputs
+rates=${RATES:-"44100 192000"}
+bitformats=${BITFORMATS:-"8 16 24 32 32f 64f"}
+types=${TYPES:-"wav rf64 w64 aiff"}
+
+failures=0
+for type in $types
+do
+    for bitformat in $bitformats
+    do
+        # (aiff: no floating-point formats)
+        if [ $type == 'aiff' ] && [[ $bitformat == *f ]]
+        then
+            continue
+        fi
+
+        for rate in $rates
+        do
+            ext=$type
+            options="-r $rate -b $bitformat --dither --seed 1234 --noMetadata"
+            if [ $type == 'rf64' ]
+            then
+                ext=wav
+                options="$options --rf64"
+            fi
+            normal=$output_path/native-normal.$ext
+            native=$output_path/native-native.$ext
+            $resampler_path -i $input -o $normal $options > /dev/null
+            $resampler_path -i $input -o $native $options --nativeWriter > /dev/null
+
+            # read back both files:
+            $resampler_path -i $normal -o $normal.64f.wav -r $rate -b 64f --noPeakChunk --noMetadata > /dev/null
+            $resampler_path -i $native -o $native.64f.wav -r $rate -b 64f --noPeakChunk --noMetadata > /dev/null
+            if [ -s $native.64f.wav ] && cmp -s $normal.64f.wav $native.64f.wav
+            then
+                echo "$type $bitformat $rate: pass"
+            else
+                echo "$type $bitformat $rate: FAIL"
+                failures=$((failures + 1))
+            fi
+            rm -f $normal $native $normal.64f.wav $native.64f.wav
+        done
+    done
+done
+
+exit $failures
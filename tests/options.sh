@@ -0,0 +1,65 @@
+#!/usr/bin/env bash
+
+# options.sh : checks that options which only change how a conversion is carried out - not what it calculates - give exactly the same output
+# as a conversion without them: multi-threading (--mt), thread placement (--affinity), block size (--blockSize) and FFT wisdom (--fftWisdom).
+# Checked for a 4-channel input, multi-stage, single-stage (which has filters long enough to be designed by several threads)
+# and minimum-phase (whose filters are designed using FFTs).
+# Also checks that a measuring FFT planner (--fftPlanner measure) gives the same output again once its plans are saved in a wisdom file.
+# (different planners can choose different FFT algorithms, whose results differ in rounding, so they aren't compared with each other)
+# Exits with a non-zero status if any check fails.
+#
+# usage: ./options.sh
+#
+# the conversions can be changed using environment variables, eg:
+#   RATES="96000" MODES="--minphase" ./options.sh
+
+source ./common.sh
+
+output_path=./outputs
+rates=${RATES:-"44100 96000"}
+modes=${MODES:-"--multiStage --singleStage --minphase"}
+wisdom=$output_path/options.wisdom
+options_list="--mt --affinity --mt_--affinity --affinity_0 --blockSize_1000 --blockSize_100000 --fftWisdom_$wisdom"
+# (options within a set are separated by underscores)
+
+input=$output_path/options-input.wav
+$resampler_path --generate $input -r 48000 --channels 4 --duration 2 > /dev/null
+
+for rate in $rates
+do
+    for mode in $modes
+    do
+        common_options="-r $rate -b 64f --noMetadata --noPeakChunk $mode"
+        reference=$output_path/options-reference.wav
+        output=$output_path/options-output.wav
+        $resampler_path -i $input -o $reference $common_options > /dev/null
+        for options in $options_list
+        do
+            options=${options//_/ }
+            rm -f $wisdom
+            $resampler_path -i $input -o $output $common_options $options > /dev/null
+            [ -s $reference ] && cmp -s $reference $output
+            check "$rate $mode $options: same output" $?
+            rm -f $output
+        done
+        rm -f $reference
+    done
+
+    # measured plans, saved in a wisdom file, and then loaded from it (with and without --mt):
+    common_options="-r $rate -b 64f --noMetadata --noPeakChunk --minphase --fftPlanner measure --fftWisdom $wisdom"
+    measured=$output_path/options-measured.wav
+    rm -f $wisdom
+    $resampler_path -i $input -o $measured $common_options > /dev/null
+    for options in "" "--mt"
+    do
+        output=$output_path/options-output.wav
+        $resampler_path -i $input -o $output $common_options $options > /dev/null
+        [ -s $measured ] && [ -s $wisdom ] && cmp -s $measured $output
+        check "$rate --minphase --fftPlanner measure${options:+ $options}: same output with saved wisdom" $?
+        rm -f $output
+    done
+    rm -f $measured $wisdom
+done
+
+rm -f $input
+exit $failures
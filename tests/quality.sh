@@ -0,0 +1,94 @@
+#!/usr/bin/env bash
+
+# quality.sh : checks the filters of each quality preset (--quality), as listed by --showStages:
+# every stage must have the preset's stopband attenuation (100 dB for draft, 120 dB for standard, 195 dB for mastering,
+# the default for the conversion ratio for high, and 110 dB for auto with 16-bit output, or the default if that is less),
+# and its filter length must be that of the same stage without --quality (with the preset's lowpass characteristic),
+# scaled by (attenuation - 7.95) / (default attenuation - 7.95), as the transition width is kept.
+# Also checks that --quality high (the default), and --quality auto with floating-point output, give exactly the same output as no --quality.
+# Exits with a non-zero status if any check fails.
+#
+# usage: ./quality.sh
+#
+# the presets can be changed using an environment variable, eg:
+#   PRESETS="draft auto" ./quality.sh
+
+source ./common.sh
+
+output_path=./outputs
+presets=${PRESETS:-"draft standard high mastering auto"}
+conversions="96khz_sweep-3dBFS_32f.wav:44100 44khz_sweep-3dBFS_32f.wav:88200"
+# (input file : output sample rate)
+
+# stages <log> : print the stopband attenuation and filter length of each stage listed by --showStages, one stage per line
+function stages(){
+    awk '/^stopband attenuation:/ { attenuation = $3 } /^Generated Filter Size:/ { print attenuation, $4 }' $1
+}
+
+# attenuation <preset> <default> : the stopband attenuation of a preset's filters (16-bit output), given the default for the stage
+function attenuation(){
+    case $1 in
+        draft) echo 100;;
+        standard) echo 120;;
+        mastering) echo 195;;
+        auto) echo $(( $2 < 110 ? $2 : 110 ));;
+        *) echo $2;;
+    esac
+}
+
+# lpf <preset> : the option selecting the preset's lowpass characteristic (if not the normal one)
+function lpf(){
+    case $1 in
+        draft) echo "--relaxedLPF";;
+        mastering) echo "--steepLPF";;
+    esac
+}
+
+for conversion in $conversions
+do
+    input=./inputs/${conversion%:*}
+    rate=${conversion#*:}
+    for preset in $presets
+    do
+        name="${conversion%:*} -> $rate --quality $preset"
+        reference=$output_path/quality-reference.wav
+        output=$output_path/quality-$preset.wav
+        reference_log=$output_path/quality-reference.log
+        log=$output_path/quality-$preset.log
+        $resampler_path -i $input -o $reference -r $rate -b 16 `lpf $preset` --showStages > $reference_log
+        $resampler_path -i $input -o $output -r $rate -b 16 --quality $preset --showStages > $log
+        [ `stages $reference_log | wc -l` -gt 0 ] && [ `stages $reference_log | wc -l` -eq `stages $log | wc -l` ]
+        check "$name: same stages" $?
+
+        result=0
+        while read default reference_taps attenuation taps
+        do
+            expected=`attenuation $preset $default`
+            echo "  stage: $attenuation dB (expected $expected dB), $taps taps (default: $reference_taps taps at $default dB)"
+            [ $attenuation -eq $expected ] || result=1
+            awk -v taps=$taps -v reference_taps=$reference_taps -v attenuation=$attenuation -v default=$default \
+                'BEGIN { expected = reference_taps * (attenuation - 7.95) / (default - 7.95); d = taps - expected; if (d < 0) d = -d; exit !(d <= 3) }' || result=1
+        done < <(paste -d ' ' <(stages $reference_log) <(stages $log))
+        check "$name: attenuation and filter lengths" $result
+
+        if [ $preset == "high" ]
+        then
+            [ -s $output ] && cmp -s $output $reference
+            check "$name: same output as default" $?
+        fi
+        rm -f $reference $output $reference_log $log
+    done
+
+    # auto keeps the default filters for floating-point output
+    # (no PEAK chunk, as it holds the time at which the file was written):
+    name="${conversion%:*} -> $rate --quality auto -b 32f"
+    reference=$output_path/quality-reference.wav
+    output=$output_path/quality-auto.wav
+    $resampler_path -i $input -o $reference -r $rate -b 32f --noPeakChunk > /dev/null
+    $resampler_path -i $input -o $output -r $rate -b 32f --noPeakChunk --quality auto > /dev/null
+    [ -s $output ] && cmp -s $output $reference
+    check "$name: same output as default" $?
+    rm -f $reference $output
+done
+
+exit $failures
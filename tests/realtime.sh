@@ -0,0 +1,52 @@
+#!/usr/bin/env bash
+
+# realtime.sh : worst-case block processing time of the real-time streaming engine (see realtime.h)
+#
+# Runs ReSampler --realtimeTest over a matrix of:
+#   block size x conversion x filter type
+# and reports the latency and the mean / 99.9th percentile / worst-case time taken to process one block.
+# Exits with a non-zero status if any block took longer than the duration of a block, or any reported latency was wrong.
+#
+# usage: ./realtime.sh
+#
+# the matrix can be narrowed using environment variables, eg:
+#   BLOCKSIZES="32 64" CONVERSIONS="44100:48000" FILTERS="--lowLatency" CHANNELS=2 DURATION=30 ./realtime.sh
+
+function tolower(){
+    echo $1 | sed "y/ABCDEFGHIJKLMNOPQRSTUVWXYZ/abcdefghijklmnopqrstuvwxyz/"
+}
+
+os=`tolower $OSTYPE`
+
+# set converter path according to OS:
+if [ $os == 'cygwin' ] || [ $os == 'msys' ]
+then
+    #Windows ...
+    resampler_path=../x64/Release/ReSampler.exe
+else
+    resampler_path=../ReSampler
+fi
+
+blocksizes=${BLOCKSIZES:-"32 64 128 256"}
+conversions=${CONVERSIONS:-"44100:48000 48000:44100 48000:96000 96000:48000"}
+filters=${FILTERS:-"--minphase --lowLatency"}
+channels=${CHANNELS:-2}
+duration=${DURATION:-10}
+
+failures=0
+for blocksize in $blocksizes
+do
+    for conversion in $conversions
+    do
+        in_rate=${conversion%:*}
+        out_rate=${conversion#*:}
+        for filter in $filters
+        do
+            $resampler_path --realtimeTest --inputRate $in_rate -r $out_rate --blockSize $blocksize --channels $channels --duration $duration $filter || failures=$((failures + 1))
+            echo
+        done
+    done
+done
+
+echo "$failures failure(s)"
+[ $failures == 0 ]
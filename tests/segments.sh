@@ -0,0 +1,62 @@
+#!/usr/bin/env bash
+
+# segments.sh : checks that converting a file in segments (--segment / --segments), and then stitching the segments (--stitch),
+# gives exactly the same output as converting the whole file in a single run.
+#
+# Both outputs are written to csv files, so that they can be compared.
+# Dither is used (with a fixed seed), to check that the stitched output also has the same dither noise.
+# Exits with a non-zero status if any comparison fails.
+#
+# usage: ./segments.sh
+#
+# the number of segments and conversions can be changed using environment variables, eg:
+#   SEGMENTS=7 RATES="44100 48000" FILTERS="--minphase" ./segments.sh
+
+function tolower(){
+    echo $1 | sed "y/ABCDEFGHIJKLMNOPQRSTUVWXYZ/abcdefghijklmnopqrstuvwxyz/"
+}
+
+os=`tolower $OSTYPE`
+
+# set converter path according to OS:
+if [ $os == 'cygwin' ] || [ $os == 'msys' ]
+then
+    #Windows ...
+    resampler_path=../x64/Release/ReSampler.exe
+else
+    resampler_path=../ReSampler
+fi
+
+input=${INPUT:-"./inputs/96khz_sweep-3dBFS_32f.wav"}
+output_path=./outputs
+segments=${SEGMENTS:-4}
+rates=${RATES:-"44100 48000 88200 192000"}
+filters=${FILTERS:-"--singleStage --multiStage --minphase --doubleprecision"}
+
+failures=0
+for rate in $rates
+do
+    for filter in $filters
+    do
+        single=$output_path/segments-single.csv
+        stitched=$output_path/segments-stitched.csv
+        options="-r $rate -b 16 --dither --seed 1234 $filter"
+        $resampler_path -i $input -o $single $options > /dev/null
+        for ((k = 1; k <= segments; k++))
+        do
+            $resampler_path -i $input -o $stitched $options --segment $k --segments $segments > /dev/null
+        done
+        $resampler_path -i $input -o $stitched $options --stitch --segments $segments > /dev/null
+
+        if cmp -s $single $stitched
+        then
+            echo "$rate $filter: pass"
+        else
+            echo "$rate $filter: FAIL"
+            failures=$((failures + 1))
+        fi
+        rm -f $single $stitched $stitched.seg*
+    done
+done
+
+exit $failures
@@ -0,0 +1,26 @@
+#!/usr/bin/env bash
+
+# selftest.sh : runs ReSampler's built-in self-test (--selfTest),
+# which checks the pseudo-random number generator used for dither against known-answer vectors,
+# checks that the block ditherer gives exactly the same output as the per-sample reference ditherer,
+# and checks the accuracy of the filters' extended-precision (compensated) accumulation against an exact reference.
+# Exits with a non-zero status if the self-test fails.
+#
+# usage: ./selftest.sh
+
+function tolower(){
+    echo $1 | sed "y/ABCDEFGHIJKLMNOPQRSTUVWXYZ/abcdefghijklmnopqrstuvwxyz/"
+}
+
+os=`tolower $OSTYPE`
+
+# set converter path according to OS:
+if [ $os == 'cygwin' ] || [ $os == 'msys' ]
+then
+    #Windows ...
+    resampler_path=../x64/Release/ReSampler.exe
+else
+    resampler_path=../ReSampler
+fi
+
+$resampler_path --selfTest
@@ -0,0 +1,92 @@
+#!/usr/bin/env bash
+
+# silence.sh : checks the digital silence fast path (once a conversion stage's filter holds nothing but zeros,
+# blocks of silent input are converted without filtering): conversions of a signal with long stretches of silence
+# (of +0.0 and of -0.0 samples) must give exactly the same output as with the fast path switched off (--noSilenceFastPath),
+# for single-stage and multi-stage conversions, with specialised and generic kernels, in single, double and extended precision,
+# channel-vectorised (--vectoriseChannels) or not,
+# when starting part-way through the input (--start), in or out of a silent stretch, and with small blocks (--blockSize),
+# so that the silent stretches start at various points of a block (with large blocks, the fast path is rarely taken close to its limit).
+# Also checks (with --profile) that the fast path is actually taken.
+# Exits with a non-zero status if any check fails.
+#
+# usage: ./silence.sh
+#
+# the conversions can be changed using environment variables, eg:
+#   RATES="48000" MODES="--singleStage --mt" ./silence.sh
+
+source ./common.sh
+
+output_path=./outputs
+input=$output_path/silence-input.wav
+rates=${RATES:-"48000 96000 32000"}
+modes=${MODES:-"--multiStage --singleStage --noSpecialisedKernels --doubleprecision --extendedPrecision --mt --start_2.5 --start_4.5 --blockSize_100 --mt_--blockSize_100 --singleStage_--blockSize_250 --extendedPrecision_--blockSize_100 --start_2.5_--blockSize_100 --vectoriseChannels --vectoriseChannels_--blockSize_100 --vectoriseChannels_--doubleprecision_--start_2.5"}
+# (options within a mode are separated by underscores)
+
+channels=4
+rate=44100
+bytesPerSecond=$((rate * channels * 4)) # (32-bit floating-point samples)
+
+# le32 <n>, le16 <n> : write n as a little-endian 32-bit / 16-bit integer
+function le32(){
+    printf "$(printf '\\x%02x\\x%02x\\x%02x\\x%02x' $(($1 & 255)) $((($1 >> 8) & 255)) $((($1 >> 16) & 255)) $((($1 >> 24) & 255)))"
+}
+function le16(){
+    printf "$(printf '\\x%02x\\x%02x' $(($1 & 255)) $((($1 >> 8) & 255)))"
+}
+
+# make the input: 1s of sound, 3s of +0.0, 1s of sound, 3s of -0.0, 1s of sound, 3s of +0.0
+sound=$output_path/silence-sound.wav
+sounddata=$output_path/silence-sound.raw
+negzeros=$output_path/silence-negzeros.raw
+data=$output_path/silence-data.raw
+$resampler_path --generate $sound -r $rate --channels $channels --duration 1 > /dev/null
+offset=`grep -obUa data $sound | head -1 | cut -d: -f1`
+tail -c +$((offset + 9)) $sound > $sounddata
+printf '\x00\x00\x00\x80' > $negzeros
+while [ `wc -c < $negzeros` -lt $((3 * bytesPerSecond)) ]
+do
+    cat $negzeros $negzeros > $negzeros.tmp
+    mv $negzeros.tmp $negzeros
+done
+{
+    cat $sounddata
+    head -c $((3 * bytesPerSecond)) /dev/zero
+    cat $sounddata
+    head -c $((3 * bytesPerSecond)) $negzeros
+    cat $sounddata
+    head -c $((3 * bytesPerSecond)) /dev/zero
+} > $data
+datasize=`wc -c < $data`
+{
+    printf 'RIFF'; le32 $((36 + datasize)); printf 'WAVE'
+    printf 'fmt '; le32 16; le16 3; le16 $channels; le32 $rate; le32 $bytesPerSecond; le16 $((channels * 4)); le16 32
+    printf 'data'; le32 $datasize
+    cat $data
+} > $input
+rm -f $sound $sounddata $negzeros $data
+
+for rate in $rates
+do
+    for mode in $modes
+    do
+        mode=${mode//_/ }
+        options="-r $rate -b 64f --noMetadata --noPeakChunk $mode"
+        fast=$output_path/silence-fast.wav
+        filtered=$output_path/silence-filtered.wav
+        $resampler_path -i $input -o $fast $options > /dev/null
+        $resampler_path -i $input -o $filtered $options --noSilenceFastPath > /dev/null
+        cmp -s $fast $filtered
+        check "$rate $mode: same as filtered" $?
+        rm -f $fast $filtered
+    done
+done
+
+# the fast path must have produced some of the output:
+profile=$output_path/silence-profile.json
+$resampler_path -i $input -o $output_path/silence-fast.wav -r 48000 --profile $profile > /dev/null
+grep -o '"silentSamples": [0-9]*' $profile | awk '{ total += $2 } END { exit !(total > 0) }'
+check "fast path taken" $?
+rm -f $profile $output_path/silence-fast.wav $input
+
+exit $failures
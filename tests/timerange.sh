@@ -0,0 +1,60 @@
+#!/usr/bin/env bash
+
+# timerange.sh : checks that converting part of a file (--start / --end) gives exactly
+# the same output as the corresponding part of a conversion of the whole file.
+#
+# Both conversions are written to csv files (one line per frame), so that they can be compared line-by-line.
+# Clipping protection is disabled, so that both conversions use the same gain.
+# Exits with a non-zero status if any comparison fails.
+#
+# usage: ./timerange.sh
+#
+# the range and conversions can be changed using environment variables, eg:
+#   START=1 END=4 RATES="44100 48000" FILTERS="--minphase" ./timerange.sh
+
+function tolower(){
+    echo $1 | sed "y/ABCDEFGHIJKLMNOPQRSTUVWXYZ/abcdefghijklmnopqrstuvwxyz/"
+}
+
+os=`tolower $OSTYPE`
+
+# set converter path according to OS:
+if [ $os == 'cygwin' ] || [ $os == 'msys' ]
+then
+    #Windows ...
+    resampler_path=../x64/Release/ReSampler.exe
+else
+    resampler_path=../ReSampler
+fi
+
+input=${INPUT:-"./inputs/96khz_sweep-3dBFS_32f.wav"}
+output_path=./outputs
+start=${START:-2} # (whole seconds, so that the first output frame of the range is start * rate)
+end=${END:-3}
+rates=${RATES:-"44100 48000 88200 192000"}
+filters=${FILTERS:-"--singleStage --multiStage --minphase --doubleprecision"}
+
+failures=0
+for rate in $rates
+do
+    for filter in $filters
+    do
+        full=$output_path/timerange-full.csv
+        part=$output_path/timerange-part.csv
+        $resampler_path -i $input -o $full -r $rate -b 32f --noClippingProtection $filter > /dev/null
+        $resampler_path -i $input -o $part -r $rate -b 32f --noClippingProtection $filter --start $start --end $end > /dev/null
+
+        first=$((start * rate + 1))
+        last=$((end * rate))
+        if sed -n "${first},${last}p" $full | cmp -s - $part
+        then
+            echo "$rate $filter: pass"
+        else
+            echo "$rate $filter: FAIL"
+            failures=$((failures + 1))
+        fi
+    done
+done
+
+rm -f $output_path/timerange-full.csv $output_path/timerange-part.csv
+exit $failures
@@ -0,0 +1,71 @@
+#!/usr/bin/env bash
+
+# vectorise.sh : checks channel-vectorised conversion (--vectoriseChannels) against per-channel conversion.
+# The outputs are not bit-identical: the channel-vectorised filters add up their products in a different order, and they use
+# every tap of the filter at every position (the per-channel SIMD filters leave out the last few taps at some positions,
+# depending on the filter length). No output sample may differ by more than 1e-5 (of full scale) in single precision,
+# or 1e-8 in double precision. Checked for 4-channel and 6-channel inputs, single-stage and multi-stage, in single and double precision,
+# starting part-way through the input (--start), and with small blocks (--blockSize).
+# Also checks that channel-vectorised conversion is actually used (with the option), and not used without it.
+# Exits with a non-zero status if any check fails.
+#
+# usage: ./vectorise.sh
+#
+# the conversions can be changed using environment variables, eg:
+#   RATES="48000" MODES="--singleStage --doubleprecision" ./vectorise.sh
+
+source ./common.sh
+
+output_path=./outputs
+rates=${RATES:-"96000 44100 32000"}
+modes=${MODES:-"--multiStage --singleStage --doubleprecision --singleStage_--doubleprecision --start_0.5 --blockSize_100"}
+# (options within a mode are separated by underscores)
+
+# samples <file> : print the samples of a 64-bit floating-point wav file, one per line
+function samples(){
+    offset=`grep -obUa data $1 | head -1 | cut -d: -f1`
+    tail -c +$((offset + 9)) $1 | od -A n -v -t f8 -w8
+}
+
+inputs=""
+for channels in 4 6
+do
+    input=$output_path/vectorise-input-$channels.wav
+    $resampler_path --generate $input -r 48000 --channels $channels --duration 2 > /dev/null
+    inputs="$inputs $input"
+done
+
+for input in $inputs
+do
+    for rate in $rates
+    do
+        for mode in $modes
+        do
+            mode=${mode//_/ }
+            name="`basename $input` -> $rate $mode"
+            tolerance=1e-5
+            if [[ $mode == *--doubleprecision* ]]
+            then
+                tolerance=1e-8
+            fi
+            options="-r $rate -b 64f --noMetadata --noPeakChunk $mode"
+            vectorised=$output_path/vectorise-vectorised.wav
+            perchannel=$output_path/vectorise-perchannel.wav
+            log=$output_path/vectorise.log
+            $resampler_path -i $input -o $vectorised $options --vectoriseChannels --showStages > $log
+            grep -q 'Channel-vectorised' $log
+            check "$name: channel-vectorised" $?
+            $resampler_path -i $input -o $perchannel $options --showStages > $log
+            ! grep -q 'Channel-vectorised' $log
+            check "$name: per-channel by default" $?
+            [ `wc -c < $vectorised` -eq `wc -c < $perchannel` ] &&
+                paste <(samples $vectorised) <(samples $perchannel) |
+                awk -v tolerance=$tolerance '{ d = $1 - $2; if (d < 0) d = -d; if (d > max) max = d } END { print "  max difference: " max + 0; exit !(max + 0 <= tolerance + 0) }'
+            check "$name: within $tolerance" $?
+            rm -f $vectorised $perchannel $log
+        done
+    done
+done
+
+rm -f $inputs
+exit $failures